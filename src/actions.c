@@ -3,7 +3,7 @@
 #include "adwm.h"
 #include "layout.h"
 #include "tags.h"
-#include "parse.h" /* for showchain */
+#include "parse.h" /* for showchain, findkey */
 #include "actions.h" /* verification */
 
 Bool
@@ -350,22 +350,20 @@ k_chain(XEvent *e, Key *key)
 
 	for (;;) {
 		XEvent ev;
-		KeySym keysym;
+		KeyCode code;
 		unsigned long mod;
 
 		XMaskEvent(dpy, KeyPressMask | KeyReleaseMask, &ev);
 		pushtime(ev.xkey.time);
-		keysym = XkbKeycodeToKeysym(dpy, (KeyCode) ev.xkey.keycode, 0, 0);
+		code = ev.xkey.keycode;
 		mod = CLEANMASK(ev.xkey.state);
 
 		switch (ev.type) {
-			Key *kp;
-
 		case KeyRelease:
-			XPRINTF("KeyRelease: 0x%02lx %s\n", mod, XKeysymToString(keysym));
+			XPRINTF("KeyRelease: 0x%02lx %s\n", mod, XKeysymToString(XkbKeycodeToKeysym(dpy, code, 0, 0)));
 			/* a key release other than the active key is a release of a
 			   modifier indicating a stop */
-			if (k && k->keysym != keysym) {
+			if (k && k->code != code) {
 				XPRINTF("KeyRelease: stopping sequence\n");
 				if (k->stop)
 					k->stop(&ev, k);
@@ -373,23 +371,18 @@ k_chain(XEvent *e, Key *key)
 			}
 			break;
 		case KeyPress:
-			XPRINTF("KeyPress: 0x%02lx %s\n", mod, XKeysymToString(keysym));
+			XPRINTF("KeyPress: 0x%02lx %s\n", mod, XKeysymToString(XkbKeycodeToKeysym(dpy, code, 0, 0)));
 			/* a press of a different key, even a modifier, or a press of the
 			   same key with a different modifier mask indicates a stop of
 			   the current sequence and the potential start of a new one */
-			if (k && (k->keysym != keysym || k->mod != mod)) {
+			if (k && (k->code != code || k->mod != mod)) {
 				XPRINTF("KeyPress: stopping sequence\n");
 				if (k->stop)
 					k->stop(&ev, k);
 				return;
 			}
-			for (kp = key->chain; !k && kp; kp = kp->cnext) {
-				XPRINTF("KeyPress: checking 0x%02lx %s against 0x%02lx %s\n",
-						mod, XKeysymToString(keysym),
-						kp->mod, XKeysymToString(kp->keysym));
-				if (kp->keysym == keysym && kp->mod == mod)
-					k = kp;
-			}
+			if (!k)
+				k = findkey(key, code, mod);
 			if (k) {
 				XPRINTF("KeyPress: activating action for chain: %s\n", showchain(k));
 				if (k->func)
@@ -400,7 +393,7 @@ k_chain(XEvent *e, Key *key)
 			}
 			/* Use the Escape key without modifiers to escape from a key
 			   chain. */
-			if (keysym == XK_Escape && !mod) {
+			if (!mod && XkbKeycodeToKeysym(dpy, code, 0, 0) == XK_Escape) {
 				XPRINTF("Escape KeyPress: stopping sequence\n");
 				return;
 			}
@@ -12,11 +12,11 @@
 #include "image.h"
 #include "icons.h"
 #include "save.h"
+#include "timer.h"
 
 #define EXTRANGE    16		/* all X11 extension event must fit in this range */
 
 /* function declarations */
-void compileregs(void);
 Group *getleader(Window leader, int group);
 Client *focusforw(Client *c);
 Client *focusback(Client *c);
@@ -78,6 +78,9 @@ XdgDirs xdgdirs = { NULL, };
 SnDisplay *sn_dpy;
 #endif
 XErrorTrap *traps = NULL;
+EventStats evstats = { 0, };
+WinMapStats wmstats = { 0, };
+ScanStats scanstats = { 0, };
 XrmDatabase xrdb = NULL;
 XrmDatabase srdb = NULL;
 Bool otherwm;
@@ -226,6 +229,7 @@ static Bool mappingnotify(XEvent *e);
 static Bool initmonitors(XEvent *e);
 #ifdef SYNC
 static Bool alarmnotify(XEvent *e);
+static void sync_timeout(Timer *t, void *data);
 #endif
 #ifdef DAMAGE
 static Bool damagenotify(XEvent *e);
@@ -325,8 +329,7 @@ applyrules(Client *c)
 {
 	static char buf[512];
 	int i;
-	unsigned j;
-	regmatch_t tmp;
+	unsigned long long matches;
 	Bool matched = False;
 	View *cv = c->cview ? : selview();
 	Monitor *cm = (cv && cv->curmon) ? cv->curmon : nearmonitor(); /* XXX: necessary? */
@@ -337,8 +340,10 @@ applyrules(Client *c)
 			c->ch.res_class ? : "", c->ch.res_name ? : "",
 			c->wm_role ? : "", c->wm_name ? : "");
 	buf[LENGTH(buf) - 1] = 0;
-	for (i = 0, r = rules[0]; i < nrules; i++, r = rules[i])
-		if (r->propregex && !regexec(r->propregex, buf, 1, &tmp, 0)) {
+	matches = matchrules(c->ch.res_class ? : "", buf);
+	for (i = 0; i < nrules; i++)
+		if (matches & (1ULL << i)) {
+			r = rules[i];
 #if 1
 			if (r->is.set.is) {
 				c->is.is |= (r->is.set.is & r->is.is.is);
@@ -363,11 +368,11 @@ applyrules(Client *c)
 				c->has.grips = False;
 #endif
 			if (r->tagregex) {
-				for (j = 0; j < scr->ntags; j++) {
-					if (!regexec(r->tagregex, scr->tags[j].name, 1, &tmp, 0)) {
-						matched = True;
-						c->tags |= (1ULL << j);
-					}
+				unsigned long long tags = ruletags(r);
+
+				if (tags) {
+					matched = True;
+					c->tags |= tags;
 				}
 			}
 		}
@@ -433,7 +438,7 @@ applystate(Client *c)
 
 		/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_HINTS properties
 		   they find on icon windows. */
-		if ((wmh = XGetWMHints(dpy, c->win))) {
+		if ((wmh = getwmhints(c->win))) {
 			applywmhints(c, wmh);
 			XFree(wmh);
 		}
@@ -543,6 +548,271 @@ relfocus(Client *c)
 	return refocus;
 }
 
+/*
+ * Attributes of the frame and the decoration windows of a client.  Dock app
+ * frames (tiles) must be created with the default visual: some set
+ * ParentRelative and icon windows must be default visual.  All other frames,
+ * titles and grips can be created with the 32 ARGB visual.
+ */
+static unsigned long
+frameattrs(Client *c, XSetWindowAttributes *twa, int *depth, Visual **visual)
+{
+	unsigned long mask = 0;
+
+	twa->override_redirect = True;
+	mask |= CWOverrideRedirect;
+	twa->event_mask = FRAMEMASK;
+	mask |= CWEventMask;
+	if (c->is.dockapp) {
+		twa->event_mask |= ExposureMask | MOUSEMASK;
+		*depth = DefaultDepth(dpy, scr->screen);
+		*visual = DefaultVisual(dpy, scr->screen);
+		twa->colormap = DefaultColormap(dpy, scr->screen);
+		mask |= CWColormap;
+		twa->background_pixel = scr->style.color.norm[ColBG].pixel;
+		mask |= CWBackPixel;
+	} else {
+		*depth = scr->depth;
+		*visual = scr->visual;
+		twa->colormap = scr->colormap;
+		mask |= CWColormap;
+		twa->border_pixel = BlackPixel(dpy, scr->screen);
+		mask |= CWBorderPixel;
+		twa->background_pixmap = None;
+		mask |= CWBackPixmap;
+	}
+	return (mask);
+}
+
+/*
+ * The title and grips windows of a client, with their pictures, text layer
+ * and icon, are only created when the client is first shown: clients managed
+ * onto views that are not displayed may never need them.  manage() merely
+ * notes in c->lazy which of them are due; until they are created the client
+ * is laid out as though they existed.
+ */
+static void
+realize(Client *c)
+{
+	XSetWindowAttributes twa = { 0, };
+	unsigned long mask;
+	Visual *visual;
+	int depth;
+	Bool shaded;
+
+	timer_stop(&c->lazy.timer);
+	if (!c->lazy.title && !c->lazy.grips)
+		return;
+	mask = frameattrs(c, &twa, &depth, &visual);
+	twa.event_mask = ExposureMask | MOUSEMASK | WINDOWMASK;
+	/* we create title as root's child as a workaround for 32bit visuals */
+	if (c->lazy.title) {
+		c->element = ecalloc(LastElement, sizeof(*c->element));
+		c->title = XCreateWindow(dpy, scr->root, 0, 0, c->c.w, scr->style.titleheight,
+					 0, depth, CopyFromParent, visual, mask, &twa);
+		winmap_save(c->title, ClientTitle, c);
+		winmap_save(c->title, ClientAny, c);
+		winmap_save(c->title, ScreenContext, scr);
+		XReparentWindow(dpy, c->title, c->frame, 0, 0);
+		c->lazy.title = False;
+	}
+	if (c->lazy.grips) {
+		c->grips = XCreateWindow(dpy, scr->root, 0, 0, c->c.w, scr->style.gripsheight,
+					 0, depth, CopyFromParent, visual, mask, &twa);
+		winmap_save(c->grips, ClientGrips, c);
+		winmap_save(c->grips, ClientAny, c);
+		winmap_save(c->grips, ScreenContext, scr);
+		XReparentWindow(dpy, c->grips, c->frame, 0, c->c.h - c->c.g);
+#if 0
+		c->tgrip = XCreateWindow(dpy, scr->root, 0, 0, c->c.w, scr->style.gripsheight,
+					 0, depth, CopyFromParent, visual, mask, &twa);
+		winmap_save(c->tgrip, ClientGrips, c);
+		winmap_save(c->tgrip, ClientAny, c);
+		winmap_save(c->tgrip, ScreenContext, scr);
+		XReparentWindow(dpy, c->tgrip, c->frame, 0, 0);
+		c->lgrip = XCreateWindow(dpy, scr->root, 0, 0, scr->style.gripsheight, c->c.h,
+					 0, depth, CopyFromParent, visual, mask, &twa);
+		winmap_save(c->lgrip, ClientGrips, c);
+		winmap_save(c->lgrip, ClientAny, c);
+		winmap_save(c->lgrip, ScreenContext, scr);
+		XReparentWindow(dpy, c->lgrip, c->frame, 0, 0);
+		c->rgrip = XCreateWindow(dpy, scr->root, 0, 0, scr->style.gripsheight, c->c.h,
+					 0, depth, CopyFromParent, visual, mask, &twa);
+		winmap_save(c->rgrip, ClientGrips, c);
+		winmap_save(c->rgrip, ClientAny, c);
+		winmap_save(c->rgrip, ScreenContext, scr);
+		XReparentWindow(dpy, c->rgrip, c->frame, 0, c->c.w - c->c.v);
+#endif
+		c->lazy.grips = False;
+	}
+	/* as reconfigure() would have placed them */
+	shaded = ((c->c.t || c->c.v) && c->is.shaded && (c != sel || !scr->options.autoroll));
+	if (c->title && c->c.t) {
+		XRectangle r = { c->c.v, c->c.v, c->c.w - 2 * c->c.v, c->c.t };
+
+		XMoveResizeWindow(dpy, c->title, r.x, r.y, r.width, r.height);
+		XMapWindow(dpy, c->title);
+	}
+	if (c->grips && c->c.g) {
+		XRectangle r = { 0, c->c.h - c->c.g, c->c.w - 2 * c->c.v, c->c.g };
+
+		XMoveResizeWindow(dpy, c->grips, r.x, r.y, r.width, r.height);
+		if (!shaded || c->c.v)
+			XMapWindow(dpy, c->grips);
+	}
+	if (c->tgrip && c->c.v) {
+		XRectangle tr = { 0, 0, c->c.w, c->c.v };
+		XRectangle lr = { 0, 0, c->c.v, c->c.h };
+		XRectangle rr = { c->c.w - c->c.v, 0, c->c.v, c->c.h };
+
+		XMoveResizeWindow(dpy, c->tgrip, tr.x, tr.y, tr.width, tr.height);
+		XMoveResizeWindow(dpy, c->lgrip, lr.x, lr.y, lr.width, lr.height);
+		XMoveResizeWindow(dpy, c->rgrip, rr.x, rr.y, rr.width, rr.height);
+		XMapWindow(dpy, c->tgrip);
+		XMapWindow(dpy, c->lgrip);
+		XMapWindow(dpy, c->rgrip);
+	}
+	drawstats.realized++;
+	XPRINTF(c, "updating icon due to first show\n");
+	ewmh_process_net_window_icon(c);
+	if (!c->is.dockapp)
+		configureshapes(c);
+	if ((c->title && c->c.t) || (c->grips && c->c.g) || (c->tgrip && c->c.v))
+		drawclient(c);
+}
+
+#ifdef XCAIRO
+/* the context and the surface it was created on are bound to the window */
+static void
+freecairo(cairo_t **cctx)
+{
+	cairo_surface_t *surf;
+
+	if (!*cctx)
+		return;
+	surf = cairo_get_target(*cctx);
+	cairo_destroy(*cctx);
+	cairo_surface_destroy(surf);
+	*cctx = NULL;
+}
+#endif
+
+/*
+ * Destroy the decoration windows of a client and what was drawn for them.
+ * The frame and the client window are left alone.
+ */
+static void
+unrealize(Client *c)
+{
+	timer_stop(&c->lazy.timer);
+#ifdef RENDER
+	freetextlayer(c);
+#endif
+	if (c->title) {
+#ifdef RENDER
+		if (c->pict.title) {
+			XRenderFreePicture(dpy, c->pict.title);
+			c->pict.title = None;
+		}
+#endif
+#ifdef XCAIRO
+		freecairo(&c->cctx.title);
+#endif
+		XDestroyWindow(dpy, c->title);
+		winmap_delete(c->title, ClientTitle);
+		winmap_delete(c->title, ClientAny);
+		winmap_delete(c->title, ScreenContext);
+		c->title = None;
+		free(c->element);
+		c->element = NULL;
+	}
+	if (c->grips) {
+#ifdef RENDER
+		if (c->pict.grips) {
+			XRenderFreePicture(dpy, c->pict.grips);
+			c->pict.grips = None;
+		}
+#endif
+#ifdef XCAIRO
+		freecairo(&c->cctx.grips);
+#endif
+		XDestroyWindow(dpy, c->grips);
+		winmap_delete(c->grips, ClientGrips);
+		winmap_delete(c->grips, ClientAny);
+		winmap_delete(c->grips, ScreenContext);
+		c->grips = None;
+	}
+	if (c->tgrip) {
+#ifdef RENDER
+		if (c->pict.tgrip) {
+			XRenderFreePicture(dpy, c->pict.tgrip);
+			c->pict.tgrip = None;
+		}
+#endif
+#ifdef XCAIRO
+		freecairo(&c->cctx.tgrip);
+#endif
+		XDestroyWindow(dpy, c->tgrip);
+		winmap_delete(c->tgrip, ClientGrips);
+		winmap_delete(c->tgrip, ClientAny);
+		winmap_delete(c->tgrip, ScreenContext);
+		c->tgrip = None;
+	}
+	if (c->lgrip) {
+#ifdef RENDER
+		if (c->pict.lgrip) {
+			XRenderFreePicture(dpy, c->pict.lgrip);
+			c->pict.lgrip = None;
+		}
+#endif
+#ifdef XCAIRO
+		freecairo(&c->cctx.lgrip);
+#endif
+		XDestroyWindow(dpy, c->lgrip);
+		winmap_delete(c->lgrip, ClientGrips);
+		winmap_delete(c->lgrip, ClientAny);
+		winmap_delete(c->lgrip, ScreenContext);
+		c->lgrip = None;
+	}
+	if (c->rgrip) {
+#ifdef RENDER
+		if (c->pict.rgrip) {
+			XRenderFreePicture(dpy, c->pict.rgrip);
+			c->pict.rgrip = None;
+		}
+#endif
+#ifdef XCAIRO
+		freecairo(&c->cctx.rgrip);
+#endif
+		XDestroyWindow(dpy, c->rgrip);
+		winmap_delete(c->rgrip, ClientGrips);
+		winmap_delete(c->rgrip, ClientAny);
+		winmap_delete(c->rgrip, ScreenContext);
+		c->rgrip = None;
+	}
+	c->drawn.title = False;
+	c->drawn.grips = False;
+}
+
+/*
+ * A client has stayed hidden for releasedelay: give back its decorations
+ * until it is shown again.
+ */
+static void
+release_timeout(Timer *t __attribute__((unused)), void *data)
+{
+	Client *c = data;
+
+	if (!c->is.banned || (!c->title && !c->grips))
+		return;
+	XPRINTF(c, "releasing decorations of hidden client\n");
+	c->lazy.title = c->title ? True : False;
+	c->lazy.grips = c->grips ? True : False;
+	unrealize(c);
+	removebutton(&c->button);
+	drawstats.released++;
+}
+
 static Bool
 check_unmapnotify(Display *dpy, XEvent *ev, XPointer arg)
 {
@@ -570,6 +840,8 @@ ban(Client *c)
 			XUnmapWindow(dpy, c->icon);
 		XSync(dpy, False);
 		XCheckIfEvent(dpy, &ev, &check_unmapnotify, (XPointer) c);
+		if ((c->title || c->grips) && scr->options.releasedelay > 0)
+			timer_start(&c->lazy.timer, scr->options.releasedelay * 1000UL, 0);
 	}
 }
 
@@ -604,6 +876,7 @@ unban(Client *c, View *v)
 			XMapWindow(dpy, c->win);
 	}
 	if (c->is.banned) {
+		realize(c);
 		XMapWindow(dpy, c->frame);
 		c->is.banned = False;
 		setclientstate(c, NormalState);
@@ -997,6 +1270,7 @@ cleanup(WithdrawCause cause)
 
 	/* free resource database */
 	XrmDestroyDatabase(xrdb);
+	flushresources();
 
 	for (scr = screens; scr < screens + nscr; scr++) {
 		freestyle();
@@ -1016,6 +1290,8 @@ cleanup(WithdrawCause cause)
 
 	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
 	XSync(dpy, False);
+	if (options.debug)
+		showstats();
 }
 
 static Bool
@@ -1077,7 +1353,7 @@ destroynotify(XEvent *e)
 		delsystray(ev->window);
 		return True;
 	}
-	XDeleteContext(dpy, ev->window, context[ScreenContext]);
+	winmap_delete(ev->window, ScreenContext);
 	return True;
 }
 
@@ -1333,6 +1609,11 @@ expose(XEvent *e)
 		/* might not be necessary any more... */
 		/* maybe we should just watch for damage on the backing pixmap and render 
 		   only the damage region. */
+		/* contents of the exposed window are lost */
+		if (ev->window == c->grips)
+			c->drawn.grips = False;
+		else
+			c->drawn.title = False;
 		drawclient(c);	/* just for exposure */
 		return True;
 	}
@@ -1580,6 +1861,8 @@ focus(Client *c)
 {
 	Client *o;
 
+	/* selection depends on which clients are banned */
+	arrangeneeded();
 	o = sel;
 	/* note that the client does not necessarily have to be focusable to be selected. */
 	if ((!c && scr->managed) || (c && !selectok(c)))
@@ -2001,13 +2284,141 @@ decmargin(unsigned px)
 	setmargin(scr->style.margin - px);
 }
 
+/*
+ * Window table.  Every window that belongs to a client (frame, title, grips,
+ * icon, user time window and the client window itself) and every window that
+ * is known to belong to a screen is kept in an open-addressing hash table
+ * keyed by window, so that events can be mapped to their client and screen
+ * without going through Xlib's context manager or the server.  Collisions are
+ * resolved by linear probing; removal shifts following entries back so that
+ * no tombstones are needed.  The table is kept at most half full.
+ */
+static struct {
+	WinEntry *slots;
+	unsigned bits;			/* log2 of the number of slots */
+	unsigned count;			/* live entries */
+} winmap;
+
+static inline unsigned
+winmap_hash(Window w)
+{
+	return (unsigned) (((unsigned long long) w * 0x9e3779b97f4a7c15ULL) >> (64 - winmap.bits));
+}
+
+static WinEntry *
+winmap_slot(Window w)
+{
+	unsigned mask = (1U << winmap.bits) - 1, i = winmap_hash(w);
+	WinEntry *e;
+
+	wmstats.lookups++;
+	for (wmstats.probes++; (e = winmap.slots + i)->win && e->win != w; i = (i + 1) & mask)
+		wmstats.probes++;
+	return (e);
+}
+
+static void
+winmap_grow(void)
+{
+	WinEntry *old = winmap.slots, *e;
+	unsigned n = old ? (1U << winmap.bits) : 0, i;
+
+	winmap.bits = old ? winmap.bits + 1 : 8;
+	winmap.slots = ecalloc(1U << winmap.bits, sizeof(*winmap.slots));
+	for (i = 0; i < n; i++)
+		if (old[i].win) {
+			e = winmap_slot(old[i].win);
+			*e = old[i];
+		}
+	free(old);
+}
+
+WinEntry *
+winmap_find(Window w)
+{
+	WinEntry *e;
+
+	if (!w || !winmap.count)
+		return (NULL);
+	e = winmap_slot(w);
+	return (e->win ? e : NULL);
+}
+
+void
+winmap_save(Window w, int part, void *data)
+{
+	WinEntry *e;
+
+	if (!w)
+		return;
+	if (!winmap.slots || 2 * (winmap.count + 1) > (1U << winmap.bits))
+		winmap_grow();
+	if (!(e = winmap_slot(w))->win) {
+		memset(e, 0, sizeof(*e));
+		e->win = w;
+		winmap.count++;
+	}
+	if (part == ScreenContext) {
+		e->screen = data;
+		return;
+	}
+	if (e->client != data) {
+		freeprops(e);
+		e->client = data;
+		e->parts = 0;
+	}
+	e->parts |= WINPART(part);
+}
+
+void
+winmap_delete(Window w, int part)
+{
+	unsigned mask, i, j, k;
+	WinEntry *e;
+
+	if (!(e = winmap_find(w)))
+		return;
+	if (part == ScreenContext)
+		e->screen = NULL;
+	else if (!(e->parts &= ~WINPART(part))) {
+		freeprops(e);
+		e->client = NULL;
+	}
+	if (e->client || e->screen)
+		return;
+	/* backward shift deletion */
+	mask = (1U << winmap.bits) - 1;
+	for (i = j = e - winmap.slots;;) {
+		memset(winmap.slots + i, 0, sizeof(*winmap.slots));
+		for (;;) {
+			j = (j + 1) & mask;
+			if (!winmap.slots[j].win)
+				goto done;
+			k = winmap_hash(winmap.slots[j].win);
+			/* move back the first entry whose home is not in (i,j] */
+			if (i <= j ? (i >= k || k > j) : (i >= k && k > j))
+				break;
+		}
+		winmap.slots[i] = winmap.slots[j];
+		i = j;
+	}
+      done:
+	winmap.count--;
+}
+
 Client *
 getclient(Window w, int part)
 {
 	Client *c = NULL;
+	WinEntry *e;
 
+	if (WINPART(part) & WINPARTS) {
+		if ((e = winmap_find(w)) && (e->parts & WINPART(part)))
+			c = e->client;
+		return (c);
+	}
 	XFindContext(dpy, w, context[part], (XPointer *) &c);
-	return c;
+	return (c);
 }
 
 Client *
@@ -2020,31 +2431,16 @@ getmanaged(Window w, int part)
 	return (NULL);
 }
 
+/*
+ * Pointer, crossing and focus events are reported against the window that
+ * selected them, and all such windows that belong to a client are in the
+ * window table; so there is no need to walk up the window tree (and grab the
+ * server to do so) to find the client that owns an event window.
+ */
 Client *
 findclient(Window fwind)
 {
-	Client *c = NULL;
-	Window froot = None, fparent = None, *children = NULL;
-	unsigned int nchild = 0;
-
-	xtrap_push(0,NULL);
-	XGrabServer(dpy);
-
-	do {
-		if (children) {
-			XFree(children);
-			children = NULL;
-		}
-		XFindContext(dpy, froot, context[ScreenContext], (XPointer *) &scr);
-		XFindContext(dpy, fwind, context[ClientAny], (XPointer *) &c);
-	}
-	while (!c && fwind != froot && (!froot || fparent != froot) &&
-	       XQueryTree(dpy, fwind, &froot, &fparent, &children, &nchild));
-
-	XUngrabServer(dpy);
-	xtrap_pop();
-
-	return (c);
+	return getclient(fwind, ClientAny);
 }
 
 Client *
@@ -2060,19 +2456,19 @@ findmanaged(Window fwind)
 long
 getstate(Window w)
 {
-	int format, status;
-	long *ret = NULL, val = -1;
-	unsigned long extra, nitems = 0;
-	Atom real;
-
-	/* note this deletes property on read */
-	status = XGetWindowProperty(dpy, w, _XA_WM_STATE, 0L, 1L, True, _XA_WM_STATE,
-				    &real, &format, &nitems, &extra,
-				    (unsigned char **) &ret);
-	if (status == Success && nitems > 0)
-		val = ret[0];
-	if (ret)
+	long *ret, val = -1;
+	unsigned long nitems = 0;
+	Atom real = None;
+
+	if ((ret = getproperty(w, _XA_WM_STATE, &real, NULL, &nitems))) {
+		if (real == _XA_WM_STATE)
+			val = ret[0];
 		XFree(ret);
+	}
+	/* note this deletes the property, as a read with delete set would: that is
+	   only when it is no longer than the one item that is read */
+	if (real == _XA_WM_STATE && nitems <= 1)
+		XDeleteProperty(dpy, w, _XA_WM_STATE);
 	return (val);
 }
 
@@ -2107,39 +2503,39 @@ getcmapwins(Window w)
 const char *
 getresource(const char *resource, const char *defval)
 {
-	static char name[256], clas[256], *type = NULL;
-	XrmValue value = { 0, NULL };
+	static char name[256], clas[256];
+	const char *value;
 
 	snprintf(name, sizeof(name), "%s.%s", RESNAME, resource);
 	snprintf(clas, sizeof(clas), "%s.%s", RESCLASS, resource);
-	if (XrmGetResource(xrdb, name, clas, &type, &value) && value.addr)
-		return value.addr;
+	if ((value = lookupres(xrdb, name, clas)))
+		return value;
 	return defval;
 }
 
 const char *
 getscreenres(const char *resource, const char *defval)
 {
-	static char name[256], clas[256], *type = NULL;
-	XrmValue value = { 0, NULL };
+	static char name[256], clas[256];
+	const char *value;
 
 	snprintf(name, sizeof(name), "%s.screen%d.%s", RESNAME, scr->screen, resource);
 	snprintf(clas, sizeof(clas), "%s.Screen%d.%s", RESCLASS, scr->screen, resource);
-	if (XrmGetResource(xrdb, name, clas, &type, &value) && value.addr)
-		return value.addr;
+	if ((value = lookupres(xrdb, name, clas)))
+		return value;
 	return defval;
 }
 
 const char *
 getsessionres(const char *resource, const char *defval)
 {
-	static char name[256], clas[256], *type = NULL;
-	XrmValue value = { 0, NULL };
+	static char name[256], clas[256];
+	const char *value;
 
 	snprintf(name, sizeof(name), "%s.session.%s", RESNAME, resource);
 	snprintf(clas, sizeof(clas), "%s.Session.%s", RESCLASS, resource);
-	if (XrmGetResource(xrdb, name, clas, &type, &value) && value.addr)
-		return value.addr;
+	if ((value = lookupres(xrdb, name, clas)))
+		return value;
 	return defval;
 }
 
@@ -2258,7 +2654,7 @@ gettextprop(Window w, Atom atom, char **text)
 	int n = 0;
 	XTextProperty name = { NULL, };
 
-	if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems)
+	if (!gettextproperty(w, atom, &name) || !name.nitems)
 		return False;
 	if (name.encoding == XA_STRING) {
 		if ((str = strndup((char *) name.value, name.nitems))) {
@@ -2321,6 +2717,7 @@ grabkeys(void)
 	KeyCode code;
 	Key *k;
 
+	mapkeys();
 	XUngrabKey(dpy, AnyKey, AnyModifier, scr->root);
 	for (k = scr->keylist; k; k = k->cnext) {
 		if ((code = XKeysymToKeycode(dpy, k->keysym))) {
@@ -2348,20 +2745,20 @@ keypress(XEvent *e)
 
 	do {
 		XEvent ev;
-		KeySym keysym;
+		KeyCode code;
 		unsigned long mod;
 
 		XMaskEvent(dpy, KeyPressMask | KeyReleaseMask, &ev);
 		pushtime(ev.xkey.time);
-		keysym = XkbKeycodeToKeysym(dpy, (KeyCode) ev.xkey.keycode, 0, 0);
+		code = ev.xkey.keycode;
 		mod = CLEANMASK(ev.xkey.state);
 
 		switch (ev.type) {
 		case KeyRelease:
-			XPRINTF("KeyRelease: 0x%02lx %s\n", mod, XKeysymToString(keysym));
+			XPRINTF("KeyRelease: 0x%02lx %s\n", mod, XKeysymToString(XkbKeycodeToKeysym(dpy, code, 0, 0)));
 			/* a key release other than the active key is a release of a
 			   modifier indicating a stop */
-			if (k && k->keysym != keysym) {
+			if (k && k->code != code) {
 				XPRINTF("KeyRelease: stopping sequence\n");
 				if (k->stop)
 					k->stop(&ev, k);
@@ -2369,21 +2766,18 @@ keypress(XEvent *e)
 			}
 			break;
 		case KeyPress:
-			XPRINTF("KeyPress: 0x%02lx %s\n", mod, XKeysymToString(keysym));
+			XPRINTF("KeyPress: 0x%02lx %s\n", mod, XKeysymToString(XkbKeycodeToKeysym(dpy, code, 0, 0)));
 			/* a press of a different key, even a modifier, or a press of the
 			   same key with a different modifier mask indicates a stop of
 			   the current sequence and the potential start of a new one */
-			if (k && (k->keysym != keysym || k->mod != mod)) {
+			if (k && (k->code != code || k->mod != mod)) {
 				XPRINTF("KeyPress: stopping sequence\n");
 				if (k->stop)
 					k->stop(&ev, k);
 				k = NULL;
 			}
-			if (!k) {
-				for (k = scr->keylist; k; k = k->cnext)
-					if (k->keysym == keysym && k->mod == mod)
-						break;
-			}
+			if (!k)
+				k = findkey(NULL, code, mod);
 			if (k) {
 				XPRINTF("KeyPress: activating action for chain: %s\n", showchain(k));
 				handled = True;
@@ -2485,12 +2879,14 @@ leavenotify(XEvent *e)
 {
 	XCrossingEvent *ev = &e->xcrossing;
 	Client *c;
+	AScreen *as;
 
 	if (e->type != LeaveNotify || ev->mode != NotifyNormal || ev->detail == NotifyInferior)
 		return False;
 
 	if (!ev->same_screen) {
-		XFindContext(dpy, ev->window, context[ScreenContext], (XPointer *) &scr);
+		if ((as = getscreen(ev->window, False)))
+			scr = as;
 		if (!scr->managed)
 			focus(NULL); /* XXX */
 	}
@@ -2629,9 +3025,16 @@ manage(Window w, XWindowAttributes *wa)
 	c->win = w;
 	c->name = ecalloc(1, 1);
 	c->icon_name = ecalloc(1, 1);
-	XSaveContext(dpy, c->win, context[ClientWindow], (XPointer) c);
-	XSaveContext(dpy, c->win, context[ClientAny], (XPointer) c);
-	XSaveContext(dpy, c->win, context[ScreenContext], (XPointer) scr);
+	/* Properties of the client window are cached from the first read on:
+	   select PropertyNotify before that read, so that any later change is
+	   reported.  Requests are processed in order, so no XSync() is needed. */
+	XSelectInput(dpy, c->win, PropertyChangeMask);
+	winmap_save(c->win, ClientWindow, c);
+	winmap_save(c->win, ClientAny, c);
+	winmap_save(c->win, ScreenContext, scr);
+#ifdef SYNC
+	timer_init(&c->sync.timer, sync_timeout, c);
+#endif
 	c->has.has = -1U;
 	c->needs.has = -1U;
 	c->can.can = -1U;
@@ -2644,10 +3047,10 @@ manage(Window w, XWindowAttributes *wa)
 		ewmh_process_kde_net_window_type_override(c);
 	}
 	if (c->icon) {
-		XSaveContext(dpy, c->icon, context[ClientIcon], (XPointer) c);
+		winmap_save(c->icon, ClientIcon, c);
 		if (c->icon != c->win) {
-			XSaveContext(dpy, c->icon, context[ClientAny], (XPointer) c);
-			XSaveContext(dpy, c->icon, context[ScreenContext], (XPointer) scr);
+			winmap_save(c->icon, ClientAny, c);
+			winmap_save(c->icon, ScreenContext, scr);
 		}
 	}
 	// c->tags = 0;
@@ -2683,7 +3086,7 @@ manage(Window w, XWindowAttributes *wa)
 
 	/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_TRANSIENT_FOR properties
 	   they find on icon windows. */
-	if (XGetTransientForHint(dpy, w, &trans) || c->is.grptrans) {
+	if (gettransientfor(w, &trans) || c->is.grptrans) {
 		if (trans == None || trans == scr->root) {
 			trans = c->leader;
 			c->is.grptrans = True;
@@ -2814,76 +3217,22 @@ manage(Window w, XWindowAttributes *wa)
 		XGrabButton(dpy, Button3, AnyModifier, c->icon, True,
 			    ButtonPressMask, GrabModeSync, GrabModeAsync, None, None);
 	}
-	twa.override_redirect = True;
-	mask |= CWOverrideRedirect;
-	twa.event_mask = FRAMEMASK;
-	mask |= CWEventMask;
-	if (c->is.dockapp) {
-		/* dockapp frames (tiles) must be created with default visual */
-		/* some set ParentRelative and icon windows must be default visual */
-		twa.event_mask |= ExposureMask | MOUSEMASK;
-		depth = DefaultDepth(dpy, scr->screen);
-		visual = DefaultVisual(dpy, scr->screen);
-		twa.colormap = DefaultColormap(dpy, scr->screen);
-		mask |= CWColormap;
-		twa.background_pixel = scr->style.color.norm[ColBG].pixel;
-		mask |= CWBackPixel;
-	} else {
-		/* all other frames, titles, grips can be created with 32 ARGB visual */
-		depth = scr->depth;
-		visual = scr->visual;
-		twa.colormap = scr->colormap;
-		mask |= CWColormap;
-		twa.border_pixel = BlackPixel(dpy, scr->screen);
-		mask |= CWBorderPixel;
-		twa.background_pixmap = None;
-		mask |= CWBackPixmap;
-	}
+	mask = frameattrs(c, &twa, &depth, &visual);
 	updatecmapwins(c);
 	c->frame = XCreateWindow(dpy, scr->root, c->c.x, c->c.y, c->c.w, c->c.h,
 				 c->c.b, depth, InputOutput, visual, mask, &twa);
-	XSaveContext(dpy, c->frame, context[ClientFrame], (XPointer) c);
-	XSaveContext(dpy, c->frame, context[ClientAny], (XPointer) c);
-	XSaveContext(dpy, c->frame, context[ScreenContext], (XPointer) scr);
+	winmap_save(c->frame, ClientFrame, c);
+	winmap_save(c->frame, ClientAny, c);
+	winmap_save(c->frame, ScreenContext, scr);
 
 	wc.border_width = c->c.b;
 	XConfigureWindow(dpy, c->frame, CWBorderWidth, &wc);
 	XSetWindowBorder(dpy, c->frame, scr->style.color.norm[ColBorder].pixel);
 
-	twa.event_mask = ExposureMask | MOUSEMASK | WINDOWMASK;
-	/* we create title as root's child as a workaround for 32bit visuals */
-	if (c->needs.title) {
-		c->element = ecalloc(LastElement, sizeof(*c->element));
-		c->title = XCreateWindow(dpy, scr->root, 0, 0, c->c.w, scr->style.titleheight,
-					 0, depth, CopyFromParent, visual, mask, &twa);
-		XSaveContext(dpy, c->title, context[ClientTitle], (XPointer) c);
-		XSaveContext(dpy, c->title, context[ClientAny], (XPointer) c);
-		XSaveContext(dpy, c->title, context[ScreenContext], (XPointer) scr);
-	}
-	if (c->needs.grips) {
-		c->grips = XCreateWindow(dpy, scr->root, 0, 0, c->c.w, scr->style.gripsheight,
-					 0, depth, CopyFromParent, visual, mask, &twa);
-		XSaveContext(dpy, c->grips, context[ClientGrips], (XPointer) c);
-		XSaveContext(dpy, c->grips, context[ClientAny], (XPointer) c);
-		XSaveContext(dpy, c->grips, context[ScreenContext], (XPointer) scr);
-#if 0
-		c->tgrip = XCreateWindow(dpy, scr->root, 0, 0, c->c.w, scr->style.gripsheight,
-					 0, depth, CopyFromParent, visual, mask, &twa);
-		XSaveContext(dpy, c->tgrip, context[ClientGrips], (XPointer) c);
-		XSaveContext(dpy, c->tgrip, context[ClientAny], (XPointer) c);
-		XSaveContext(dpy, c->tgrip, context[ScreenContext], (XPointer) scr);
-		c->lgrip = XCreateWindow(dpy, scr->root, 0, 0, scr->style.gripsheight, c->c.h,
-					 0, depth, CopyFromParent, visual, mask, &twa);
-		XSaveContext(dpy, c->lgrip, context[ClientGrips], (XPointer) c);
-		XSaveContext(dpy, c->lgrip, context[ClientAny], (XPointer) c);
-		XSaveContext(dpy, c->lgrip, context[ScreenContext], (XPointer) scr);
-		c->rgrip = XCreateWindow(dpy, scr->root, 0, 0, scr->style.gripsheight, c->c.h,
-					 0, depth, CopyFromParent, visual, mask, &twa);
-		XSaveContext(dpy, c->rgrip, context[ClientGrips], (XPointer) c);
-		XSaveContext(dpy, c->rgrip, context[ClientAny], (XPointer) c);
-		XSaveContext(dpy, c->rgrip, context[ScreenContext], (XPointer) scr);
-#endif
-	}
+	/* title and grips are created by realize() when the client is first shown */
+	c->lazy.title = c->needs.title ? True : False;
+	c->lazy.grips = c->needs.grips ? True : False;
+	timer_init(&c->lazy.timer, release_timeout, c);
 
 	addclient(c, False, False, True);
 
@@ -2923,16 +3272,6 @@ manage(Window w, XWindowAttributes *wa)
 		XSelectInput(dpy, c->win, CLIENTMASK);
 		updateshape(c);
 		XReparentWindow(dpy, c->win, c->frame, 0, c->c.t);
-		if (c->title)
-			XReparentWindow(dpy, c->title, c->frame, 0, 0);
-		if (c->tgrip)
-			XReparentWindow(dpy, c->tgrip, c->frame, 0, 0);
-		if (c->grips)
-			XReparentWindow(dpy, c->grips, c->frame, 0, c->c.h - c->c.g);
-		if (c->lgrip)
-			XReparentWindow(dpy, c->lgrip, c->frame, 0, 0);
-		if (c->rgrip)
-			XReparentWindow(dpy, c->rgrip, c->frame, 0, c->c.w - c->c.v);
 		XConfigureWindow(dpy, c->win, CWBorderWidth, &wc);
 		XMapWindow(dpy, c->win);
 	}
@@ -2951,38 +3290,10 @@ manage(Window w, XWindowAttributes *wa)
 	ewmh_process_net_startup_id(c);
 	ewmh_update_net_window_desktop(c);
 	ewmh_update_net_window_extents(c);
-	XPRINTF(c, "updating icon due initial manage\n");
-	ewmh_process_net_window_icon(c);
 	ewmh_update_ob_app_props(c);
 
-	if (c->title && c->c.t) {
-		XRectangle r = { 0, 0, c->c.w, c->c.t };
-
-		XMoveResizeWindow(dpy, c->title, r.x, r.y, r.width, r.height);
-		XMapWindow(dpy, c->title);
-	}
-	if (c->grips && c->c.g) {
-		XRectangle r = { 0, c->c.h - c->c.g, c->c.w, c->c.g };
-
-		XMoveResizeWindow(dpy, c->grips, r.x, r.y, r.width, r.height);
-		XMapWindow(dpy, c->grips);
-	}
-	if (c->tgrip && c->c.v) {
-		XRectangle tr = { 0, 0, c->c.w, c->c.v };
-		XRectangle lr = { 0, 0, c->c.v, c->c.h };
-		XRectangle rr = { c->c.w - c->c.v, 0, c->c.v, c->c.h };
-
-		XMoveResizeWindow(dpy, c->tgrip, tr.x, tr.y, tr.width, tr.height);
-		XMoveResizeWindow(dpy, c->lgrip, lr.x, lr.y, lr.width, lr.height);
-		XMoveResizeWindow(dpy, c->rgrip, rr.x, rr.y, rr.width, rr.height);
-		XMapWindow(dpy, c->tgrip);
-		XMapWindow(dpy, c->lgrip);
-		XMapWindow(dpy, c->rgrip);
-	}
 	if (!c->is.dockapp)
 		configureshapes(c);
-	if ((c->title && c->c.t) || (c->grips && c->c.g) || (c->tgrip && c->c.v))
-		drawclient(c);
 
 	if (c->with.struts) {
 		ewmh_update_net_work_area();
@@ -3014,8 +3325,15 @@ mappingnotify(XEvent *e)
 	XMappingEvent *ev = &e->xmapping;
 
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard)
-		grabkeys();
+	if (ev->request == MappingKeyboard) {
+		AScreen *save = scr;
+
+		/* keycodes changed for every screen */
+		for (scr = screens; scr < screens + nscr; scr++)
+			if (scr->managed)
+				grabkeys();
+		scr = save;
+	}
 	return True;
 }
 
@@ -3025,20 +3343,28 @@ maprequest(XEvent *e)
 	XWindowAttributes wa = { 0, };
 	Client *c;
 	XMapRequestEvent *ev = &e->xmaprequest;
+	Bool result = True;
 
-	if (!XGetWindowAttributes(dpy, ev->window, &wa))
-		return True;
-	if (wa.override_redirect) {
-		manageoverride(ev->window, &wa);
-		return True;
-	}
-	if (issystray(ev->window))
-		return True;
+	/* for a new window fetch attributes and properties for manage() in one go */
 	if (!(c = getclient(ev->window, ClientWindow))) {
-		manage(ev->window, &wa);
+		/* manage() caches what is prefetched: see there */
+		if (!issystray(ev->window))
+			XSelectInput(dpy, ev->window, PropertyChangeMask);
+		prefetch(&ev->window, 1, &wa);
+	} else if (!XGetWindowAttributes(dpy, ev->window, &wa))
 		return True;
+	if (wa.root) {
+		if (wa.override_redirect)
+			manageoverride(ev->window, &wa);
+		else if (issystray(ev->window))
+			;
+		else if (!c)
+			manage(ev->window, &wa);
+		else
+			result = False;
 	}
-	return False;
+	endprefetch();
+	return result;
 }
 
 void
@@ -3220,6 +3546,54 @@ selview()
 
 #ifdef SYNC
 
+#define SYNCTIMEOUT	1000	/* most msec to wait for a client to update its counter */
+#define SYNCMINWAIT	100	/* least msec to wait once the client's latency is known */
+#define SYNCMISSES	3	/* timeouts in a row before resizing unsynchronized */
+
+SyncStats syncstats = { 0, };
+
+/*
+ * How long to wait for an answer: a few times what the client usually takes,
+ * within SYNCMINWAIT and SYNCTIMEOUT.
+ */
+static unsigned long
+sync_wait(Client *c)
+{
+	unsigned long msec;
+
+	if (!c->sync.latency)
+		return SYNCTIMEOUT;
+	msec = 4 * c->sync.latency / 1000;
+	return (msec < SYNCMINWAIT) ? SYNCMINWAIT : (msec > SYNCTIMEOUT) ? SYNCTIMEOUT : msec;
+}
+
+static void
+sync_record(Client *c, unsigned bucket)
+{
+	c->sync.hist[bucket]++;
+	syncstats.hist[bucket]++;
+}
+
+/*
+ * The client answered the outstanding request in time: fold the latency into
+ * its running average and histogram.
+ */
+static void
+sync_answered(Client *c)
+{
+	struct timeval now, d;
+	unsigned long usec, msec;
+	unsigned bucket;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &c->sync.sent, &d);
+	usec = d.tv_sec * 1000000 + d.tv_usec;
+	c->sync.latency = c->sync.latency ? (7 * c->sync.latency + usec) / 8 : usec;
+	c->sync.misses = 0;
+	for (bucket = 0, msec = usec / 1000; msec && bucket < SYNCBUCKETS - 2; bucket++, msec >>= 1) ;
+	sync_record(c, bucket);
+}
+
 void
 sync_request(Client *c, Time time)
 {
@@ -3258,6 +3632,41 @@ sync_request(Client *c, Time time)
 	XSendEvent(dpy, c->win, False, NoEventMask, &ce);
 
 	c->sync.waiting = True;
+	c->sync.requests++;
+	syncstats.requests++;
+	gettimeofday(&c->sync.sent, NULL);
+	timer_start(&c->sync.timer, sync_wait(c), 0);
+}
+
+/*
+ * The client did not update its counter in time: stop waiting for it and
+ * configure it to the current frame size without synchronizing.  After
+ * SYNCMISSES timeouts in a row newsize() stops synchronizing altogether until
+ * a late answer arrives in alarmnotify().
+ */
+static void
+sync_timeout(Timer *t __attribute__((unused)), void *data)
+{
+	Client *c = data;
+	XWindowChanges wc = { 0, };
+	unsigned mask = 0;
+
+	if (!c->sync.waiting)
+		return;
+	c->sync.waiting = False;
+	sync_record(c, SYNCBUCKETS - 1);
+	if (++c->sync.misses == SYNCMISSES)
+		EPRINTF(__CFMTS(c) "not answering sync requests: resizing unsynchronized\n", __CARGS(c));
+	if ((wc.width = c->c.w - 2 * c->c.v) != c->sync.w)
+		mask |= CWWidth;
+	if ((wc.height = c->c.h - c->c.t - c->c.g - c->c.v) != c->sync.h)
+		mask |= CWHeight;
+	if (mask) {
+		xtrap_push(1,_WCFMTS(wc, mask), _WCARGS(wc, mask));
+		XConfigureWindow(dpy, c->win, mask, &wc);
+		xtrap_pop();
+		XFlush(dpy);
+	}
 }
 
 Bool
@@ -3265,6 +3674,11 @@ newsize(Client *c, int w, int h, Time time)
 {
 	if (!c->sync.alarm)
 		return True;
+	if (c->sync.misses >= SYNCMISSES) {
+		/* client is not answering: resize without it */
+		syncstats.unsynced++;
+		return True;
+	}
 	if (c->sync.waiting) {
 		XPRINTF("Deferring size request from %dx%d to %dx%d for 0x%08lx 0x%08lx %s\n",
 		     c->c.w - 2 * c->c.v, c->c.h - c->c.t - c->c.g - c->c.v, w, h, c->frame, c->win, c->name);
@@ -3293,9 +3707,16 @@ alarmnotify(XEvent *e)
 	XPRINTF(c, "alarm notify on 0x%08lx\n", ae->alarm);
 	if (!c->sync.waiting) {
 		XPRINTF("%s", "Alarm was cancelled!\n");
+		/* answered after all: synchronize with it again */
+		if (c->sync.misses) {
+			syncstats.late++;
+			c->sync.misses = 0;
+		}
 		return True;
 	}
 	c->sync.waiting = False;
+	timer_stop(&c->sync.timer);
+	sync_answered(c);
 
 	if ((wc.width = c->c.w - 2 * c->c.v) != c->sync.w) {
 		XPRINTF("Width changed from %d to %u since last request\n", c->sync.w, wc.width);
@@ -4131,6 +4552,7 @@ propertynotify(XEvent *e)
 	unsigned i, n = 0;
 	Bool result = False;
 
+	forgetprop(ev->window, ev->atom);
 	if ((m = getgroup(ev->window, ClientSession, &n))) {
 		for (i = 0; i < n; i++)
 			if ((c = getmanaged(m[i], ClientWindow)))
@@ -4242,16 +4664,19 @@ getscreen(Window win, Bool query)
 	Window *wins = NULL, wroot, parent;
 	unsigned int num;
 	AScreen *s = NULL;
+	WinEntry *e;
 
 	if (!win)
 		return (s);
-	if (!XFindContext(dpy, win, context[ScreenContext], (XPointer *) &s))
-		return (s);
+	if ((e = winmap_find(win)) && e->screen)
+		return (e->screen);
 	if (!query)
 		return (s);
+	if (nscr == 1)
+		return (screens);
 	xtrap_push(1,NULL);
 	if (XQueryTree(dpy, win, &wroot, &parent, &wins, &num))
-		XFindContext(dpy, wroot, context[ScreenContext], (XPointer *) &s);
+		s = getscreen(wroot, False);
 	else
 		EPRINTF("XQueryTree(0x%lx) failed!\n", win);
 	xtrap_pop();
@@ -4281,11 +4706,306 @@ geteventscr(XEvent *ev)
 	return (event_scr);
 }
 
+/*
+ * Event coalescing.  Events that are already queued are read into a batch and
+ * redundant events are collapsed before dispatch: only the last PropertyNotify
+ * for a given window and atom, the last Expose and MotionNotify for a window,
+ * and the last ConfigureRequest for a window (with the value masks of earlier
+ * requests merged into it) are kept.  An EnterNotify is dropped when pointer
+ * crossings later in the same batch supersede it.  An earlier event is never
+ * collapsed across an intervening event of another type for the same window.
+ *
+ * Reading stops after any event whose handler may run a nested event loop
+ * (grabs for interactive moves, key chains, selection handoff), so that such
+ * loops see the remaining events on the Xlib queue in order.
+ */
+static Bool
+isbarrierevent(XEvent *ev)
+{
+	switch (ev->type) {
+	case KeyPress:
+	case KeyRelease:
+	case ButtonPress:
+	case ButtonRelease:
+	case ClientMessage:
+	case SelectionClear:
+	case SelectionRequest:
+	case MappingNotify:
+		return True;
+	default:
+		return (ev->type >= LASTEvent);
+	}
+}
+
+static Window
+eventwindow(XEvent *ev)
+{
+	switch (ev->type) {
+	case ConfigureRequest:
+		return ev->xconfigurerequest.window;
+	case MapRequest:
+		return ev->xmaprequest.window;
+	case UnmapNotify:
+		return ev->xunmap.window;
+	case DestroyNotify:
+		return ev->xdestroywindow.window;
+	case ReparentNotify:
+		return ev->xreparent.window;
+	case MapNotify:
+		return ev->xmap.window;
+	case ConfigureNotify:
+		return ev->xconfigure.window;
+	default:
+		return ev->xany.window;
+	}
+}
+
+/* whether an EnterNotify may be superseded across this event */
+static Bool
+iscrossingevent(XEvent *ev)
+{
+	switch (ev->type) {
+	case EnterNotify:
+	case LeaveNotify:
+	case MotionNotify:
+	case Expose:
+	case PropertyNotify:
+	case ConfigureNotify:
+		return True;
+	default:
+		return False;
+	}
+}
+
+static void
+mergeconfigurerequest(XConfigureRequestEvent *from, XConfigureRequestEvent *to)
+{
+	unsigned long mask = from->value_mask & ~to->value_mask;
+
+	if (mask & CWX)
+		to->x = from->x;
+	if (mask & CWY)
+		to->y = from->y;
+	if (mask & CWWidth)
+		to->width = from->width;
+	if (mask & CWHeight)
+		to->height = from->height;
+	if (mask & CWBorderWidth)
+		to->border_width = from->border_width;
+	if (mask & CWSibling)
+		to->above = from->above;
+	if (mask & CWStackMode)
+		to->detail = from->detail;
+	to->value_mask |= mask;
+}
+
+static Bool
+coalesceevent(XEvent *batch, Bool *drop, int i, int n)
+{
+	XEvent *ev = &batch[i], *nx;
+	Window win = eventwindow(ev);
+	int j;
+
+	switch (ev->type) {
+	case PropertyNotify:
+	case ConfigureRequest:
+	case Expose:
+	case MotionNotify:
+		for (j = i + 1; j < n; j++) {
+			if (drop[j])
+				continue;
+			nx = &batch[j];
+			if (eventwindow(nx) != win)
+				continue;
+			if (nx->type != ev->type)
+				return False;
+			if (ev->type == PropertyNotify && nx->xproperty.atom != ev->xproperty.atom)
+				continue;
+			if (ev->type == ConfigureRequest)
+				mergeconfigurerequest(&ev->xconfigurerequest, &nx->xconfigurerequest);
+			return True;
+		}
+		return False;
+	case EnterNotify:
+		if (ev->xcrossing.mode != NotifyNormal)
+			return False;
+		for (j = i + 1; j < n; j++) {
+			if (drop[j])
+				continue;
+			nx = &batch[j];
+			if (!iscrossingevent(nx))
+				return False;
+			if (nx->type == EnterNotify && nx->xcrossing.mode == NotifyNormal)
+				return True;
+		}
+		return False;
+	default:
+		return False;
+	}
+}
+
+static void
+handle_events(void)
+{
+	static XEvent batch[EVENTBATCH];
+	static Bool drop[EVENTBATCH];
+	int i, n = 0;
+
+	do {
+		XNextEvent(dpy, &batch[n]);
+		drop[n] = False;
+		n++;
+	} while (n < EVENTBATCH && !isbarrierevent(&batch[n - 1])
+		 && XEventsQueued(dpy, QueuedAfterReading));
+	evstats.events += n;
+	evstats.batches++;
+
+	/* walk backward so that each event is compared against survivors */
+	for (i = n - 2; i >= 0; i--)
+		if ((drop[i] = coalesceevent(batch, drop, i, n)))
+			evstats.coalesced[batch[i].type]++;
+
+	for (i = 0; i < n && running; i++) {
+		if (drop[i])
+			continue;
+		scr = geteventscr(&batch[i]);
+		DPRINTF("Got an event!\n");
+		if (!handle_event(&batch[i]))
+			DPRINTF("WARNING: Event %d not handled\n", batch[i].type);
+	}
+}
+
+/*
+ * Print the non-empty buckets of a sync latency histogram (see SyncStats).
+ */
+static void
+showsynchist(const unsigned long *hist)
+{
+	int i;
+
+	for (i = 0; i < SYNCBUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		if (i == SYNCBUCKETS - 1)
+			fprintf(stderr, ", timeout %lu", hist[i]);
+		else if (i == SYNCBUCKETS - 2)
+			fprintf(stderr, ", >=%dms %lu", 1 << (i - 1), hist[i]);
+		else
+			fprintf(stderr, ", <%dms %lu", 1 << i, hist[i]);
+	}
+	fputc('\n', stderr);
+}
+
+/*
+ * Bytes of pixmap storage held for the decorations of a client: the title
+ * text layer and a private icon.  Shared icons are accounted to the icon cache.
+ */
+static unsigned long
+decorbytes(Client *c)
+{
+	unsigned long bytes = 0;
+
+#ifdef RENDER
+	bytes += (unsigned long) c->layer.w * c->layer.h * sizeof(ARGB);
+#endif
+	if (c->button.present && !c->button.shared)
+		bytes += (unsigned long) c->button.px.w * c->button.px.h * sizeof(ARGB);
+	return (bytes);
+}
+
+void
+showstats(void)
+{
+	unsigned long total = 0, bytes = 0, windows = 0;
+	unsigned hidden = 0, decorated = 0;
+	AScreen *s;
+	Client *c;
+	int i;
+
+	for (i = 0; i < LASTEvent; i++)
+		total += evstats.coalesced[i];
+	fprintf(stderr, NAME ": S: window table %u entries in %u slots, %lu searches, %lu probes\n",
+		winmap.count, winmap.slots ? (1U << winmap.bits) : 0, wmstats.lookups, wmstats.probes);
+	fprintf(stderr, NAME ": S: property cache %lu hits, %lu misses, %lu prefetched\n",
+		propstats.hits, propstats.misses, propstats.prefetched);
+	fprintf(stderr, NAME ": S: startup %lu windows, %lu managed: query %ld.%06lds, classify %ld.%06lds, manage %ld.%06lds, arrange %ld.%06lds\n",
+		scanstats.windows, scanstats.managed,
+		scanstats.query.tv_sec, scanstats.query.tv_usec,
+		scanstats.classify.tv_sec, scanstats.classify.tv_usec,
+		scanstats.manage.tv_sec, scanstats.manage.tv_usec,
+		scanstats.arrange.tv_sec, scanstats.arrange.tv_usec);
+	fprintf(stderr, NAME ": S: resources %lu lookups, %lu memoized, %lu search lists, %lu flushes, last load %ld.%06lds\n",
+		resstats.lookups, resstats.hits, resstats.lists, resstats.flushes,
+		resstats.init.tv_sec, resstats.init.tv_usec);
+	fprintf(stderr, NAME ": S: move/resize %lu motions in %lu frames, %lu dropped, latency %lu usec average, %lu usec worst\n",
+		movestats.motions, movestats.frames, movestats.dropped,
+		movestats.frames ? movestats.latency / movestats.frames : 0, movestats.maxlatency);
+	fprintf(stderr, NAME ": S: timers %lu started, %lu fired, %lu cascaded, %lu wakeups\n",
+		timerstats.started, timerstats.fired, timerstats.cascaded, timerstats.wakeups);
+	fprintf(stderr, NAME ": S: sync %lu requests, %lu answered late, %lu resizes unsynchronized",
+		syncstats.requests, syncstats.late, syncstats.unsynced);
+	showsynchist(syncstats.hist);
+#ifdef SYNC
+	for (s = screens; s < screens + nscr; s++)
+		for (c = s->clients; c; c = c->next) {
+			if (!c->sync.requests)
+				continue;
+			fprintf(stderr, NAME ": S:\t0x%08lx %s: %lu requests, %lu usec average",
+				c->win, c->name, c->sync.requests, c->sync.latency);
+			showsynchist(c->sync.hist);
+		}
+#endif
+	fprintf(stderr, NAME ": S: text extents %lu hits, %lu measured, %lu fitted, %lu evicted; title layers %lu rendered, %lu reused\n",
+		textstats.hits, textstats.misses, textstats.fits, textstats.evictions,
+		textstats.layers, textstats.composited);
+	fprintf(stderr, NAME ": S: icons %lu shared, %lu decoded, %lu evicted\n",
+		iconstats.hits, iconstats.misses, iconstats.evictions);
+	fprintf(stderr, NAME ": S: decorations %lu drawn (%lu with grips), %lu buttons only, %lu unchanged; %lu realized, %lu released\n",
+		drawstats.full, drawstats.grips, drawstats.partial, drawstats.skipped,
+		drawstats.realized, drawstats.released);
+	for (s = screens; s < screens + nscr; s++)
+		for (c = s->clients; c; c = c->next) {
+			if (!c->is.banned)
+				continue;
+			hidden++;
+			if (c->title || c->grips)
+				decorated++;
+			windows += (c->title ? 1 : 0) + (c->grips ? 1 : 0);
+			bytes += decorbytes(c);
+		}
+	fprintf(stderr, NAME ": S: hidden clients %u, %u decorated: %lu windows, %lu pixmap bytes, %lu per hidden client\n",
+		hidden, decorated, windows, bytes, hidden ? bytes / hidden : 0);
+	fprintf(stderr, NAME ": S: events %lu in %lu batches, %lu coalesced\n",
+		evstats.events, evstats.batches, total);
+	if (total)
+		fprintf(stderr, NAME ": S:\tPropertyNotify %lu, ConfigureRequest %lu, Expose %lu, MotionNotify %lu, EnterNotify %lu\n",
+			evstats.coalesced[PropertyNotify], evstats.coalesced[ConfigureRequest],
+			evstats.coalesced[Expose], evstats.coalesced[MotionNotify],
+			evstats.coalesced[EnterNotify]);
+	fflush(stderr);
+}
+
+/*
+ * Bring deferred arrangements, stacking and EWMH properties up to date on all
+ * screens.  This is done once for each batch of events.
+ */
+static void
+flushneeded(void)
+{
+	AScreen *save = scr;
+
+	for (scr = screens; scr < screens + nscr; scr++)
+		if (scr->managed)
+			arrangeneeded();
+	scr = save;
+	pending_states = 0;
+	XFlush(dpy);
+}
+
 void
 run(void)
 {
-	int xfd;
-	XEvent ev;
+	int xfd, n;
 
 	/* main event loop */
 	XSync(dpy, False);
@@ -4311,18 +5031,26 @@ run(void)
 			case SIGCHLD:
 				while (waitpid(-1, &sig, WNOHANG) > 0) ;
 				break;
+			case SIGUSR1:
+				showstats();
+				break;
 			default:
 				break;
 			}
 		}
 
-		if (poll(&pfd, 1, -1) == -1) {
+		flushneeded();
+		/* round trips may have left events in the queue without socket data */
+		if ((n = poll(&pfd, 1, QLength(dpy) ? 0 : timer_timeout())) == -1) {
 			if (errno == EAGAIN || errno == EINTR || errno == ERESTART) {
 				errno = 0;
 				continue;
 			}
 			eprint("%s", "poll failed: %s\n", strerror(errno));
 		} else {
+			if (!n)
+				timerstats.wakeups++;
+			timer_run();
 			if (pfd.revents & (POLLNVAL | POLLHUP | POLLERR)) {
 				if (pfd.revents & POLLNVAL)
 					EPRINTF("POLLNVAL bit set!\n");
@@ -4332,14 +5060,10 @@ run(void)
 					EPRINTF("POLLERR bit set!\n");
 				eprint("%s", "poll error\n");
 			}
-			if (pfd.revents & POLLIN) {
-				while (running && XPending(dpy)) {
-					XNextEvent(dpy, &ev);
-					scr = geteventscr(&ev);
-					DPRINTF("Got an event!\n");
-					if (!handle_event(&ev))
-						DPRINTF("WARNING: Event %d not handled\n", ev.type);
-				}
+			/* timer callbacks make round trips that may queue events too */
+			while (running && XPending(dpy)) {
+				handle_events();
+				flushneeded();
 			}
 		}
 	}
@@ -4366,24 +5090,20 @@ delsystray(Window win)
 Bool
 issystray(Window win)
 {
-	int format, status;
 	long *data = NULL;
-	unsigned long extra, nitems = 0;
-	Atom real;
+	unsigned long nitems = 0;
+	Atom real = None;
 	Bool ret;
 	unsigned int i;
 
-	status =
-	    XGetWindowProperty(dpy, win, _XA_KDE_NET_WM_SYSTEM_TRAY_WINDOW_FOR, 0L, 1L,
-			       False, AnyPropertyType, &real, &format, &nitems, &extra,
-			       (unsigned char **) &data);
-	if ((ret = (status == Success && real != None))) {
+	data = getproperty(win, _XA_KDE_NET_WM_SYSTEM_TRAY_WINDOW_FOR, &real, NULL, &nitems);
+	if ((ret = (real != None))) {
 		for (i = 0; i < systray.count && systray.members[i] != win; i++) ;
 		if (i == systray.count) {
 			XSelectInput(dpy, win, StructureNotifyMask);
 			XSaveContext(dpy, win, context[SysTrayWindows],
 				     (XPointer) &systray);
-			XSaveContext(dpy, win, context[ScreenContext], (XPointer) scr);
+			winmap_save(win, ScreenContext, scr);
 
 			systray.members =
 			    erealloc(systray.members, (i + 1) * sizeof(Window));
@@ -4408,95 +5128,164 @@ manageoverride(Window win, XWindowAttributes *wa)
 	(void) wa;
 }
 
+/*
+ * Add the time since *t to the phase total *acc and restart *t.
+ */
+static void
+scanlap(struct timeval *acc, struct timeval *t)
+{
+	struct timeval now, d;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, t, &d);
+	timeradd(acc, &d, acc);
+	*t = now;
+}
+
+/*
+ * Never matches: only notes whether a DestroyNotify or UnmapNotify for the
+ * window in arg is queued, in which case it is cleared.
+ */
+static Bool
+check_gone(Display *dpy, XEvent *ev, XPointer arg)
+{
+	Window *w = (typeof(w)) arg;
+
+	(void) dpy;
+	if ((ev->type == DestroyNotify && ev->xdestroywindow.window == *w) ||
+	    (ev->type == UnmapNotify && !ev->xunmap.send_event && ev->xunmap.window == *w))
+		*w = None;
+	return False;
+}
+
 void
 scan(void)
 {
-	unsigned int i, num;
-	Window *wins, d1, d2;
+	unsigned int i, num = 0, nfirst = 0, nlater = 0;
+	unsigned *first, *later;
+	Window *wins = NULL, d1, d2;
+	XWindowAttributes *was;
+	struct timeval t;
 
-	wins = NULL;
+	gettimeofday(&t, NULL);
 	xtrap_push(0,NULL);
 	XGrabServer(dpy);
-	if (XQueryTree(dpy, scr->root, &d1, &d2, &wins, &num)) {
-		for (i = 0; i < num; i++) {
-			XWindowAttributes wa = { 0, };
-			XWMHints *wmh = NULL;
-			long state = -1;
-			Client *c;
-
-			if (!wins[i])
-				continue;
+	if (!XQueryTree(dpy, scr->root, &d1, &d2, &wins, &num)) {
+		DPRINTF("XQueryTree(0x%lx) failed\n", scr->root);
+		num = 0;
+	}
+	/* fetch attributes and properties of all windows in one go */
+	was = ecalloc(num ? : 1, sizeof(*was));
+	prefetch(wins, num, was);
+	scanlap(&scanstats.query, &t);
+
+	/* sort windows into those to manage first (group leaders) and those to
+	   manage after them, keeping stacking order */
+	first = ecalloc(num ? : 1, sizeof(*first));
+	later = ecalloc(num ? : 1, sizeof(*later));
+	for (i = 0; i < num; i++) {
+		XWindowAttributes *wa = was + i;
+		XWMHints *wmh = NULL;
+		long state = -1;
+		Client *c;
+
+		if (!wins[i])
+			continue;
 
-			DPRINTF("scan checking window 0x%08lx\n", wins[i]);
+		DPRINTF("scan checking window 0x%08lx\n", wins[i]);
 
-			if ((c = getclient(wins[i], ClientAny))) {
-				DPRINTF("-> deleting 0x%08lx (already managed by %s)\n", wins[i], c->name);
-				wins[i] = None;
-				continue;
-			}
-			if (!XGetWindowAttributes(dpy, wins[i], &wa)) {
-				DPRINTF("-> deleting 0x%08lx (no window attributes)\n", wins[i]);
-				wins[i] = None;
-				continue;
-			}
-			if (wa.override_redirect) {
-				DPRINTF("-> deleting 0x%08lx (override redirect set)\n", wins[i]);
-				wins[i] = None;
-				continue;
-			}
-			if (issystray(wins[i])) {
-				DPRINTF("-> deleting 0x%08lx (is a system tray icon)\n", wins[i]);
-				wins[i] = None;
-				continue;
-			}
-			if ((wa.map_state != IsViewable) && ((state = getstate(wins[i])) != IconicState) && (state != NormalState)) {
-				DPRINTF("-> deleting 0x%08lx (not viewable and state = %ld)\n", wins[i], state);
-				wins[i] = None;
-				continue;
-			}
-			/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_TRANSIENT_FOR properties
-			   they find on icon windows. */
-			if (XGetTransientForHint(dpy, wins[i], &d1)) {
-				DPRINTF("-> skipping 0x%08lx (transient-for property set)\n", wins[i]);
-				continue;
-			}
-			/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_HINTS properties
-			   they find on icon windows. */
-			if (!(wmh = XGetWMHints(dpy, wins[i])) ||
-					((wmh->flags & WindowGroupHint) && (wmh->window_group != wins[i])) ||
-					!(wmh->flags & IconWindowHint)) {
-				DPRINTF("-> skipping 0x%08lx (not group leader)\n", wins[i]);
-				if (wmh)
-					XFree(wmh);
-				continue;
-			}
-			DPRINTF("-> managing 0x%08lx\n", wins[i]);
-			manage(wins[i], &wa);
-			wins[i] = None;
-			if (wmh)
-				XFree(wmh);
+		if ((c = getclient(wins[i], ClientAny))) {
+			DPRINTF("-> deleting 0x%08lx (already managed by %s)\n", wins[i], c->name);
+			continue;
 		}
-		for (i = 0; i < num; i++) {
-			XWindowAttributes wa = { 0, };
-
-			if (!wins[i])
-				continue;
-			if (!XGetWindowAttributes(dpy, wins[i], &wa))
-				continue;
-			DPRINTF("-> managing 0x%08lx\n", wins[i]);
-			manage(wins[i], &wa);
-			wins[i] = None;
+		if (!wa->root) {
+			DPRINTF("-> deleting 0x%08lx (no window attributes)\n", wins[i]);
+			continue;
 		}
-	} else
-		DPRINTF("XQueryTree(0x%lx) failed\n", scr->root);
+		if (wa->override_redirect) {
+			DPRINTF("-> deleting 0x%08lx (override redirect set)\n", wins[i]);
+			continue;
+		}
+		if (issystray(wins[i])) {
+			DPRINTF("-> deleting 0x%08lx (is a system tray icon)\n", wins[i]);
+			continue;
+		}
+		if ((wa->map_state != IsViewable) && ((state = getstate(wins[i])) != IconicState) && (state != NormalState)) {
+			DPRINTF("-> deleting 0x%08lx (not viewable and state = %ld)\n", wins[i], state);
+			continue;
+		}
+		/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_TRANSIENT_FOR properties
+		   they find on icon windows. */
+		if (gettransientfor(wins[i], &d1)) {
+			DPRINTF("-> skipping 0x%08lx (transient-for property set)\n", wins[i]);
+			later[nlater++] = i;
+			continue;
+		}
+		/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_HINTS properties
+		   they find on icon windows. */
+		if (!(wmh = getwmhints(wins[i])) ||
+				((wmh->flags & WindowGroupHint) && (wmh->window_group != wins[i])) ||
+				!(wmh->flags & IconWindowHint)) {
+			DPRINTF("-> skipping 0x%08lx (not group leader)\n", wins[i]);
+			later[nlater++] = i;
+		} else
+			first[nfirst++] = i;
+		if (wmh)
+			XFree(wmh);
+	}
+	/* Select property changes while still grabbed, so that the prefetched
+	   properties are current until a PropertyNotify says otherwise (see
+	   manage()). */
+	for (i = 0; i < nfirst + nlater; i++)
+		XSelectInput(dpy, wins[(i < nfirst) ? first[i] : later[i - nfirst]], PropertyChangeMask);
+	/* From here on root's substructure redirect holds back new windows, and
+	   windows that change or go away tell us so with events; so there is no
+	   need to keep the server grabbed while managing. */
 	XUngrabServer(dpy);
+	XSync(dpy, False);
+	scanlap(&scanstats.classify, &t);
+
+	for (i = 0; i < nfirst + nlater; i++) {
+		unsigned k = (i < nfirst) ? first[i] : later[i - nfirst];
+		XEvent ev;
+		Window w;
+
+		/* icon windows of clients managed before now belong to them */
+		if (getclient(wins[k], ClientAny))
+			continue;
+		/* windows withdrawn or destroyed since the grab was released are
+		   not managed; later changes arrive as events once managed */
+		w = wins[k];
+		XCheckIfEvent(dpy, &ev, &check_gone, (XPointer) &w);
+		if (!w) {
+			DPRINTF("-> skipping 0x%08lx (unmapped or destroyed since scan)\n", wins[k]);
+			continue;
+		}
+		DPRINTF("-> managing 0x%08lx\n", wins[k]);
+		manage(wins[k], was + k);
+		dropprefetched(wins[k]);
+		scanstats.managed++;
+	}
+	endprefetch();
+	scanstats.windows += num;
+	scanlap(&scanstats.manage, &t);
 	xtrap_pop();
+	free(first);
+	free(later);
+	free(was);
 	if (wins)
 		XFree(wins);
 	DPRINTF("done scanning screen %d\n", scr->screen);
 	focus(sel);
 	ewmh_update_kde_splash_progress();
 	ewmh_update_startup_notification();
+	scanlap(&scanstats.arrange, &t);
+	OPRINTF("scanned %lu windows, managed %lu: query %ld.%06lds, classify %ld.%06lds, manage %ld.%06lds, arrange %ld.%06lds\n",
+		scanstats.windows, scanstats.managed,
+		scanstats.query.tv_sec, scanstats.query.tv_usec,
+		scanstats.classify.tv_sec, scanstats.classify.tv_usec,
+		scanstats.manage.tv_sec, scanstats.manage.tv_usec,
+		scanstats.arrange.tv_sec, scanstats.arrange.tv_usec);
 }
 
 static Bool
@@ -4838,10 +5627,39 @@ updatemonitors(XEvent *e, unsigned n, Bool size_update, Bool full_update)
 	ewmh_update_net_monitor_geometry();
 }
 
+#ifdef XRANDR
+/*
+ * Frame interval in microseconds of a RANDR mode, or zero when the mode does
+ * not say.
+ */
+static unsigned long
+modeframe(XRRScreenResources *sr, RRMode mode)
+{
+	int i;
+
+	for (i = 0; i < sr->nmode; i++) {
+		XRRModeInfo *mi = &sr->modes[i];
+		double lines;
+
+		if (mi->id != mode)
+			continue;
+		if (!mi->dotClock || !mi->hTotal || !(lines = mi->vTotal))
+			return 0;
+		if (mi->modeFlags & RR_DoubleScan)
+			lines *= 2;
+		if (mi->modeFlags & RR_Interlace)
+			lines /= 2;
+		return (unsigned long) (1000000.0 * mi->hTotal * lines / mi->dotClock);
+	}
+	return 0;
+}
+#endif
+
 static Bool
 initmonitors(XEvent *e)
 {
 	unsigned n = 0;
+	unsigned long frame = 0;
 	Monitor *m;
 	Bool size_update = False, full_update = False;
 
@@ -4935,6 +5753,7 @@ initmonitors(XEvent *e)
 				m->mx = m->sc.x + m->sc.w / 2;
 				m->my = m->sc.y + m->sc.h / 2;
 				m->num = si[i].screen_number;
+				m->frame = 0;
 				setmonitorviews(e, m);
 				m->veil =
 				    XCreateSimpleWindow(dpy, scr->root, m->sc.x, m->sc.y,
@@ -4995,6 +5814,13 @@ initmonitors(XEvent *e)
 		}
 		XPRINTF("RANDR defines %d ctrc for display\n", sr->ncrtc);
 		if (sr->ncrtc < 2) {
+			XRRCrtcInfo *ci;
+
+			/* a single crtc still knows its refresh rate */
+			if (sr->ncrtc == 1 && (ci = XRRGetCrtcInfo(dpy, sr, sr->crtcs[0]))) {
+				frame = modeframe(sr, ci->mode);
+				XRRFreeCrtcInfo(ci);
+			}
 			XRRFreeScreenResources(sr);
 			goto no_xrandr;
 		}
@@ -5098,6 +5924,7 @@ initmonitors(XEvent *e)
 				for (j = 0; j < 8; j++)
 					m->bars[j] = None;
 			}
+			m->frame = modeframe(sr, ci->mode);
 			XPRINTF("Monitor %d:\n", m->index);
 			XPRINTF("\tindex           = %d\n", m->index);
 			XPRINTF("\tscreen          = %d\n", m->num);
@@ -5203,6 +6030,7 @@ initmonitors(XEvent *e)
 		for (j = 0; j < 8; j++)
 			m->bars[j] = None;
 	}
+	m->frame = frame;
 	XPRINTF("Monitor %d:\n", m->index);
 	XPRINTF("\tindex           = %d\n", m->index);
 	XPRINTF("\tscreen          = %d\n", m->num);
@@ -5356,10 +6184,12 @@ findscreen(Bool reload __attribute__((unused)))
 	int d = 0;
 	unsigned int mask = 0;
 	Window w = None, proot = None;
+	AScreen *s;
 
 	/* multihead support */
 	XQueryPointer(dpy, screens->root, &proot, &w, &d, &d, &d, &d, &mask);
-	XFindContext(dpy, proot, context[ScreenContext], (XPointer *) &scr);
+	if ((s = getscreen(proot, False)))
+		scr = s;
 }
 
 static void
@@ -5432,7 +6262,9 @@ void
 initialize(const char *conf, AdwmOperations * ops, Bool reload __attribute__((unused)))
 {
 	char *owd;
+	struct timeval t0, t1;
 
+	gettimeofday(&t0, NULL);
 	/* save original working directory to restore after processing rc files */
 	owd = ecalloc(PATH_MAX, sizeof(*owd));
 	if (!getcwd(owd, PATH_MAX))
@@ -5505,6 +6337,10 @@ initialize(const char *conf, AdwmOperations * ops, Bool reload __attribute__((un
 				strerror(errno));
 		free(owd);
 	}
+	gettimeofday(&t1, NULL);
+	timersub(&t1, &t0, &resstats.init);
+	OPRINTF("%s took %ld.%06lds\n", reload ? "reload" : "initialization",
+		resstats.init.tv_sec, resstats.init.tv_usec);
 }
 
 void
@@ -5666,7 +6502,7 @@ unmanage(Client *c, WithdrawCause cause)
 	/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_TRANSIENT_FOR properties
 	   they find on icon windows. */
 	doarrange = !(c->skip.arrange || c->is.floater || (cause != CauseDestroyed &&
-		       XGetTransientForHint(dpy, c->win, &trans))) ||
+		       gettransientfor(c->win, &trans))) ||
 	    c->is.bastard || c->is.dockapp;
 	dostruts = c->with.struts;
 	/* The server grab construct avoids race conditions. */
@@ -5681,11 +6517,12 @@ unmanage(Client *c, WithdrawCause cause)
 	if (c->is.modal)
 		togglemodal(c);
 #ifdef SYNC
+	timer_stop(&c->sync.timer);
 	if (c->sync.alarm) {
 		c->sync.waiting = False;
 		XSyncDestroyAlarm(dpy, c->sync.alarm);
-		XDeleteContext(dpy, c->sync.alarm, context[ClientAny]);
-		XDeleteContext(dpy, c->sync.alarm, context[ScreenContext]);
+		winmap_delete(c->sync.alarm, ClientAny);
+		winmap_delete(c->sync.alarm, ScreenContext);
 		c->sync.alarm = None;
 	}
 #endif
@@ -5704,72 +6541,7 @@ unmanage(Client *c, WithdrawCause cause)
 		c->pict.icon = None;
 	}
 #endif
-	if (c->title) {
-#ifdef RENDER
-		if (c->pict.title) {
-			XRenderFreePicture(dpy, c->pict.title);
-			c->pict.title = None;
-		}
-#endif
-		XDestroyWindow(dpy, c->title);
-		XDeleteContext(dpy, c->title, context[ClientTitle]);
-		XDeleteContext(dpy, c->title, context[ClientAny]);
-		XDeleteContext(dpy, c->title, context[ScreenContext]);
-		c->title = None;
-		free(c->element);
-	}
-	if (c->grips) {
-#ifdef RENDER
-		if (c->pict.grips) {
-			XRenderFreePicture(dpy, c->pict.grips);
-			c->pict.grips = None;
-		}
-#endif
-		XDestroyWindow(dpy, c->grips);
-		XDeleteContext(dpy, c->grips, context[ClientGrips]);
-		XDeleteContext(dpy, c->grips, context[ClientAny]);
-		XDeleteContext(dpy, c->grips, context[ScreenContext]);
-		c->grips = None;
-	}
-	if (c->tgrip) {
-#ifdef RENDER
-		if (c->pict.tgrip) {
-			XRenderFreePicture(dpy, c->pict.tgrip);
-			c->pict.tgrip = None;
-		}
-#endif
-		XDestroyWindow(dpy, c->tgrip);
-		XDeleteContext(dpy, c->tgrip, context[ClientGrips]);
-		XDeleteContext(dpy, c->tgrip, context[ClientAny]);
-		XDeleteContext(dpy, c->tgrip, context[ScreenContext]);
-		c->tgrip = None;
-	}
-	if (c->lgrip) {
-#ifdef RENDER
-		if (c->pict.lgrip) {
-			XRenderFreePicture(dpy, c->pict.lgrip);
-			c->pict.lgrip = None;
-		}
-#endif
-		XDestroyWindow(dpy, c->lgrip);
-		XDeleteContext(dpy, c->lgrip, context[ClientGrips]);
-		XDeleteContext(dpy, c->lgrip, context[ClientAny]);
-		XDeleteContext(dpy, c->lgrip, context[ScreenContext]);
-		c->lgrip = None;
-	}
-	if (c->rgrip) {
-#ifdef RENDER
-		if (c->pict.rgrip) {
-			XRenderFreePicture(dpy, c->pict.rgrip);
-			c->pict.rgrip = None;
-		}
-#endif
-		XDestroyWindow(dpy, c->rgrip);
-		XDeleteContext(dpy, c->rgrip, context[ClientGrips]);
-		XDeleteContext(dpy, c->rgrip, context[ClientAny]);
-		XDeleteContext(dpy, c->rgrip, context[ScreenContext]);
-		c->rgrip = None;
-	}
+	unrealize(c);
 	if ((w = c->cmapwins)) {
 		while (*w)
 			XDeleteContext(dpy, *w++, context[ClientColormap]);
@@ -5832,17 +6604,17 @@ unmanage(Client *c, WithdrawCause cause)
 	ewmh_del_client(c, cause);
 
 	XDestroyWindow(dpy, c->frame);
-	XDeleteContext(dpy, c->frame, context[ClientFrame]);
-	XDeleteContext(dpy, c->frame, context[ClientAny]);
-	XDeleteContext(dpy, c->frame, context[ScreenContext]);
-	XDeleteContext(dpy, c->win, context[ClientWindow]);
-	XDeleteContext(dpy, c->win, context[ClientAny]);
-	XDeleteContext(dpy, c->win, context[ScreenContext]);
+	winmap_delete(c->frame, ClientFrame);
+	winmap_delete(c->frame, ClientAny);
+	winmap_delete(c->frame, ScreenContext);
+	winmap_delete(c->win, ClientWindow);
+	winmap_delete(c->win, ClientAny);
+	winmap_delete(c->win, ScreenContext);
 	if (c->icon) {
-		XDeleteContext(dpy, c->icon, context[ClientIcon]);
+		winmap_delete(c->icon, ClientIcon);
 		if (c->icon != c->win) {
-			XDeleteContext(dpy, c->icon, context[ClientAny]);
-			XDeleteContext(dpy, c->icon, context[ScreenContext]);
+			winmap_delete(c->icon, ClientAny);
+			winmap_delete(c->icon, ScreenContext);
 		}
 	}
 	ewmh_release_user_time_window(c);
@@ -5864,6 +6636,8 @@ unmanage(Client *c, WithdrawCause cause)
 #endif
 	free(c->name);
 	c->name = NULL;
+	free(c->drawn.name);
+	c->drawn.name = NULL;
 	free(c->icon_name);
 	c->icon_name = NULL;
 	free(c->wm_name);
@@ -6072,7 +6846,7 @@ updatehints(Client *c)
 		/* UXTerm updates WM_HINTS all the time without changing it */
 		/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_HINTS properties
 		   they find on icon windows. */
-		if ((wmh = XGetWMHints(dpy, c->win))) {
+		if ((wmh = getwmhints(c->win))) {
 			if (c->is.managed) {
 				if (((c->wmh.flags ^ wmh->flags) & (IconPixmapHint | IconMaskHint))
 				    || wmh->icon_window != c->wmh.icon_window
@@ -6111,7 +6885,7 @@ updatesizehints(Client *c)
 
 	/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_NORMAL_HINTS properties
 	   they fined on icon windows. */
-	if (!XGetWMNormalHints(dpy, c->win, &c->sh, &supplied))
+	if (!getwmnormalhints(c->win, &c->sh, &supplied))
 		return;
 
 	if (c->sh.flags & (USPosition | PPosition)) {
@@ -6270,7 +7044,7 @@ updatetransientfor(Client *c)
 
 	/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_TRANSIENT_FOR properties
 	   they find on icon windows. */
-	if (XGetTransientForHint(dpy, c->win, &trans) && trans == None)
+	if (gettransientfor(c->win, &trans) && trans == None)
 		trans = scr->root;
 	if (!c->is.floater && (c->is.floater = (trans != None))) {
 		arrange(NULL);
@@ -6688,51 +7462,123 @@ updatecmapwins(Client *c)
 	}
 }
 
-void
-_xtrap_push(Bool ignore, const char *time, const char *file, int line, const char *func, const char *fmt, ...)
+/*
+ * Error traps do not synchronize with the server.  Each trap records the range
+ * of request serial numbers issued while it was pushed; errors are matched to
+ * traps by serial number as they arrive in xerror().  A popped trap remains
+ * live until the server is known to have processed its last request, after
+ * which any error for it would already have been delivered, and it is then
+ * returned to the pool.  Trap messages are only formatted when an error hits.
+ */
+static XErrorTrap trappool[XTRAP_POOLSIZE];
+static XErrorTrap *freetraps = NULL;
+static Bool trappool_init = False;
+
+static void
+xtrap_reclaim(void)
 {
-	XErrorTrap *trap;
-	va_list args;
-	char *msg;
-	int len;
+	XErrorTrap *trap, **prev;
+	unsigned long last = LastKnownRequestProcessed(dpy);
 
-	msg = calloc(BUFSIZ + 1, sizeof(*msg));
-	len = snprintf(msg, BUFSIZ, NAME ": X: [%s] %12s: +%4d : %s() : ", time, file, line, func);
+	for (prev = &traps; (trap = *prev);) {
+		if (!trap->trap_active && trap->trap_end <= last) {
+			*prev = trap->next;
+			trap->next = freetraps;
+			freetraps = trap;
+		} else
+			prev = &trap->next;
+	}
+}
 
-	if (fmt && *fmt) {
-		va_start(args, fmt);
-		len += vsnprintf(msg + len, BUFSIZ - len, fmt, args);
-		va_end(args);
-	} else {
-		len += snprintf(msg + len, BUFSIZ - len, "xerror occured during trap\n");
+static XErrorTrap *
+xtrap_alloc(void)
+{
+	XErrorTrap *trap;
+	int i;
+
+	if (!trappool_init) {
+		for (i = 0; i < XTRAP_POOLSIZE; i++) {
+			trappool[i].next = freetraps;
+			freetraps = &trappool[i];
+		}
+		trappool_init = True;
 	}
-	if ((trap = calloc(1, sizeof(*trap)))) {
-		trap->next = traps;
-		traps = trap;
-		trap->trap_string = strdup(msg);
+	if (!freetraps)
+		xtrap_reclaim();
+	if (!freetraps) {
+		/* all traps awaiting their requests: flush them through */
 		XSync(dpy, False);
-		trap->trap_next = NextRequest(dpy);
-		trap->trap_last = LastKnownRequestProcessed(dpy);
-		trap->trap_qlen = QLength(dpy);
-		trap->trap_ignore = ignore;
+		xtrap_reclaim();
 	}
-	free(msg);
+	if ((trap = freetraps))
+		freetraps = trap->next;
+	return (trap);
 }
 
-void
-_xtrap_pop(int canary __attribute__((unused)))
+XErrorTrap *
+_xtrap_push(Bool ignore, const char *file, int line, const char *func, const char *fmt, ...)
 {
 	XErrorTrap *trap;
+	va_list args;
 
-	XSync(dpy, False);
-	if ((trap = traps)) {
-		traps = trap->next;
-		trap->next = NULL;
-		free(trap->trap_string);
-		trap->trap_string = NULL;
-		free(trap);
-	} else
+	if (!(trap = xtrap_alloc())) {
+		EPRINTF("_xtrap_push() trap pool exhausted!\n");
+		return (NULL);
+	}
+	trap->trap_file = file;
+	trap->trap_line = line;
+	trap->trap_func = func;
+	trap->trap_fmt = fmt;
+	gettimeofday(&trap->trap_time, NULL);
+	trap->trap_args[0] = '\0';
+	if (fmt && strchr(fmt, '%')) {
+		/* arguments do not outlive the call: keep them formatted */
+		va_start(args, fmt);
+		vsnprintf(trap->trap_args, sizeof(trap->trap_args), fmt, args);
+		va_end(args);
+	}
+	trap->trap_next = NextRequest(dpy);
+	trap->trap_end = trap->trap_next;
+	trap->trap_last = LastKnownRequestProcessed(dpy);
+	trap->trap_qlen = QLength(dpy);
+	trap->trap_ignore = ignore;
+	trap->trap_active = True;
+	trap->next = traps;
+	traps = trap;
+	return (trap);
+}
+
+void
+_xtrap_pop(XErrorTrap *trap)
+{
+	if (!trap || !trap->trap_active) {
 		EPRINTF("_xtrap_pop() when no trap was pushed!\n");
+		return;
+	}
+	trap->trap_active = False;
+	trap->trap_end = NextRequest(dpy) - 1;
+	xtrap_reclaim();
+}
+
+static void
+xtrap_print(XErrorTrap *trap)
+{
+	const char *msg;
+	size_t len;
+
+	fprintf(stderr, NAME ": X: [%f] %12s: +%4d : %s() : ",
+		(double) trap->trap_time.tv_sec + (double) trap->trap_time.tv_usec / 1000000.0,
+		trap->trap_file, trap->trap_line, trap->trap_func);
+	if (trap->trap_args[0])
+		msg = trap->trap_args;
+	else if (trap->trap_fmt && *trap->trap_fmt)
+		msg = trap->trap_fmt;
+	else
+		msg = "xerror occured during trap\n";
+	fputs(msg, stderr);
+	if ((len = strlen(msg)) && msg[len - 1] != '\n')
+		fputc('\n', stderr);
+	fflush(stderr);
 }
 
 Bool
@@ -6766,14 +7612,10 @@ xerror(Display *dsply, XErrorEvent *ee)
 	XErrorTrap *trap;
 	Bool ignore = False, critical;
 
+	/* newest first, so that the innermost nested trap matches */
 	for (trap = traps; trap; trap = trap->next) {
-		if (ee->serial >= trap->trap_next) {
-			if (trap->trap_string) {
-				fputs(trap->trap_string, stderr);
-				if (trap->trap_string[strlen(trap->trap_string)-1] != '\n')
-					fputc('\n', stderr);
-				fflush(stderr);
-			}
+		if (ee->serial >= trap->trap_next && (trap->trap_active || ee->serial <= trap->trap_end)) {
+			xtrap_print(trap);
 			ignore = trap->trap_ignore;
 			break;
 		}
@@ -6978,9 +7820,9 @@ main(int argc, char *argv[])
 	signal(SIGTERM, sighandler);
 	signal(SIGQUIT, sighandler);
 	signal(SIGCHLD, sighandler);
+	signal(SIGUSR1, sighandler);	/* dump statistics */
 #if 0
 	/* consider adding more signal handlers */
-	signal(SIGUSR1, sighandler);
 	signal(SIGUSR2, sighandler);
 #endif
 
@@ -7137,7 +7979,7 @@ main(int argc, char *argv[])
 	for (i = 0, scr = screens; i < nscr; i++, scr++) {
 		scr->screen = i;
 		scr->root = RootWindow(dpy, i);
-		XSaveContext(dpy, scr->root, context[ScreenContext], (XPointer) scr);
+		winmap_save(scr->root, ScreenContext, scr);
 		OPRINTF("screen %d has root 0x%lx\n", scr->screen, scr->root);
 		initimage();
 	}
@@ -8,8 +8,11 @@
 #include <sys/wait.h>
 #include <sys/poll.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <dirent.h>
 #include <fcntl.h>
@@ -25,6 +28,7 @@
 #include <regex.h>
 #include <wordexp.h>
 #include <signal.h>
+#include <time.h>
 #include <math.h>
 #include <execinfo.h>
 #include <dlfcn.h>
@@ -72,6 +76,9 @@
 #ifdef SHAPE
 #include <X11/extensions/shape.h>
 #endif
+#ifdef XCB
+#include <X11/Xlib-xcb.h>
+#endif
 #ifdef SMLIB
 #include <X11/ICE/ICEutil.h>
 #include <X11/SM/SMlib.h>
@@ -412,14 +419,88 @@ enum {
 typedef struct XErrorTrap XErrorTrap;
 
 struct XErrorTrap {
-	XErrorTrap *next;
-	char *trap_string;
-	unsigned long trap_next;
-	unsigned long trap_last;
+	XErrorTrap *next;		/* next live trap (or next free trap) */
+	const char *trap_file;		/* source file of push */
+	const char *trap_func;		/* function of push */
+	const char *trap_fmt;		/* message format (NULL for default) */
+	int trap_line;			/* source line of push */
+	struct timeval trap_time;	/* time of push */
+	char trap_args[256];		/* message when format has arguments */
+	unsigned long trap_next;	/* first request covered by trap */
+	unsigned long trap_end;		/* last request covered by trap */
+	unsigned long trap_last;	/* last known processed request at push */
 	int trap_qlen;
 	Bool trap_ignore;
+	Bool trap_active;		/* still pushed (range open ended) */
+};
+
+#define XTRAP_POOLSIZE	64
+
+typedef struct {
+	unsigned long events;		/* events read from the queue */
+	unsigned long batches;		/* batches dispatched */
+	unsigned long coalesced[LASTEvent];	/* events collapsed, by type */
+} EventStats;
+
+#define EVENTBATCH	256
+
+typedef struct {
+	unsigned long windows;		/* top-level windows found by scan() */
+	unsigned long managed;		/* windows managed by scan() */
+	struct timeval query;		/* querying the tree and prefetching */
+	struct timeval classify;	/* sorting windows out (server grabbed) */
+	struct timeval manage;		/* managing windows */
+	struct timeval arrange;		/* the first arrangement */
+} ScanStats;
+
+typedef struct {
+	unsigned long lookups;		/* resource lookups */
+	unsigned long hits;		/* lookups answered from the memo */
+	unsigned long lists;		/* search lists built for name prefixes */
+	unsigned long flushes;		/* memo flushes on database changes */
+	struct timeval init;		/* last initialize() or reload() */
+} ResStats;
+
+typedef struct {
+	unsigned long motions;		/* motion events read while moving or resizing */
+	unsigned long frames;		/* geometry updates applied */
+	unsigned long dropped;		/* frame deadlines missed waiting for sync acks */
+	unsigned long latency;		/* total motion to update latency (usec) */
+	unsigned long maxlatency;	/* worst motion to update latency (usec) */
+} MoveStats;
+
+#define FRAMERATE	60		/* when neither configured nor known from RANDR */
+
+/* _NET_WM_SYNC_REQUEST answers by latency: bucket 0 is under 1 msec, bucket i
+   is under 2^i msec, SYNCBUCKETS - 2 is everything slower that was answered
+   in time and the last bucket counts requests that timed out */
+#define SYNCBUCKETS	12
+
+typedef struct {
+	unsigned long requests;		/* sync requests sent */
+	unsigned long late;		/* answers after the request timed out */
+	unsigned long unsynced;		/* resizes not synchronized (client not answering) */
+	unsigned long hist[SYNCBUCKETS];
+} SyncStats;
+
+/* timer on the timer wheel driven by run() (see timer.c) */
+typedef struct Timer Timer;
+typedef void (*TimerFunc) (Timer *t, void *data);
+struct Timer {
+	Timer *next, **prev;		/* wheel slot linkage (prev is NULL when idle) */
+	unsigned long expires;		/* tick (msec) at which the timer fires */
+	unsigned long period;		/* msec between firings, 0 for one-shot */
+	TimerFunc func;
+	void *data;
 };
 
+typedef struct {
+	unsigned long started;		/* timers armed */
+	unsigned long fired;		/* timer callbacks run */
+	unsigned long cascaded;		/* timers moved down a wheel level */
+	unsigned long wakeups;		/* poll() timeouts taken for timers */
+} TimerStats;
+
 typedef struct {
 	const char *name;		/* extension name */
 	Status (*version)(Display *, int *, int *);	/* how to get version */
@@ -765,7 +846,9 @@ typedef struct Client Client;
 typedef struct AScreen AScreen;
 typedef struct Group Group;
 typedef struct CycleList CycleList;
+typedef struct SharedIcon SharedIcon;
 typedef struct Key Key;
+typedef struct KeyBinding KeyBinding;
 typedef struct Node Node;
 typedef struct Term Term;
 typedef struct Leaf Leaf;
@@ -776,6 +859,62 @@ typedef struct Arrangement Arrangement;
 typedef struct Notify Notify;
 #endif
 
+/* cached window property (type is None when the property does not exist) */
+typedef struct PropEntry PropEntry;
+struct PropEntry {
+	PropEntry *next;
+	Atom atom;
+	Atom type;
+	int format;
+	unsigned long nitems;
+	long data[];			/* as returned by XGetWindowProperty() */
+};
+
+#define PROPCACHE_MAX	4096		/* largest cached property in bytes */
+
+/* window table entry: the client and screen that own a window */
+typedef struct {
+	Window win;			/* key (None for an empty slot) */
+	unsigned parts;			/* WINPART() bits of the client parts */
+	Client *client;
+	AScreen *screen;
+	PropEntry *props;		/* cached properties of client windows */
+} WinEntry;
+
+#define WINPART(part)	(1U << (part))
+#define WINPARTS	(WINPART(ClientWindow)|WINPART(ClientIcon)|WINPART(ClientTitle)|\
+			 WINPART(ClientGrips)|WINPART(ClientFrame)|WINPART(ClientTimeWindow)|\
+			 WINPART(ClientAny))
+
+typedef struct {
+	unsigned long lookups;		/* window table searches */
+	unsigned long probes;		/* slots examined by those searches */
+} WinMapStats;
+
+#define GRIDSIZE	256	/* edge in pixels of a spatial index cell */
+
+typedef struct {
+	void *data;
+	unsigned short cx, cy;		/* first cell covered by the item */
+} GridItem;
+
+typedef struct {
+	GridItem *items;
+	unsigned n, size;
+} GridCell;
+
+typedef struct {
+	int x, y;			/* origin of the indexed area */
+	unsigned cols, rows;
+	GridCell *cells;
+} Grid;					/* uniform grid of rectangles */
+
+typedef struct {
+	unsigned long hits;		/* property reads served from the cache */
+	unsigned long misses;		/* property reads that went to the server */
+	unsigned long prefetched;	/* property reads served from a prefetch */
+} PropStats;
+
 typedef struct {
 	Pattern pattern;		/* default solid */
 	Gradient gradient;		/* default none */
@@ -829,6 +968,17 @@ typedef struct {
 	int borders[4];			/* left, right, top, bottom pixmap borders */
 } Texture;
 
+#define TEXTCACHE_MAX	512	/* measured strings kept per process */
+
+typedef struct {
+	unsigned long hits;		/* strings measured from the cache */
+	unsigned long misses;		/* strings measured by Xft */
+	unsigned long fits;		/* strings fitted to a new width */
+	unsigned long evictions;	/* strings dropped to stay within budget */
+	unsigned long layers;		/* title text layers rendered */
+	unsigned long composited;	/* titles drawn from an existing layer */
+} TextStats;
+
 typedef struct {
 	XftFont *font;
 	XGlyphInfo extents;
@@ -903,6 +1053,7 @@ struct Monitor {
 	} dock;
 	unsigned row, col;		/* row and column in monitor layout */
 	PointerBarrier bars[8];
+	unsigned long frame;		/* refresh interval (usec) from RANDR, 0 if unknown */
 };
 
 typedef struct {
@@ -918,8 +1069,17 @@ typedef struct {
 	AdwmPixmap px;
 	XftColor bg;
 	Bool present;
+	SharedIcon *shared;		/* px belongs to a shared icon */
 } ButtonImage;
 
+#define ICONCACHE_MAX	(1<<20)	/* bytes of unused decoded icons kept */
+
+typedef struct {
+	unsigned long hits;		/* icons shared instead of decoded */
+	unsigned long misses;		/* icons decoded */
+	unsigned long evictions;	/* unused icons released */
+} IconStats;
+
 typedef struct {
 	ButtonImage *image;
 	Bool (**action) (Client *, XEvent *);
@@ -929,8 +1089,21 @@ typedef struct {
 	Bool present, hovered;
 	unsigned pressed;
 	Geometry eg;
+	Bool drawn;			/* drawn by the last full redraw */
+	int dx;				/* container position last drawn */
+	ButtonImage *image;		/* button image last drawn */
+	unsigned dpressed;		/* pressed state last drawn */
 } ElementClient;
 
+typedef struct {
+	unsigned long full;		/* complete title and grips redraws */
+	unsigned long grips;		/* of which also redrew the grips */
+	unsigned long partial;		/* redraws of changed buttons only */
+	unsigned long skipped;		/* redraws that found nothing changed */
+	unsigned long realized;		/* title and grips created on first show */
+	unsigned long released;		/* released again after being hidden */
+} DrawStats;
+
 typedef union {
 	struct {
 		unsigned taskbar:1;
@@ -1113,6 +1286,11 @@ struct Client {
 	Client *next;	/* tiling list order */
 	Client *prev;	/* tiling list order (rev) */
 	Client *snext;	/* stacking list order _NET_CLIENT_LIST_STACKING */
+	unsigned stackpos;	/* position in the stacking list when numbered */
+	struct {
+		Grid *grid;	/* spatial index the frame is entered in */
+		int x1, y1, x2, y2;	/* frame extents as entered */
+	} indexed;
 	Client *cnext;	/* client list order _NET_CLIENT_LIST */
 	Client *fnext;	/* focus list order */
 	Client *anext;	/* select list order */
@@ -1124,6 +1302,11 @@ struct Client {
 	Window rgrip;
 	Window tgrip;
 	Window frame;
+	struct {
+		Bool title;		/* title window is created on first show */
+		Bool grips;		/* grips window is created on first show */
+		Timer timer;		/* releases them once hidden for releasedelay */
+	} lazy;
 #ifdef RENDER
 	struct {
 		Picture win;
@@ -1135,6 +1318,13 @@ struct Client {
 		Picture tgrip;
 		Picture frame;
 	} pict;
+	struct {
+		Pixmap pixmap;
+		Picture mask;		/* glyph coverage of the fitted title */
+		XftFont *font;		/* font the mask was rendered with */
+		char *text;		/* fitted title the mask was rendered from */
+		unsigned w, h;
+	} layer;			/* pre-rendered title text */
 #endif
 #ifdef XCAIRO
 	struct {
@@ -1156,8 +1346,18 @@ struct Client {
 	Colormap cmap;
 	ButtonImage button;
 	ElementClient *element;
+	struct {
+		Bool title;		/* title window contents are current */
+		Bool grips;		/* grips window contents are current */
+		int w;			/* width last drawn */
+		int hilite;		/* highlight last drawn */
+		XftColor *hues;		/* colors last drawn */
+		unsigned long long tags;	/* tags last drawn */
+		char *name;		/* name last drawn */
+	} drawn;
 	Time user_time;
 	Time save_time;
+	Bool needstate;			/* _NET_WM_STATE needs update */
 #ifdef SYNC
 	struct {
 		XID counter;
@@ -1166,6 +1366,12 @@ struct Client {
 		XSyncAlarm alarm;
 		int w;
 		int h;
+		Timer timer;		/* gives up waiting for the counter */
+		struct timeval sent;	/* when the outstanding request was sent */
+		unsigned long latency;	/* smoothed request to alarm latency (usec) */
+		unsigned long requests;	/* requests sent */
+		unsigned misses;	/* requests timed out since the last answer */
+		unsigned long hist[SYNCBUCKETS];	/* see SyncStats */
 	} sync;
 #endif
 #ifdef STARTUP_NOTIFICATION
@@ -1205,6 +1411,8 @@ struct View {
 	Bool needarrange;		/* need to be rearranged */
 	Client *lastsel;		/* last selected client for view */
 	Time strut_time;		/* time that we entered a strut */
+	Window strut_win;		/* client waiting to raise the struts */
+	Timer strut_timer;		/* fires the delayed focus after strutsdelay */
 };					/* per-tag settings */
 
 typedef enum {
@@ -1377,6 +1585,7 @@ struct Key {
 	void (*stop) (XEvent *, Key *);
 	Key *chain;
 	Key *cnext;
+	KeyCode code;			/* keycode bound by mapkeys(), or zero */
 	char *arg;
 	RelativeDirection dir;
 	Bool wrap;
@@ -1423,6 +1632,8 @@ typedef struct {
 	DockOrient dockori;
 	int dockmon;
 	int dragdist;
+	int framerate;			/* interactive move/resize rate (Hz), 0 for refresh */
+	int releasedelay;		/* release decorations hidden this long (s), 0 never */
 	double mwfact;
 	double mhfact;
 	unsigned nmaster;
@@ -1458,6 +1669,10 @@ struct AScreen {
 	View views[MAXTAGS];
 	Tag tags[MAXTAGS];
 	Key *keylist;
+	struct {
+		KeyBinding **buckets;	/* bindings by parent, keycode and modifiers */
+		unsigned size;		/* number of buckets, a power of two */
+	} keymap;
 	struct {
 		int orient;		/* orientation */
 		unsigned rows, cols;		/* rows and cols (one can be zero) */
@@ -1468,6 +1683,18 @@ struct AScreen {
 	} d, m;
 	int sh, sw;
 	Bool colormapnotified;
+	struct {
+		Bool restack;		/* stacking order needs update */
+		Bool stacking;		/* _NET_CLIENT_LIST_STACKING needs update */
+		Bool clients;		/* _NET_CLIENT_LIST needs update */
+	} dirty;			/* deferred until arrangeneeded() */
+	Grid grid;			/* spatial index of client frames */
+	Bool numbered;			/* stackpos of clients is up to date */
+	struct {
+		Window *wl;		/* frames in the order last sent to the server */
+		unsigned n;		/* number of frames in wl */
+		unsigned size;		/* allocated size of wl */
+	} stacked;
 	DC dc;				/* draw context for frames, titles, grips */
 	GC gc;				/* graphics context for dock apps */
 	Element element[LastElement];
@@ -1493,6 +1720,12 @@ struct AScreen {
 	XColor *colors;			/* colormap */
 	int ncolors;			/* number of colors in colormap */
 	int cpc;
+	struct {
+		unsigned char shift, loss;	/* position and dropped low bits */
+	} rgb[3];			/* TrueColor channel layout */
+	Bool identity;			/* ARGB is already the visual's pixel format */
+	void (*convert)(const AScreen *, const ARGB *, unsigned char *, unsigned);
+					/* row converter chosen by initimage() */
 #ifdef STARTUP_NOTIFICATION
 	SnMonitorContext *ctx;
 #endif
@@ -1524,6 +1757,14 @@ typedef struct {
 #endif
 	regex_t *propregex;
 	regex_t *tagregex;
+	char *prefix;			/* class the prop regex is anchored to */
+	char *literal;			/* substring any prop match must contain */
+	Bool exact;			/* matching prefix alone decides the match */
+	struct {
+		AScreen *ds;
+		unsigned long long hash;	/* tag names last matched against */
+		unsigned long long tags;	/* tags matched by tagregex */
+	} tagcache;
 } Rule;					/* window matching rules */
 
 #ifdef STARTUP_NOTIFICATION
@@ -1539,6 +1780,7 @@ struct Notify {
 	Time timestamp;
 	Bool complete;
 	Bool assigned;
+	Timer timer;			/* expires the sequence if never assigned */
 };
 #endif
 
@@ -1569,10 +1811,15 @@ void *emallocz(size_t size);
 void *erealloc(void *ptr, size_t size);
 void eprint(const char *errstr, ...);
 Client *findclient(Window w);
+WinEntry *winmap_find(Window w);
+void winmap_save(Window w, int part, void *data);
+void winmap_delete(Window w, int part);
 Client *findmanaged(Window w);
 const char *getresource(const char *resource, const char *defval);
 const char *getscreenres(const char *resource, const char *defval);
 const char *getsessionres(const char *resource, const char *defval);
+const char *lookupres(XrmDatabase db, const char *name, const char *clas);
+void flushresources(void);
 void putresource(const char *resource, const char *value);
 void putscreenres(const char *resource, const char *value);
 void putintscreenres(const char *resource, int value);
@@ -1752,12 +1999,12 @@ do { \
 	_was_here--; \
 } while(0)
 
-void _xtrap_push(Bool ignore, const char *time, const char *file, int line, const char *func, const char *fmt, ...)
-     __attribute__((__format__(__printf__, 6, 7)));
-void _xtrap_pop(int canary);
+XErrorTrap *_xtrap_push(Bool ignore, const char *file, int line, const char *func, const char *fmt, ...)
+     __attribute__((__format__(__printf__, 5, 6)));
+void _xtrap_pop(XErrorTrap *trap);
 
-#define xtrap_push(ig,args...) int _xtrap_canary = 0; do { _xtrap_push(ig, _timestamp(), __FILE__, __LINE__, __func__, args); } while (0)
-#define xtrap_pop()            do { _xtrap_pop (_xtrap_canary); } while (0)
+#define xtrap_push(ig,args...) XErrorTrap *_xtrap_trap = _xtrap_push(ig, __FILE__, __LINE__, __func__, args)
+#define xtrap_pop()            do { _xtrap_pop (_xtrap_trap); } while (0)
 
 
 #define OPAQUE			0xffffffff
@@ -1815,5 +2062,17 @@ extern char **cargv;
 extern SnDisplay *sn_dpy;
 #endif
 extern XErrorTrap *traps;
+extern EventStats evstats;
+extern WinMapStats wmstats;
+extern PropStats propstats;
+extern ScanStats scanstats;
+extern DrawStats drawstats;
+extern TextStats textstats;
+extern IconStats iconstats;
+extern ResStats resstats;
+extern MoveStats movestats;
+extern TimerStats timerstats;
+extern SyncStats syncstats;
+void showstats(void);
 
 #endif				/* __LOCAL_ADWM_H__ */
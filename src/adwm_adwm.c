@@ -107,6 +107,7 @@ initkeysfile_ADWM(void)
 	free(path);
 	if (xkeysdb) {
 		XrmDestroyDatabase(xkeysdb);
+		flushresources();
 		xkeysdb = NULL;
 	}
 	xkeysdb = XrmGetFileDatabase(config.keysfile);
@@ -115,6 +116,7 @@ initkeysfile_ADWM(void)
 		return;
 	}
 	XrmMergeDatabases(xkeysdb, &xconfigdb);
+	flushresources();
 }
 /** @} */
 
@@ -149,6 +151,7 @@ initbtnsfile_ADWM(void)
 	free(path);
 	if (xbtnsdb) {
 		XrmDestroyDatabase(xbtnsdb);
+		flushresources();
 		xbtnsdb = NULL;
 	}
 	xbtnsdb = XrmGetFileDatabase(config.btnsfile);
@@ -157,6 +160,7 @@ initbtnsfile_ADWM(void)
 		return;
 	}
 	XrmMergeDatabases(xbtnsdb, &xconfigdb);
+	flushresources();
 }
 /** @} */
 
@@ -191,6 +195,7 @@ initrulefile_ADWM(void)
 	free(path);
 	if (xruledb) {
 		XrmDestroyDatabase(xruledb);
+		flushresources();
 		xruledb = NULL;
 	}
 	xruledb = XrmGetFileDatabase(config.rulefile);
@@ -199,6 +204,7 @@ initrulefile_ADWM(void)
 		return;
 	}
 	XrmMergeDatabases(xruledb, &xconfigdb);
+	flushresources();
 }
 /** @} */
 
@@ -232,6 +238,7 @@ initstylefile_ADWM(void)
 	free(path);
 	if (xstyledb) {
 		XrmDestroyDatabase(xstyledb);
+		flushresources();
 		xstyledb = NULL;
 	}
 	xstyledb = XrmGetFileDatabase(config.stylefile);
@@ -240,6 +247,7 @@ initstylefile_ADWM(void)
 		return;
 	}
 	XrmMergeDatabases(xstyledb, &xconfigdb);
+	flushresources();
 }
 /** @} */
 
@@ -273,6 +281,7 @@ initthemefile_ADWM(void)
 	free(path);
 	if (xthemedb) {
 		XrmDestroyDatabase(xthemedb);
+		flushresources();
 		xthemedb = NULL;
 	}
 	xthemedb = XrmGetFileDatabase(config.themefile);
@@ -281,6 +290,7 @@ initthemefile_ADWM(void)
 		return;
 	}
 	XrmMergeDatabases(xthemedb, &xconfigdb);
+	flushresources();
 }
 /** @} */
 
@@ -304,6 +314,7 @@ initrcfile_ADWM(const char *conf __attribute__((unused)), Bool reload __attribut
 	}
 	if (xconfigdb) {
 		XrmDestroyDatabase(xconfigdb);
+		flushresources();
 		xconfigdb = NULL;
 	}
 	for (i = 0; i < cargc - 1; i++)
@@ -483,6 +494,12 @@ initconfig_ADWM(Bool reload __attribute__((unused)))
 	strncpy(n, "dragdistance", nlen);
 	strncpy(c, "Dragdistance", clen);
 	options.dragdist = atoi(readres(name, clas, "5"));
+	strncpy(n, "framerate", nlen);
+	strncpy(c, "Framerate", clen);
+	options.framerate = atoi(readres(name, clas, "0"));
+	strncpy(n, "releasedelay", nlen);
+	strncpy(c, "Releasedelay", clen);
+	options.releasedelay = atoi(readres(name, clas, "0"));
 
 	strncpy(n, "mwfact", nlen);
 	strncpy(c, "Mwfact", clen);
@@ -612,6 +629,14 @@ initscreen_ADWM(Bool reload __attribute__((unused)))
 	strncpy(c, "Dragdistance", clen);
 	if ((res = readres(name, clas, NULL)))
 		scr->options.dragdist = atoi(res);
+	strncpy(n, "framerate", nlen);
+	strncpy(c, "Framerate", clen);
+	if ((res = readres(name, clas, NULL)))
+		scr->options.framerate = atoi(res);
+	strncpy(n, "releasedelay", nlen);
+	strncpy(c, "Releasedelay", clen);
+	if ((res = readres(name, clas, NULL)))
+		scr->options.releasedelay = atoi(res);
 	strncpy(n, "mwfact", nlen);
 	strncpy(c, "Mwfact", clen);
 	if ((res = readres(name, clas, NULL))) {
@@ -291,6 +291,10 @@ initscreen(Bool reload __attribute__((unused)))
 		scr->options.dockmon = atoi(res);
 	if ((res = getscreenres("dragdistance", NULL)))
 		scr->options.dragdist = atoi(res);
+	if ((res = getscreenres("framerate", NULL)))
+		scr->options.framerate = atoi(res);
+	if ((res = getscreenres("releasedelay", NULL)))
+		scr->options.releasedelay = atoi(res);
 	if ((res = getscreenres("mwfact", NULL))) {
 		scr->options.mwfact = atof(res);
 		if (scr->options.mwfact < 0.10 || scr->options.mwfact > 0.90)
@@ -351,6 +355,8 @@ initconfig(Bool reload __attribute__((unused)))
 	options.dockori = atoi(getsessionres("dock.orient", "1"));
 	options.dockmon = atoi(getsessionres("dock.monitor", "0"));
 	options.dragdist = atoi(getsessionres("dragdistance", "5"));
+	options.framerate = atoi(getsessionres("framerate", "0"));
+	options.releasedelay = atoi(getsessionres("releasedelay", "0"));
 	options.mwfact = atof(getsessionres("mwfact", STR(DEFMWFACT)));
 	if (options.mwfact < 0.10 || options.mwfact > 0.90)
 		options.mwfact = DEFMWFACT;
@@ -572,6 +578,7 @@ initdockfile(void)
 		return;
 	}
 	XrmMergeDatabases(drdb, &xrdb);
+	flushresources();
 }
 
 static void
@@ -630,6 +637,7 @@ initkeysfile(void)
 		return;
 	}
 	XrmMergeDatabases(krdb, &xrdb);
+	flushresources();
 }
 
 static void
@@ -688,6 +696,7 @@ initbtnsfile(void)
 		return;
 	}
 	XrmMergeDatabases(brdb, &xrdb);
+	flushresources();
 }
 
 static void
@@ -746,6 +755,7 @@ initrulefile(void)
 		return;
 	}
 	XrmMergeDatabases(brdb, &xrdb);
+	flushresources();
 }
 
 static void
@@ -831,6 +841,7 @@ initstylefile(void)
 		return;
 	}
 	XrmMergeDatabases(yrdb, &xrdb);
+	flushresources();
 }
 
 static void
@@ -914,6 +925,7 @@ initthemefile(void)
 		return;
 	}
 	XrmMergeDatabases(trdb, &xrdb);
+	flushresources();
 }
 
 static void
@@ -1001,6 +1013,7 @@ initrcfile(const char *conf __attribute__((unused)), Bool reload)
 	}
 	if (xrdb) {
 		XrmDestroyDatabase(xrdb);
+		flushresources();
 		xresdb = xrdb = NULL;
 	}
 	for (i = 0; i < cargc - 1; i++)
@@ -97,6 +97,7 @@
 #define drawsep(args...)	  xcairo_drawsep(args)
 #define drawdockapp(args...)	  xcairo_drawdockapp(args)
 #define drawnormal(args...)	  xcairo_drawnormal(args)
+#define NO_BACKBUFFER		  1	/* draws straight to the title window */
 #define initpng(args...)	  xcairo_initpng(args)
 #define initjpg(args...)	  xcairo_initjpg(args)
 #define initsvg(args...)	  xcairo_initsvg(args)
@@ -117,6 +118,9 @@
 #define drawsep(args...)	  ximage_drawsep(args)
 #define drawdockapp(args...)	  ximage_drawdockapp(args)
 #define drawnormal(args...)	  ximage_drawnormal(args)
+#ifdef RENDER
+#define drawtitle(args...)	  ximage_drawtitle(args)
+#endif
 #define initpng(args...)	  ximage_initpng(args)
 #define initjpg(args...)	  ximage_initjpg(args)
 #define initsvg(args...)	  ximage_initsvg(args)
@@ -147,6 +151,12 @@
 #endif				/* !defined PIXBUF || !defined USE_PIXBUF */
 #endif				/* !defined IMLIB2 || !defined USE_IMLIB2 */
 
+#ifndef drawtitle
+#define drawtitle(ds, c, args...) drawtext(ds, (c)->name, args)
+#endif
+
+DrawStats drawstats = { 0, };
+
 Bool
 drawdamage(Client *c, XDamageNotifyEvent *ev)
 {
@@ -169,26 +179,229 @@ drawdamage(Client *c, XDamageNotifyEvent *ev)
 	return (status);
 }
 
-void
-removebutton(ButtonImage *bi)
+static void
+removepixmap(AdwmPixmap *px)
 {
-	free(bi->px.file);
-	bi->px.file = NULL;
-
 #if defined IMLIB2 && defined USE_IMLIB2
-	imlib2_removepixmap(&bi->px);
+	imlib2_removepixmap(px);
 #endif				/* defined IMLIB2 && defined USE_IMLIB2 */
 #if defined PIXBUF && defined USE_PIXBUF
-	pixbuf_removepixmap(&bi->px);
+	pixbuf_removepixmap(px);
 #endif				/* defined PIXBUF && defined USE_PIXBUF */
 #if defined RENDER && defined USE_RENDER
-	render_removepixmap(&bi->px);
+	render_removepixmap(px);
 #endif				/* defined RENDER && defined USE_RENDER */
 #if 1
-	ximage_removepixmap(&bi->px);
+	ximage_removepixmap(px);
 #else
-	xlib_removepixmap(&bi->px);
+	xlib_removepixmap(px);
+#endif
+}
+
+/*
+ * Icons decoded from files and from _NET_WM_ICON data are shared by all the
+ * button images that show them, keyed by source (file name, or hash of the
+ * icon data), screen, title height and depth.  Button images hold references; icons
+ * that are no longer referenced are kept, least recently used first out, for
+ * as long as they fit in ICONCACHE_MAX bytes.
+ */
+struct SharedIcon {
+	SharedIcon *prev, *next;	/* most recently used first */
+	char *file;			/* source file, or NULL for icon data */
+	uint64_t hash;			/* hash of icon data */
+	unsigned w, h;			/* dimensions of icon data */
+	AScreen *ds;			/* screen decoded for */
+	unsigned size, depth;		/* title height and depth decoded for */
+	AdwmPixmap px;
+	unsigned refs;
+	size_t bytes;
+};
+
+static struct {
+	SharedIcon *head, *tail;
+	size_t unused;			/* bytes of unreferenced icons */
+} icons;
+
+IconStats iconstats = { 0, };
+
+static void
+unlinkicon(SharedIcon *si)
+{
+	if (si->prev)
+		si->prev->next = si->next;
+	else
+		icons.head = si->next;
+	if (si->next)
+		si->next->prev = si->prev;
+	else
+		icons.tail = si->prev;
+	si->prev = si->next = NULL;
+}
+
+static void
+pushicon(SharedIcon *si)
+{
+	if ((si->next = icons.head))
+		icons.head->prev = si;
+	else
+		icons.tail = si;
+	icons.head = si;
+}
+
+static void
+trimicons(void)
+{
+	SharedIcon *si, *prev;
+
+	for (si = icons.tail; si && icons.unused > ICONCACHE_MAX; si = prev) {
+		prev = si->prev;
+		if (si->refs)
+			continue;
+		unlinkicon(si);
+		icons.unused -= si->bytes;
+		removepixmap(&si->px);
+		free(si->file);
+		free(si);
+		iconstats.evictions++;
+	}
+}
+
+static uint64_t
+hashicon(unsigned w, unsigned h, const long *data)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i, n = (size_t) w * h;
+
+	for (i = 0; i < n; i++)
+		hash = (hash ^ (uint64_t) data[i]) * 1099511628211ULL;
+	return (hash);
+}
+
+static SharedIcon *
+findicon(AScreen *ds, const char *file, uint64_t hash, unsigned w, unsigned h)
+{
+	SharedIcon *si;
+
+	for (si = icons.head; si; si = si->next) {
+		if (si->ds != ds || si->size != (unsigned) ds->style.titleheight ||
+		    si->depth != ds->depth)
+			continue;
+		if (file ? (si->file && !strcmp(si->file, file)) :
+		    (!si->file && si->hash == hash && si->w == w && si->h == h))
+			break;
+	}
+	return (si);
+}
+
+/* Point all the button images of a client at a shared icon. */
+static void
+shareicon(SharedIcon *si, Client *c)
+{
+	ButtonImage **bis;
+
+	for (bis = getbuttons(c); bis && *bis; bis++) {
+		ButtonImage *bi = *bis;
+
+		if (bi->shared == si)
+			continue;
+		removebutton(bi);
+		if (!si->refs++)
+			icons.unused -= si->bytes;
+		bi->px = si->px;
+		bi->shared = si;
+		bi->present = True;
+	}
+	if (si != icons.head) {
+		unlinkicon(si);
+		pushicon(si);
+	}
+}
+
+static Bool
+createfileicon(AScreen *ds, Client *c, const char *file)
+{
+	const char *p;
+
+	if (!(p = strrchr(file, '.')))
+		return (False);
+	p++;
+	if (!strcmp(p, "xbm"))
+		return createxbmicon(ds, c, file);
+#if defined XPM || defined IMLIB2 || defined PIXBUF
+	if (!strcmp(p, "xpm"))
+		return createxpmicon(ds, c, file);
+#endif
+#if defined LIBPNG || defined IMLIB2 || defined PIXBUF
+	if (!strcmp(p, "png"))
+		return createpngicon(ds, c, file);
+#endif
+#if defined LIBRSVG
+	if (!strcmp(p, "svg"))
+		return createsvgicon(ds, c, file);
 #endif
+	return (False);
+}
+
+/*
+ * Give a client the icon from a file or from icon data, decoding it only when
+ * no other button image already shows it.
+ */
+static Bool
+createsharedicon(AScreen *ds, Client *c, const char *file, unsigned w, unsigned h,
+		 long *data)
+{
+	uint64_t hash = file ? 0 : hashicon(w, h, data);
+	ButtonImage **bis, *bi = &c->button;
+	SharedIcon *si;
+
+	if ((si = findicon(ds, file, hash, w, h))) {
+		iconstats.hits++;
+		shareicon(si, c);
+		return (True);
+	}
+	/* the backends write the decoded icon into each button image */
+	for (bis = getbuttons(c); bis && *bis; bis++)
+		if ((*bis)->shared)
+			removebutton(*bis);
+	if (!(file ? createfileicon(ds, c, file) : createdataicon(ds, c, w, h, data)))
+		return (False);
+	iconstats.misses++;
+	if (!bi->present)
+		return (True);
+	/* adopt the window's copy and let the others share it */
+	si = ecalloc(1, sizeof(*si));
+	si->file = file ? strdup(file) : NULL;
+	si->hash = hash;
+	si->w = w;
+	si->h = h;
+	si->ds = ds;
+	si->size = ds->style.titleheight;
+	si->depth = ds->depth;
+	si->px = bi->px;
+	si->px.file = NULL;
+	si->bytes = (size_t) si->px.w * si->px.h * sizeof(ARGB);
+	si->refs = 1;
+	bi->shared = si;
+	pushicon(si);
+	shareicon(si, c);
+	return (True);
+}
+
+void
+removebutton(ButtonImage *bi)
+{
+	free(bi->px.file);
+	bi->px.file = NULL;
+
+	if (bi->shared) {
+		if (!--bi->shared->refs) {
+			icons.unused += bi->shared->bytes;
+			trimicons();
+		}
+		bi->shared = NULL;
+		memset(&bi->px, 0, sizeof(bi->px));
+	} else
+		removepixmap(&bi->px);
 	bi->present = False;
 }
 
@@ -313,7 +526,7 @@ createneticon(Client *c, long *data, unsigned long n)
 		}
 	}
 	if (best)
-		status = createdataicon(scr, c, best->w, best->h, best->icon);
+		status = createsharedicon(scr, c, NULL, best->w, best->h, best->icon);
 	free(icons);
 	XFree(data);
 	return (status);
@@ -324,7 +537,7 @@ createappicon(Client *c)
 {
 	const char *names[4] = { NULL, };
 	const char *exts[5] = { NULL, };
-	char *file, *p;
+	char *file;
 	int i = 0, j = 0;
 	Bool result = False;
 
@@ -352,26 +565,7 @@ createappicon(Client *c)
 
 	if (!(file = FindBestIcon(names, scr->style.titleheight, exts)))
 		return (result);
-	if ((p = strrchr(file, '.'))) {
-		p++;
-		if (!strcmp(p, "xbm"))
-			result = createxbmicon(scr, c, file);
-#if defined XPM || defined IMLIB2 || defined PIXBUF
-		else
-		if (!strcmp(p, "xpm"))
-			result = createxpmicon(scr, c, file);
-#endif
-#if defined LIBPNG || defined IMLIB2 || defined PIXBUF
-		else
-		if (!strcmp(p, "png"))
-			result = createpngicon(scr, c, file);
-#endif
-#if defined LIBRSVG
-		else
-		if (!strcmp(p, "svg"))
-			result = createsvgicon(scr, c, file);
-#endif
-	}
+	result = createsharedicon(scr, c, file, 0, 0, NULL);
 	free(file);
 	return (result);
 }
@@ -410,8 +604,101 @@ getpixel(AScreen *ds, Client *c, int type)
 	return col->pixel;
 }
 
-unsigned int
-textnw(AScreen *ds, const char *text, unsigned int len, int hilite)
+/*
+ * Measured strings are cached per screen and font (hilite), keyed by a hash of
+ * the text, along with the longest prefix of the text that fits the width it
+ * was last fitted to.  Titles are measured several times for each redraw and
+ * seldom change between redraws.  The least recently used entries are dropped
+ * beyond TEXTCACHE_MAX entries, and the entries for a font when it is closed.
+ */
+typedef struct TextExtent TextExtent;
+
+struct TextExtent {
+	TextExtent *prev, *next;	/* most recently used first */
+	TextExtent *chain;		/* hash bucket */
+	const AScreen *ds;
+	int hilite;
+	unsigned hash;
+	unsigned len;
+	unsigned width;			/* width of the whole text */
+	int fitw;			/* width last fitted to */
+	unsigned fitlen;		/* bytes of the text that fit in fitw */
+	int fitwidth;			/* width of those bytes, -1 when none fit */
+	char text[];
+};
+
+#define TEXTBUCKETS	256
+
+static struct {
+	TextExtent *head, *tail;
+	TextExtent *buckets[TEXTBUCKETS];
+	unsigned count;
+} texts;
+
+TextStats textstats = { 0, };
+
+static unsigned
+hashtext(const AScreen *ds, const char *text, unsigned len, int hilite)
+{
+	unsigned hash = 2166136261U ^ (unsigned) (uintptr_t) ds ^ (unsigned) hilite;
+
+	while (len--)
+		hash = (hash ^ (unsigned char) *text++) * 16777619U;
+	return hash;
+}
+
+static void
+unlinktext(TextExtent *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		texts.head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		texts.tail = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void
+pushtext(TextExtent *e)
+{
+	if ((e->next = texts.head))
+		texts.head->prev = e;
+	else
+		texts.tail = e;
+	texts.head = e;
+}
+
+static void
+freetext(TextExtent *e)
+{
+	TextExtent **ep;
+
+	for (ep = &texts.buckets[e->hash % TEXTBUCKETS]; *ep != e; ep = &(*ep)->chain) ;
+	*ep = e->chain;
+	unlinktext(e);
+	texts.count--;
+	free(e);
+}
+
+/** @brief Release cached text extents of a screen and font (-1 matches all fonts).
+  */
+static void
+releasetexts(const AScreen *ds, int hilite)
+{
+	TextExtent *e, *next;
+
+	for (e = texts.head; e; e = next) {
+		next = e->next;
+		if (e->ds == ds && (hilite == -1 || e->hilite == hilite))
+			freetext(e);
+	}
+}
+
+static unsigned
+measuretext(AScreen *ds, const char *text, unsigned len, int hilite)
 {
 	XftTextExtentsUtf8(dpy, ds->style.font[hilite],
 			   (const unsigned char *) text, len,
@@ -419,6 +706,104 @@ textnw(AScreen *ds, const char *text, unsigned int len, int hilite)
 	return ds->dc.font[hilite].extents->xOff;
 }
 
+static TextExtent *
+textextent(AScreen *ds, const char *text, unsigned len, int hilite)
+{
+	unsigned hash = hashtext(ds, text, len, hilite);
+	TextExtent *e, **bucket = &texts.buckets[hash % TEXTBUCKETS];
+
+	for (e = *bucket; e; e = e->chain)
+		if (e->hash == hash && e->len == len && e->hilite == hilite && e->ds == ds &&
+		    !memcmp(e->text, text, len))
+			break;
+	if (e) {
+		textstats.hits++;
+		if (e != texts.head) {
+			unlinktext(e);
+			pushtext(e);
+		}
+		return e;
+	}
+	textstats.misses++;
+	e = ecalloc(1, sizeof(*e) + len + 1);
+	e->ds = ds;
+	e->hilite = hilite;
+	e->hash = hash;
+	e->len = len;
+	memcpy(e->text, text, len);
+	e->width = measuretext(ds, text, len, hilite);
+	e->fitw = INT_MIN;
+	e->fitwidth = -1;
+	e->chain = *bucket;
+	*bucket = e;
+	pushtext(e);
+	if (++texts.count > TEXTCACHE_MAX) {
+		freetext(texts.tail);
+		textstats.evictions++;
+	}
+	return e;
+}
+
+unsigned int
+textnw(AScreen *ds, const char *text, unsigned int len, int hilite)
+{
+	return textextent(ds, text, len, hilite)->width;
+}
+
+/** @brief Fit text into mw pixels for drawing.
+  *
+  * Copies into buf (of size bytes) the longest prefix of text that fits in mw
+  * pixels, ending in "..." when the text was shortened, and sets *lenp to its
+  * length.  Returns the width of the prefix, or -1 when nothing fits.
+  */
+int
+textfit(AScreen *ds, const char *text, int hilite, int mw, char *buf, size_t size,
+	unsigned *lenp)
+{
+	unsigned olen, len, lo, hi, mid;
+	TextExtent *e;
+
+	olen = len = strlen(text);
+	if (len >= size)
+		len = size - 1;
+	e = textextent(ds, text, len, hilite);
+	if (e->fitw != mw) {
+		textstats.fits++;
+		e->fitw = mw;
+		if ((int) e->width <= mw) {
+			e->fitlen = len;
+			e->fitwidth = e->width;
+		} else {
+			/* widths grow with the prefix: find the longest that fits */
+			for (lo = 0, hi = len; hi - lo > 1;) {
+				mid = (lo + hi) / 2;
+				if ((int) measuretext(ds, text, mid, hilite) <= mw)
+					lo = mid;
+				else
+					hi = mid;
+			}
+			e->fitlen = lo;
+			e->fitwidth = lo ? (int) measuretext(ds, text, lo, hilite) : -1;
+		}
+	}
+	if (e->fitwidth < 0)
+		return -1;
+	len = e->fitlen;
+	memcpy(buf, text, len);
+	buf[len] = 0;
+	if (len < olen) {
+		if (len > 1)
+			buf[len - 1] = '.';
+		if (len > 2)
+			buf[len - 2] = '.';
+		if (len > 3)
+			buf[len - 3] = '.';
+	}
+	if (lenp)
+		*lenp = len;
+	return e->fitwidth;
+}
+
 unsigned int
 textw(AScreen *ds, const char *text, int hilite)
 {
@@ -660,7 +1045,7 @@ elementw(AScreen *ds, Client *c, char which)
 {
 	int w = 0;
 	ElementType type = elementtype(which);
-	int hilite = (c == sel) ? Selected : (c->is.focused ? Focused : Normal);
+	int hilite = gethilite(c);
 
 	if (0 > type || type >= LastElement)
 		return 0;
@@ -702,7 +1087,7 @@ drawelement(AScreen *ds, char which, int x, int position, Client *c)
 {
 	int w = 0;
 	XftColor *color = c == sel ? ds->style.color.sele : ds->style.color.norm;
-	int hilite = (c == sel) ? Selected : (c->is.focused ? Focused : Normal);
+	int hilite = gethilite(c);
 	ElementType type = elementtype(which);
 	ElementClient *ec = &c->element[type];
 
@@ -735,8 +1120,8 @@ drawelement(AScreen *ds, char which, int x, int position, Client *c)
 		ec->eg.w = w;
 		break;
 	case TitleName:
-		w = drawtext(ds, c->name, ds->dc.draw.pixmap, ds->dc.draw.xft, color,
-			     hilite, ds->dc.x, ds->dc.y, ds->dc.w);
+		w = drawtitle(ds, c, ds->dc.draw.pixmap, ds->dc.draw.xft, color,
+			      hilite, ds->dc.x, ds->dc.y, ds->dc.w);
 		ec->eg.w = w;
 		break;
 	case TitleSep:
@@ -745,8 +1130,15 @@ drawelement(AScreen *ds, char which, int x, int position, Client *c)
 		ec->eg.w = w;
 		break;
 	default:
-		if (0 <= type && type < LastBtn)
-			w = drawbutton(ds, c, type, color, ds->dc.x);
+		if (0 <= type && type < LastBtn) {
+			ec->drawn = True;
+			ec->dx = ds->dc.x;
+			ec->dpressed = ec->pressed;
+			if ((w = drawbutton(ds, c, type, color, ds->dc.x)))
+				ec->image = buttonimage(ds, c, type);
+			else
+				ec->image = NULL;
+		}
 		break;
 	}
 	if (w) {
@@ -758,10 +1150,113 @@ drawelement(AScreen *ds, char which, int x, int position, Client *c)
 	return w;
 }
 
+/*
+ * The last drawn state of the title bar is retained in the client.  When
+ * nothing that affects the layout of the title bar has changed, only buttons
+ * whose image changed (hover, press, toggle) are redrawn into the back buffer
+ * and copied to the title window; when nothing changed at all, nothing is
+ * drawn.  Exposures and style changes invalidate the retained state.  The
+ * back buffer is the screen's shared draw pixmap, not one per client, so a
+ * change of the title text still redraws the whole title bar.
+ */
+static Bool
+titlechanged(AScreen *ds, Client *c)
+{
+	int hilite = gethilite(c);
+
+	if (!c->drawn.title || c->drawn.w != c->c.w || c->drawn.hilite != hilite ||
+	    c->drawn.hues != gethues(ds, c) || c->drawn.tags != c->tags)
+		return True;
+	if (!c->drawn.name || strcmp(c->drawn.name, c->name ? : ""))
+		return True;
+	/* narrow titles are laid out differently by drawnormal() */
+	if (c->c.w < (int) textw(ds, c->name, hilite))
+		return True;
+	return False;
+}
+
+static Bool
+overlaps(Geometry *a, Geometry *b)
+{
+	return (a->x < b->x + b->w && b->x < a->x + a->w &&
+		a->y < b->y + b->h && b->y < a->y + a->h);
+}
+
+/* Returns False when the title bar must be redrawn completely. */
+static Bool
+drawbuttons(AScreen *ds, Client *c)
+{
+	unsigned long long mask = 0;
+	ElementClient *ec;
+	ButtonImage *bi;
+	ElementType type;
+	const char *p;
+
+	if (!c->element || !c->title)
+		return True;
+	for (p = ds->style.titlelayout; *p; p++) {
+		if ((type = elementtype(*p)) < 0 || type >= LastBtn)
+			continue;
+		if (!(ec = &c->element[type])->drawn)
+			continue;
+		bi = buttonimage(ds, c, type);
+		if (bi && !bi->present)
+			bi = NULL;
+		if (bi == ec->image && ec->pressed == ec->dpressed)
+			continue;
+		if (!bi || !ec->image || bi->px.w != ec->image->px.w ||
+		    bi->px.h != ec->image->px.h)
+			return False;
+		if (c->element[TitleName].present &&
+		    overlaps(&ec->eg, &c->element[TitleName].eg))
+			return False;
+		if (c->element[TitleTags].present &&
+		    overlaps(&ec->eg, &c->element[TitleTags].eg))
+			return False;
+		mask |= (1ULL << type);
+	}
+	if (!mask) {
+		drawstats.skipped++;
+		return True;
+	}
+#ifdef NO_BACKBUFFER
+	return False;
+#else
+	ds->dc.y = 0;
+	ds->dc.w = c->c.w;
+	ds->dc.h = ds->style.titleheight;
+	XSetFillStyle(dpy, ds->dc.gc, FillSolid);
+	for (p = ds->style.titlelayout; *p; p++) {
+		if ((type = elementtype(*p)) < 0 || type >= LastBtn || !(mask & (1ULL << type)))
+			continue;
+		mask &= ~(1ULL << type);
+		ec = &c->element[type];
+		bi = buttonimage(ds, c, type);
+		/* clear what the old image left behind */
+		XSetForeground(dpy, ds->dc.gc, bi->bg.pixel ? bi->bg.pixel : getpixel(ds, c, ColBG));
+		XFillRectangle(dpy, ds->dc.draw.pixmap, ds->dc.gc, ec->eg.x, ec->eg.y,
+			       ec->eg.w, ec->eg.h);
+		ds->dc.x = ec->dx;
+		drawelement(ds, *p, ds->dc.x, AlignLeft, c);
+		if (ds->style.outline && ec->eg.y + ec->eg.h > ds->dc.h - ds->style.border) {
+			XSetForeground(dpy, ds->dc.gc, getpixel(ds, c, ColBorder));
+			XFillRectangle(dpy, ds->dc.draw.pixmap, ds->dc.gc, ec->eg.x,
+				       ds->dc.h - ds->style.border, ec->eg.w,
+				       ds->style.border);
+		}
+		XCopyArea(dpy, ds->dc.draw.pixmap, c->title, ds->dc.gc, ec->eg.x, ec->eg.y,
+			  ec->eg.w, ec->eg.h, ec->eg.x, ec->eg.y);
+	}
+	drawstats.partial++;
+	return True;
+#endif
+}
+
 void
 drawclient(Client *c)
 {
 	AScreen *ds;
+	int i;
 
 	/* might be drawing a client that is not on the current screen */
 	if (!(ds = getscreen(c->win, True))) {
@@ -777,7 +1272,26 @@ drawclient(Client *c)
 		return drawdockapp(ds, c);
 	if (!c->title && !c->grips)
 		return;
+	if (!titlechanged(ds, c) && drawbuttons(ds, c) && (c->drawn.grips || !c->grips))
+		return;
+	/* grips only depend on the width and the colors */
+	if (c->drawn.w != c->c.w || c->drawn.hues != gethues(ds, c))
+		c->drawn.grips = False;
+	if (c->element)
+		for (i = 0; i < LastElement; i++)
+			c->element[i].drawn = False;
+	drawstats.full++;
+	if (c->grips && !c->drawn.grips)
+		drawstats.grips++;
 	drawnormal(ds, c);
+	c->drawn.title = True;
+	c->drawn.grips = True;
+	c->drawn.w = c->c.w;
+	c->drawn.hilite = gethilite(c);
+	c->drawn.hues = gethues(ds, c);
+	c->drawn.tags = c->tags;
+	free(c->drawn.name);
+	c->drawn.name = strdup(c->name ? : "");
 }
 
 static Bool
@@ -1055,6 +1569,7 @@ initbuttons()
 static void
 freefont(int hilite)
 {
+	releasetexts(scr, hilite);
 	if (scr->style.font[hilite]) {
 		XftFontClose(dpy, scr->style.font[hilite]);
 		scr->style.font[hilite] = NULL;
@@ -1091,10 +1606,38 @@ freecolor(XftColor *color)
 		XftColorFree(dpy, scr->visual, scr->colormap, color);
 }
 
+#ifdef RENDER
+/** @brief Release the pre-rendered title text of a client.
+  */
+void
+freetextlayer(Client *c)
+{
+	if (c->layer.mask) {
+		XRenderFreePicture(dpy, c->layer.mask);
+		c->layer.mask = None;
+	}
+	if (c->layer.pixmap) {
+		XFreePixmap(dpy, c->layer.pixmap);
+		c->layer.pixmap = None;
+	}
+	free(c->layer.text);
+	c->layer.text = NULL;
+	c->layer.font = NULL;
+	c->layer.w = c->layer.h = 0;
+}
+#endif
+
 void
 freestyle()
 {
 	int i, j;
+#ifdef RENDER
+	Client *c;
+
+	/* rendered with fonts that are about to be closed */
+	for (c = scr->clients; c; c = c->next)
+		freetextlayer(c);
+#endif
 
 	freebuttons();
 	for (i = 0; i <= Selected; i++) {
@@ -1110,6 +1653,12 @@ freestyle()
 		XftDrawDestroy(scr->dc.draw.xft);
 		scr->dc.draw.xft = NULL;
 	}
+#ifdef RENDER
+	if (scr->dc.draw.pict) {
+		XRenderFreePicture(dpy, scr->dc.draw.pict);
+		scr->dc.draw.pict = None;
+	}
+#endif
 	if (scr->dc.draw.pixmap) {
 		XFreePixmap(dpy, scr->dc.draw.pixmap);
 		scr->dc.draw.pixmap = None;
@@ -1182,6 +1731,7 @@ initstyle(Bool reload __attribute__((unused)))
 	initbuttons();
 	/* redraw all existing clients */
 	for (c = scr->clients; c ; c = c->next) {
+		c->drawn.title = c->drawn.grips = False;
 		drawclient(c);
 		ewmh_update_net_window_extents(c);
 	}
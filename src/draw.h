@@ -23,11 +23,16 @@ int drawelement(AScreen *ds, char which, int x, int position, Client *c);
 ButtonImage *buttonimage(AScreen *ds, Client *c, ElementType type);
 unsigned int textnw(AScreen *ds, const char *text, unsigned int len, int hilite);
 unsigned int textw(AScreen *ds, const char *text, int hilite);
+int textfit(AScreen *ds, const char *text, int hilite, int mw, char *buf, size_t size,
+	    unsigned *lenp);
 int gethilite(Client *c);
 XftColor *gethues(AScreen *ds, Client *c);
 XftColor *getcolor(AScreen *ds, Client *c, int type);
 unsigned long getpixel(AScreen *ds, Client *c, int type);
 void initelement(ElementType type, const char *name, const char *dev, Bool (**action) (Client *, XEvent *));
+#ifdef RENDER
+void freetextlayer(Client *c);
+#endif
 void freestyle();
 void initstyle(Bool reload);
 
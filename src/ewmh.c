@@ -5,6 +5,7 @@
 #include "draw.h"
 #include "tags.h"
 #include "config.h"
+#include "timer.h"
 #include "ewmh.h" /* verification */
 
 extern AdwmPlaces config;
@@ -371,6 +372,8 @@ parse_startup_id(const char *id, char **launcher_p, char **launchee_p, char **ho
 #ifdef STARTUP_NOTIFICATION
 static Notify *notifies = NULL;
 
+#define SNTIMEOUT	15000	/* msec before an unassigned sequence is dropped */
+
 struct SnStartupSequence
 {
 	int refcount;
@@ -465,6 +468,19 @@ c_find_seq(SnStartupSequence *seq)
 	return (c);
 }
 
+static void n_del_notify(Notify *n);
+
+static void
+n_expire_notify(Timer *t __attribute__((unused)), void *data)
+{
+	Notify *n = data;
+
+	if (n->assigned)
+		return;
+	XPRINTF("NOTIFY: EXPIRE: %s\n", n->id);
+	n_del_notify(n);
+}
+
 static void
 n_new_notify(SnStartupSequence *seq)
 {
@@ -488,6 +504,8 @@ n_new_notify(SnStartupSequence *seq)
 	XPRINTF("NOTIFY: NEW: %s\n", n->id);
 	n->next = notifies;
 	notifies = n;
+	timer_init(&n->timer, n_expire_notify, n);
+	timer_start(&n->timer, SNTIMEOUT, 0);
 }
 
 static void ewmh_update_sn_app_props(Client *c, Notify *n);
@@ -519,6 +537,7 @@ n_del_notify(Notify *n)
 	np = n_find_n(n);
 	assert(np != NULL);
 	*np = n->next;
+	timer_stop(&n->timer);
 	sn_startup_sequence_unref(n->seq);
 	free(n->id);
 	free(n->launcher);
@@ -1026,16 +1045,36 @@ ewmh_update_echinus_layout_name()
 }
 
 Bool adding_client = False;
+unsigned long pending_states = 0;
 
+/* Client list updates are deferred: they only mark the screen and are written
+ * once by ewmh_flush_net_client_lists() when pending arrangements are flushed. */
 void
 ewmh_update_net_client_list_stacking()
+{
+	scr->dirty.stacking = True;
+}
+
+void
+ewmh_update_net_client_list()
+{
+	scr->dirty.clients = True;
+}
+
+void
+ewmh_update_net_client_lists()
+{
+	scr->dirty.clients = True;
+	scr->dirty.stacking = True;
+}
+
+static void
+ewmh_write_net_client_list_stacking()
 {
 	Client *c;
 	Window *wl = NULL;
 	int i, n;
 
-	if (adding_client)
-		return;
 	XPRINTF("%s\n", "Updating _NET_CLIENT_LIST_STACKING");
 	for (n = 0, c = scr->stack; c; n++, c = c->snext) ;
 	if (n && (wl = ecalloc(n, sizeof(Window)))) {
@@ -1046,18 +1085,15 @@ ewmh_update_net_client_list_stacking()
 	XChangeProperty(dpy, scr->root, _XA_NET_CLIENT_LIST_STACKING, XA_WINDOW, 32,
 			PropModeReplace, (unsigned char *) wl, n);
 	free(wl);
-	XFlush(dpy);		/* XXX: caller's responsibility */
 }
 
-void
-ewmh_update_net_client_list()
+static void
+ewmh_write_net_client_list()
 {
 	Client *c;
 	Window *wl = NULL;
 	int i, n;
 
-	if (adding_client)
-		return;
 	XPRINTF("%s\n", "Updating _NET_CLIENT_LIST");
 	for (n = 0, c = scr->clist; c; n++, c = c->cnext) ;
 	if (n && (wl = calloc(n, sizeof(Window)))) {
@@ -1070,17 +1106,22 @@ ewmh_update_net_client_list()
 	XChangeProperty(dpy, scr->root, _XA_WIN_CLIENT_LIST, XA_CARDINAL, 32,
 			PropModeReplace, (unsigned char *) wl, n);
 	free(wl);
-	XFlush(dpy);		/* XXX: caller's responsibility */
 }
 
 void
-ewmh_update_net_client_lists()
+ewmh_flush_net_client_lists()
 {
+	/* don't add to client lists till fully configured (confuses libwnck and friends otherwise) */
 	if (adding_client)
 		return;
-	ewmh_update_net_client_list();
-	ewmh_update_net_client_list_stacking();
-	XFlush(dpy);		/* XXX: caller's responsibility */
+	if (scr->dirty.clients) {
+		scr->dirty.clients = False;
+		ewmh_write_net_client_list();
+	}
+	if (scr->dirty.stacking) {
+		scr->dirty.stacking = False;
+		ewmh_write_net_client_list_stacking();
+	}
 }
 
 void
@@ -2127,12 +2168,24 @@ ewmh_update_net_window_actions(Client *c)
 
 void
 ewmh_update_net_window_state(Client *c)
+{
+	/* do not update until we have finished reading it */
+	if (!c->is.managed)
+		return;
+	if (!c->needstate) {
+		c->needstate = True;
+		pending_states++;
+	}
+}
+
+void
+ewmh_flush_net_window_state(Client *c)
 {
 	long winstate[20];
 	int states = 0;
 	unsigned long state = 0;
 
-	/* do not update until we have finished reading it */
+	c->needstate = False;
 	if (!c->is.managed)
 		return;
 
@@ -2948,8 +3001,8 @@ ewmh_release_user_time_window(Client *c)
 
 	c->time_window = None;
 	XSelectInput(dpy, win, NoEventMask);
-	XDeleteContext(dpy, win, context[ClientTimeWindow]);
-	XDeleteContext(dpy, win, context[ClientAny]);
+	winmap_delete(win, ClientTimeWindow);
+	winmap_delete(win, ClientAny);
 }
 
 Window getrecwin(Client *c, Atom atom);
@@ -2969,8 +3022,8 @@ ewmh_process_net_window_user_time_window(Client *c)
 	c->time_window = win;
 	if (win != c->win) {
 		XSelectInput(dpy, win, PropertyChangeMask);
-		XSaveContext(dpy, win, context[ClientTimeWindow], (XPointer) c);
-		XSaveContext(dpy, win, context[ClientAny], (XPointer) c);
+		winmap_save(win, ClientTimeWindow, c);
+		winmap_save(win, ClientAny, c);
 	}
 	ewmh_process_net_window_user_time(c);
 }
@@ -2983,6 +3036,9 @@ ewmh_process_net_window_icon(Client *c)
 	Pixmap *pixmap;
 	ButtonImage *bi;
 
+	/* only drawn in the title bar: rendered when that is realized */
+	if (!c->title)
+		return;
 	if ((bi = getbutton(c)))
 		return;
 	if ((card = getcard(c->win, _XA_NET_WM_ICON, &n))) {
@@ -3207,10 +3263,8 @@ ewmh_process_net_window_sync_request_counter(Client *c)
 
 			if (c->sync.alarm) {
 				XPRINTF(c, "allocated alarm 0x%08lx\n", c->sync.alarm);
-				XSaveContext(dpy, c->sync.alarm, context[ClientAny],
-					     (XPointer) c);
-				XSaveContext(dpy, c->sync.alarm, context[ScreenContext],
-					     (XPointer) scr);
+				winmap_save(c->sync.alarm, ClientAny, c);
+				winmap_save(c->sync.alarm, ScreenContext, scr);
 
 			} else
 				XPRINTF(c, "could not allocate alarm!\n");
@@ -3665,88 +3719,410 @@ setopacity(Client *c, unsigned int opacity)
 			PropModeReplace, (unsigned char *) &data, 1L);
 }
 
-Atom *
-getatom(Window win, Atom atom, unsigned long *nitems)
+/*
+ * Property cache.  Properties read from client windows (and user time windows)
+ * are kept on the window's entry in the window table, including the fact that
+ * a property does not exist, so that repeated reads (such as the opacity check
+ * on every redraw) do not go to the server.  PropertyChangeMask is selected on
+ * these windows, and each PropertyNotify passed to propertynotify() drops the
+ * cached copy of that property.  Properties that we set on client windows
+ * ourselves are not cached, because our own changes would otherwise be missed
+ * until their PropertyNotify arrives; nor are large properties such as icons.
+ */
+PropStats propstats = { 0, };
+
+static Bool
+ownprop(Atom prop)
 {
-	int format, status;
-	Atom *ret = NULL;
-	unsigned long extra, num = 64;
-	Atom real;
+	static const int own[] = {
+		WMState, WMDesktop, WindowState, WindowDesk, WindowDeskMask,
+		WindowActions, WindowExtents, WindowFrameStrut, WindowFsMonitors,
+		WindowMoving, WindowResizing, WinWorkspace, WinWorkspaces, WinState,
+		WinLayer, WinMaxGeom, DTWorkspacePresence,
+	};
+	unsigned i;
 
-      try_harder:
-	status = XGetWindowProperty(dpy, win, atom, 0L, num, False, XA_ATOM,
-				    &real, &format, nitems, &extra,
-				    (unsigned char **) &ret);
-	if (status != Success) {
-		*nitems = 0;
-		return NULL;
+	for (i = 0; i < sizeof(own) / sizeof(own[0]); i++)
+		if (atom[own[i]] == prop)
+			return True;
+	return False;
+}
+
+static size_t
+propsize(int format, unsigned long nitems)
+{
+	switch (format) {
+	case 32:
+		return nitems * sizeof(long);
+	case 16:
+		return nitems * sizeof(short);
+	default:
+		return nitems;
 	}
-	if (extra) {
-		num += ((extra + 3) >> 2);
-		extra = 0;
-		if (ret) {
-			XFree(ret);
-			ret = NULL;
+}
+
+static WinEntry *
+propwindow(Window win)
+{
+	WinEntry *e;
+
+	if ((e = winmap_find(win)) && (e->parts & (WINPART(ClientWindow) | WINPART(ClientTimeWindow))))
+		return (e);
+	return (NULL);
+}
+
+void
+forgetprop(Window win, Atom atom)
+{
+	PropEntry *p, **pp;
+	WinEntry *e;
+
+	if (!(e = propwindow(win)))
+		return;
+	for (pp = &e->props; (p = *pp); pp = &p->next) {
+		if (p->atom == atom) {
+			*pp = p->next;
+			free(p);
+			break;
 		}
-		goto try_harder;
 	}
-	/* don't return empty properties */
-	if (*nitems == 0) {
-		if (ret) {
-			XFree(ret);
-			ret = NULL;
-		}
+}
+
+void
+freeprops(WinEntry *e)
+{
+	PropEntry *p;
+
+	while ((p = e->props)) {
+		e->props = p->next;
+		free(p);
 	}
-	return ret;
 }
 
-long *
-getcard(Window win, Atom atom, unsigned long *nitems)
+/*
+ * Prefetching.  Before a window is managed, or all windows at startup, the
+ * properties that manage() reads (and the window attributes and geometry) are
+ * requested for all of the windows at once and the replies collected
+ * afterward, so that managing a window does not wait on one round trip after
+ * another.  The prefetched properties are held here, sorted by window, until
+ * dropprefetched() or endprefetch().  Reads before manage() (such as those
+ * made by scan() to classify windows) and those by manage() itself are all
+ * served from them; getprop() also copies them to the property cache.  Without
+ * XCB, prefetch() only fetches the window attributes.
+ */
+typedef struct {
+	Window win;
+	PropEntry *props;
+} Prefetch;
+
+static struct {
+	Prefetch *list;
+	unsigned count;
+} prefetched;
+
+static int
+cmpprefetch(const void *a, const void *b)
 {
-	int format, status;
-	long *ret = NULL;
-	unsigned long extra, num = 64;
-	Atom real;
+	Window wa = ((const Prefetch *) a)->win, wb = ((const Prefetch *) b)->win;
 
-      try_harder:
-	status = XGetWindowProperty(dpy, win, atom, 0L, num, False, XA_CARDINAL,
-				    &real, &format, nitems, &extra,
-				    (unsigned char **) &ret);
-	if (status != Success) {
-		*nitems = 0;
+	return (wa < wb) ? -1 : (wa > wb);
+}
+
+static Prefetch *
+findprefetched(Window win)
+{
+	Prefetch key = { win, NULL };
+
+	if (!prefetched.count)
 		return NULL;
+	return bsearch(&key, prefetched.list, prefetched.count, sizeof(key), cmpprefetch);
+}
+
+/* returns a copy of a prefetched property, which stays for later reads */
+static PropEntry *
+copyprefetched(Window win, Atom atom)
+{
+	Prefetch *f;
+	PropEntry *p, *q;
+	size_t size;
+
+	if (!(f = findprefetched(win)))
+		return NULL;
+	for (p = f->props; p && p->atom != atom; p = p->next) ;
+	if (!p)
+		return NULL;
+	size = propsize(p->format, p->nitems);
+	q = ecalloc(1, sizeof(*q) + size + 1);
+	memcpy(q, p, sizeof(*q) + size);
+	q->next = NULL;
+	propstats.prefetched++;
+	return q;
+}
+
+/* discard what was prefetched for a window once manage() is done with it */
+void
+dropprefetched(Window win)
+{
+	Prefetch *f;
+	PropEntry *p;
+
+	if (!(f = findprefetched(win)))
+		return;
+	while ((p = f->props)) {
+		f->props = p->next;
+		free(p);
 	}
-	if (extra) {
-		num += ((extra + 3) >> 2);
-		extra = 0;
-		if (ret) {
-			XFree(ret);
-			ret = NULL;
+}
+
+void
+endprefetch(void)
+{
+	unsigned i;
+
+	for (i = 0; i < prefetched.count; i++)
+		dropprefetched(prefetched.list[i].win);
+	free(prefetched.list);
+	prefetched.list = NULL;
+	prefetched.count = 0;
+}
+
+#ifdef XCB
+static Visual *
+findvisual(Screen *s, VisualID id)
+{
+	int i, j;
+
+	for (i = 0; i < s->ndepths; i++)
+		for (j = 0; j < s->depths[i].nvisuals; j++)
+			if (s->depths[i].visuals[j].visualid == id)
+				return s->depths[i].visuals + j;
+	return NULL;
+}
+
+static void
+setattributes(XWindowAttributes *wa, xcb_get_window_attributes_reply_t *ar,
+	      xcb_get_geometry_reply_t *gr)
+{
+	memset(wa, 0, sizeof(*wa));
+	wa->x = gr->x;
+	wa->y = gr->y;
+	wa->width = gr->width;
+	wa->height = gr->height;
+	wa->border_width = gr->border_width;
+	wa->depth = gr->depth;
+	wa->root = gr->root;
+	wa->screen = ScreenOfDisplay(dpy, scr->screen);
+	wa->visual = findvisual(wa->screen, ar->visual);
+	wa->class = ar->_class;
+	wa->bit_gravity = ar->bit_gravity;
+	wa->win_gravity = ar->win_gravity;
+	wa->backing_store = ar->backing_store;
+	wa->backing_planes = ar->backing_planes;
+	wa->backing_pixel = ar->backing_pixel;
+	wa->save_under = ar->save_under;
+	wa->colormap = ar->colormap;
+	wa->map_installed = ar->map_is_installed;
+	wa->map_state = ar->map_state;
+	wa->all_event_masks = ar->all_event_masks;
+	wa->your_event_mask = ar->your_event_mask;
+	wa->do_not_propagate_mask = ar->do_not_propagate_mask;
+	wa->override_redirect = ar->override_redirect;
+}
+
+static PropEntry *
+newprefetched(Atom atom, xcb_get_property_reply_t *r)
+{
+	unsigned long i, n = xcb_get_property_value_length(r);
+	PropEntry *p;
+	size_t size;
+
+	switch (r->format) {
+	case 32:
+		n /= 4;
+		break;
+	case 16:
+		n /= 2;
+		break;
+	}
+	size = propsize(r->format, n);
+	p = ecalloc(1, sizeof(*p) + size + 1);
+	p->atom = atom;
+	p->type = r->type;
+	p->format = r->format;
+	p->nitems = n;
+	if (r->format == 32) {
+		/* Xlib hands format 32 data back as (sign extended) longs */
+		int32_t *v = xcb_get_property_value(r);
+
+		for (i = 0; i < n; i++)
+			p->data[i] = v[i];
+	} else
+		memcpy(p->data, xcb_get_property_value(r), size);
+	return p;
+}
+#endif
+
+void
+prefetch(Window *wins, unsigned n, XWindowAttributes *wa)
+{
+#ifdef XCB
+	static const Atom icccm[] = {
+		XA_WM_HINTS, XA_WM_NORMAL_HINTS, XA_WM_CLASS, XA_WM_NAME,
+		XA_WM_ICON_NAME, XA_WM_TRANSIENT_FOR,
+	};
+	static const int ewmh[] = {
+		WMProto, WMClientLeader, WMWindowRole, SMClientId, WMColormapWindows,
+		WindowName, WindowIconName, WindowType, WindowTypeOverride,
+		WindowState, WindowDesk, WindowDeskMask, WinWorkspace, WinWorkspaces,
+		WinState, WinHints, WinLayer, WinExpandedSize, MWMHints, DTWMHints,
+		DTWorkspaceHints, Strut, StrutPartial, WindowUserTime, UserTimeWindow,
+		WindowOpacity, WindowPid, NetStartupId, WindowCounter,
+		WindowFsMonitors, WindowForSysTray, WMState,
+	};
+	enum { NICCCM = sizeof(icccm) / sizeof(icccm[0]), NATOM = NICCCM + sizeof(ewmh) / sizeof(ewmh[0]) };
+	xcb_connection_t *xc = XGetXCBConnection(dpy);
+	xcb_get_window_attributes_cookie_t *ac = NULL;
+	xcb_get_geometry_cookie_t *gc = NULL;
+	xcb_get_property_cookie_t *pc;
+	Atom list[NATOM];
+	unsigned i, j, k;
+	PropEntry *p;
+
+	endprefetch();
+	for (j = 0; j < NICCCM; j++)
+		list[j] = icccm[j];
+	for (; j < NATOM; j++)
+		list[j] = atom[ewmh[j - NICCCM]];
+	if (wa) {
+		ac = ecalloc(n, sizeof(*ac));
+		gc = ecalloc(n, sizeof(*gc));
+	}
+	pc = ecalloc(n * NATOM, sizeof(*pc));
+	for (i = 0; i < n; i++) {
+		if (!wins[i])
+			continue;
+		if (wa) {
+			ac[i] = xcb_get_window_attributes(xc, wins[i]);
+			gc[i] = xcb_get_geometry(xc, wins[i]);
 		}
-		goto try_harder;
+		for (j = 0; j < NATOM; j++)
+			pc[i * NATOM + j] = xcb_get_property(xc, 0, wins[i], list[j],
+							     XCB_GET_PROPERTY_TYPE_ANY, 0,
+							     PROPCACHE_MAX / 4);
 	}
-	/* don't return empty properties */
-	if (*nitems == 0) {
-		if (ret) {
-			XFree(ret);
-			ret = NULL;
+	prefetched.list = ecalloc(n, sizeof(*prefetched.list));
+	for (i = 0, k = 0; i < n; i++) {
+		xcb_generic_error_t *err = NULL;
+		Prefetch *f;
+
+		if (!wins[i]) {
+			if (wa)
+				memset(wa + i, 0, sizeof(*wa));
+			continue;
+		}
+		if (wa) {
+			xcb_get_window_attributes_reply_t *ar;
+			xcb_get_geometry_reply_t *gr;
+
+			ar = xcb_get_window_attributes_reply(xc, ac[i], &err);
+			free(err);
+			err = NULL;
+			gr = xcb_get_geometry_reply(xc, gc[i], &err);
+			free(err);
+			err = NULL;
+			if (ar && gr)
+				setattributes(wa + i, ar, gr);
+			else
+				memset(wa + i, 0, sizeof(*wa));
+			free(ar);
+			free(gr);
+		}
+		f = prefetched.list + k++;
+		f->win = wins[i];
+		for (j = 0; j < NATOM; j++) {
+			xcb_get_property_reply_t *r;
+
+			r = xcb_get_property_reply(xc, pc[i * NATOM + j], &err);
+			free(err);
+			err = NULL;
+			if (!r)
+				continue;
+			/* leave properties that did not fit to getprop() */
+			if (!r->bytes_after) {
+				p = newprefetched(list[j], r);
+				p->next = f->props;
+				f->props = p;
+			}
+			free(r);
 		}
 	}
-	return ret;
+	prefetched.count = k;
+	qsort(prefetched.list, k, sizeof(*prefetched.list), cmpprefetch);
+	free(pc);
+	free(ac);
+	free(gc);
+#else
+	unsigned i;
+
+	if (wa)
+		for (i = 0; i < n; i++)
+			if (!wins[i] || !XGetWindowAttributes(dpy, wins[i], wa + i))
+				memset(wa + i, 0, sizeof(*wa));
+#endif
 }
 
-Pixmap *
-getpixmaps(Window win, Atom atom, unsigned long *nitems)
+/*
+ * Read a property.  Returns NULL (and no items) when the property does not
+ * exist, is empty, or is not of the requested type (unless AnyPropertyType is
+ * requested).  The actual type is returned in real when given.  The returned
+ * data is a copy when it comes from the cache; either way it is released with
+ * XFree().
+ */
+static void *
+getprop(Window win, Atom atom, Atom type, Atom *real, int *format, unsigned long *nitems)
 {
-	int format, status;
-	Pixmap *ret = NULL;
+	int fmt = 0, status;
+	unsigned char *ret = NULL;
 	unsigned long extra, num = 64;
-	Atom real;
-
+	Atom rtype = None;
+	PropEntry *p = NULL, *own = NULL;
+	WinEntry *e;
+	size_t size;
+
+	*nitems = 0;
+	if (real)
+		*real = None;
+	if ((e = propwindow(win))) {
+		for (p = e->props; p && p->atom != atom; p = p->next) ;
+		if (p)
+			propstats.hits++;
+		else
+			propstats.misses++;
+	}
+	if (!p && (p = own = copyprefetched(win, atom))) {
+		if (e && propsize(p->format, p->nitems) <= PROPCACHE_MAX && !ownprop(atom)) {
+			p->next = e->props;
+			e->props = p;
+			own = NULL;
+		}
+	}
+	if (p) {
+		if (real)
+			*real = p->type;
+		if (format)
+			*format = p->format;
+		if ((type == AnyPropertyType || p->type == type) && p->nitems) {
+			size = propsize(p->format, p->nitems);
+			ret = ecalloc(1, size + 1);
+			memcpy(ret, p->data, size);
+			*nitems = p->nitems;
+		}
+		free(own);
+		return ret;
+	}
       try_harder:
-	status = XGetWindowProperty(dpy, win, atom, 0L, num, False, XA_PIXMAP,
-				    &real, &format, nitems, &extra,
-				    (unsigned char **) &ret);
+	status = XGetWindowProperty(dpy, win, atom, 0L, num, False, AnyPropertyType,
+				    &rtype, &fmt, nitems, &extra, &ret);
 	if (status != Success) {
 		*nitems = 0;
 		return NULL;
@@ -3760,8 +4136,25 @@ getpixmaps(Window win, Atom atom, unsigned long *nitems)
 		}
 		goto try_harder;
 	}
-	/* don't return empty properties */
-	if (*nitems == 0) {
+	size = propsize(fmt, *nitems);
+	if (e && size <= PROPCACHE_MAX && !ownprop(atom)) {
+		p = ecalloc(1, sizeof(*p) + size + 1);
+		p->atom = atom;
+		p->type = rtype;
+		p->format = fmt;
+		p->nitems = *nitems;
+		if (size)
+			memcpy(p->data, ret, size);
+		p->next = e->props;
+		e->props = p;
+	}
+	if (real)
+		*real = rtype;
+	if (format)
+		*format = fmt;
+	/* don't return empty properties or properties of another type */
+	if (*nitems == 0 || (type != AnyPropertyType && rtype != type)) {
+		*nitems = 0;
 		if (ret) {
 			XFree(ret);
 			ret = NULL;
@@ -3770,65 +4163,177 @@ getpixmaps(Window win, Atom atom, unsigned long *nitems)
 	return ret;
 }
 
+void *
+getproperty(Window win, Atom atom, Atom *type, int *format, unsigned long *nitems)
+{
+	return getprop(win, atom, AnyPropertyType, type, format, nitems);
+}
+
+Atom *
+getatom(Window win, Atom atom, unsigned long *nitems)
+{
+	return getprop(win, atom, XA_ATOM, NULL, NULL, nitems);
+}
+
+long *
+getcard(Window win, Atom atom, unsigned long *nitems)
+{
+	return getprop(win, atom, XA_CARDINAL, NULL, NULL, nitems);
+}
+
+Pixmap *
+getpixmaps(Window win, Atom atom, unsigned long *nitems)
+{
+	return getprop(win, atom, XA_PIXMAP, NULL, NULL, nitems);
+}
+
 Window *
 getwind(Window win, Atom atom, unsigned long *nitems)
 {
-	int format, status;
-	Window *ret = NULL;
-	unsigned long extra, num = 64;
-	Atom real;
+	return getprop(win, atom, XA_WINDOW, NULL, NULL, nitems);
+}
 
-      try_harder:
-	status = XGetWindowProperty(dpy, win, atom, 0L, num, False, XA_WINDOW,
-				    &real, &format, nitems, &extra,
-				    (unsigned char **) &ret);
-	if (status != Success) {
-		*nitems = 0;
+long *
+gethints(Window win, Atom atom, unsigned long *nitems)
+{
+	return getprop(win, atom, XA_WM_SIZE_HINTS, NULL, NULL, nitems);
+}
+
+/*
+ * ICCCM properties, read through getprop() rather than with Xlib's own
+ * helpers so that they come from the cache or a prefetch where possible.
+ * These decode the properties as XGetTransientForHint(), XGetWMHints(),
+ * XGetWMNormalHints(), XGetClassHint() and XGetTextProperty() do.
+ */
+
+/* element counts of WM_HINTS and WM_NORMAL_HINTS (from Xlib's Xatomtype.h) */
+#ifndef NumPropWMHintsElements
+#define NumPropWMHintsElements	9
+#endif
+#ifndef NumPropSizeElements
+#define NumPropSizeElements	18
+#endif
+#ifndef OldNumPropSizeElements
+#define OldNumPropSizeElements	15
+#endif
+
+Bool
+gettransientfor(Window win, Window *trans)
+{
+	Window *w;
+	unsigned long n = 0;
+
+	*trans = None;
+	if (!(w = getwind(win, XA_WM_TRANSIENT_FOR, &n)))
+		return False;
+	*trans = w[0];
+	XFree(w);
+	return True;
+}
+
+XWMHints *
+getwmhints(Window win)
+{
+	XWMHints *wmh;
+	long *prop;
+	unsigned long n = 0;
+	int format = 0;
+
+	if (!(prop = getprop(win, XA_WM_HINTS, XA_WM_HINTS, NULL, &format, &n)))
+		return NULL;
+	if (format != 32 || n < NumPropWMHintsElements - 1) {
+		XFree(prop);
 		return NULL;
 	}
-	if (extra) {
-		num += ((extra + 3) >> 2);
-		extra = 0;
-		if (ret) {
-			XFree(ret);
-			ret = NULL;
-		}
-		goto try_harder;
-	}
-	/* don't return empty properties */
-	if (*nitems == 0) {
-		if (ret) {
-			XFree(ret);
-			ret = NULL;
-		}
+	if ((wmh = XAllocWMHints())) {
+		wmh->flags = prop[0];
+		wmh->input = prop[1] ? True : False;
+		wmh->initial_state = prop[2];
+		wmh->icon_pixmap = prop[3];
+		wmh->icon_window = prop[4];
+		wmh->icon_x = prop[5];
+		wmh->icon_y = prop[6];
+		wmh->icon_mask = prop[7];
+		wmh->window_group = (n >= NumPropWMHintsElements) ? prop[8] : None;
 	}
-	return ret;
+	XFree(prop);
+	return wmh;
 }
 
-long *
-gethints(Window win, Atom atom, unsigned long *nitems)
+Bool
+getwmnormalhints(Window win, XSizeHints *sh, long *supplied)
 {
-	int format, status;
-	long *ret = NULL;
-	unsigned long extra;
-	Atom real;
+	long *prop;
+	unsigned long n = 0;
+	int format = 0;
 
-	status = XGetWindowProperty(dpy, win, atom, 0L, 64L, False, XA_WM_SIZE_HINTS,
-				    &real, &format, nitems, &extra,
-				    (unsigned char **) &ret);
-	if (status != Success) {
-		*nitems = 0;
-		return NULL;
+	if (!(prop = getprop(win, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, NULL, &format, &n)))
+		return False;
+	if (format != 32 || n < OldNumPropSizeElements) {
+		XFree(prop);
+		return False;
 	}
-	XPRINTF("Format of WM_SIZE_HINTS is %d\n", format);
-	/* don't return empty properties */
-	if (*nitems == 0) {
-		if (ret) {
-			XFree(ret);
-			ret = NULL;
-		}
+	sh->flags = prop[0];
+	sh->x = prop[1];
+	sh->y = prop[2];
+	sh->width = prop[3];
+	sh->height = prop[4];
+	sh->min_width = prop[5];
+	sh->min_height = prop[6];
+	sh->max_width = prop[7];
+	sh->max_height = prop[8];
+	sh->width_inc = prop[9];
+	sh->height_inc = prop[10];
+	sh->min_aspect.x = prop[11];
+	sh->min_aspect.y = prop[12];
+	sh->max_aspect.x = prop[13];
+	sh->max_aspect.y = prop[14];
+	*supplied = (USPosition | USSize | PAllHints);
+	if (n >= NumPropSizeElements) {
+		*supplied |= (PBaseSize | PWinGravity);
+		sh->base_width = prop[15];
+		sh->base_height = prop[16];
+		sh->win_gravity = prop[17];
 	}
-	return ret;
+	sh->flags &= *supplied;
+	XFree(prop);
+	return True;
+}
+
+Bool
+getwmclass(Window win, XClassHint *ch)
+{
+	char *prop;
+	unsigned long n = 0;
+	size_t len;
+	int format = 0;
+
+	if (!(prop = getprop(win, XA_WM_CLASS, XA_STRING, NULL, &format, &n)))
+		return False;
+	if (format != 8) {
+		XFree(prop);
+		return False;
+	}
+	/* the data is always followed by a nul */
+	len = strnlen(prop, n);
+	ch->res_name = strndup(prop, len);
+	ch->res_class = (len + 1 < n) ? strndup(prop + len + 1, n - len - 1) : strdup("");
+	XFree(prop);
+	return True;
+}
+
+Bool
+gettextproperty(Window win, Atom atom, XTextProperty *tp)
+{
+	unsigned long n = 0;
+	Atom type = None;
+	int format = 0;
+
+	tp->value = getprop(win, atom, AnyPropertyType, &type, &format, &n);
+	tp->encoding = type;
+	tp->format = format;
+	tp->nitems = n;
+	return (type != None);
 }
 
 pid_t
@@ -3861,8 +4366,8 @@ getgrpclasshint(Client *c, XClassHint *ch)
 
 	/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_CLASS hints they find on
 	   icon windows. */
-	if (((win = c->leader) && XGetClassHint(dpy, win, ch)) ||
-	    ((win = c->win)    && XGetClassHint(dpy, win, ch)))
+	if (((win = c->leader) && getwmclass(win, ch)) ||
+	    ((win = c->win)    && getwmclass(win, ch)))
 		return True;
 	return False;
 }
@@ -3874,8 +4379,8 @@ getclasshint(Client *c, XClassHint *ch)
 
 	/* ICCCM 2.0/4.1.9: Window managers will ignore any WM_CLASS properties
 	   they find on icon windows. */
-	if (((win = c->win)    && XGetClassHint(dpy, win, ch)) ||
-	    ((win = c->leader) && XGetClassHint(dpy, win, ch)))
+	if (((win = c->win)    && getwmclass(win, ch)) ||
+	    ((win = c->leader) && getwmclass(win, ch)))
 		return True;
 	return False;
 }
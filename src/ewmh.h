@@ -3,6 +3,7 @@
 
 /* ewmh.c */
 extern Bool adding_client;
+extern unsigned long pending_states;
 Bool checkatom(Window win, Atom bigatom, Atom smallatom);
 unsigned getwintype(Window win);
 Bool checkwintype(Window win, int wintype);
@@ -13,6 +14,17 @@ long *getcard(Window win, Atom atom, unsigned long *nitems);
 Pixmap *getpixmaps(Window win, Atom atom, unsigned long *nitems);
 Window *getwind(Window win, Atom atom, unsigned long *nitems);
 long *gethints(Window win, Atom atom, unsigned long *nitems);
+void *getproperty(Window win, Atom atom, Atom *type, int *format, unsigned long *nitems);
+Bool gettransientfor(Window win, Window *trans);
+XWMHints *getwmhints(Window win);
+Bool getwmnormalhints(Window win, XSizeHints *sh, long *supplied);
+Bool getwmclass(Window win, XClassHint *ch);
+Bool gettextproperty(Window win, Atom atom, XTextProperty *tp);
+void prefetch(Window *wins, unsigned n, XWindowAttributes *wa);
+void dropprefetched(Window win);
+void endprefetch(void);
+void forgetprop(Window win, Atom atom);
+void freeprops(WinEntry *e);
 void initewmh(char *name);
 void exitewmh(WithdrawCause cause);
 void ewmh_add_client(Client *c);
@@ -39,6 +51,7 @@ void ewmh_update_net_active_window(void);
 void ewmh_update_net_client_list_stacking(void);
 void ewmh_update_net_client_lists(void);
 void ewmh_update_net_client_list(void);
+void ewmh_flush_net_client_lists(void);
 void ewmh_update_net_current_desktop(void);
 void ewmh_update_net_desktop_geometry(void);
 void ewmh_update_net_desktop_layout(void);
@@ -71,6 +84,7 @@ void ewmh_update_net_window_desktop(Client *);
 void ewmh_update_net_window_extents(Client *);
 void ewmh_update_net_window_fs_monitors(Client *);
 void ewmh_update_net_window_state(Client *);
+void ewmh_flush_net_window_state(Client *);
 void ewmh_update_net_window_visible_icon_name(Client *);
 void ewmh_update_net_window_visible_name(Client *);
 void wmh_process_win_window_hints(Client *);
@@ -17,6 +17,8 @@ char **exts = NULL;
 typedef struct IconDirectory IconDirectory;
 typedef struct IconTheme IconTheme;
 typedef struct IconThemeName IconThemeName;
+typedef struct IconFile IconFile;
+typedef struct IconEntry IconEntry;
 
 struct IconDirectory {
 	IconTheme *theme;
@@ -31,6 +33,32 @@ struct IconDirectory {
 	int threshold;
 };
 
+/*
+ * Icon lookups are served from an index of the files found in each theme
+ * subdirectory (and in the fallback directories), built once per scan by
+ * reading each directory at most once.  Files are kept in search order, so a
+ * lookup is a hash probe that yields the same file the search through the
+ * directories would have found.
+ */
+struct IconFile {
+	IconFile *next;			/* next file with the same name, in search order */
+	IconDirectory *dir;		/* theme subdirectory (NULL for fallback directories) */
+	unsigned order;			/* position in the search order */
+	char *path;
+};
+
+struct IconEntry {
+	IconEntry *next;		/* next entry in the hash bucket */
+	char *name;			/* file name without extension */
+	IconFile *files;
+};
+
+typedef struct {
+	IconEntry **buckets;
+	unsigned bits;
+	unsigned count;
+} IconIndex;
+
 struct IconTheme {
 	IconTheme *next;
 	char *name;
@@ -39,6 +67,7 @@ struct IconTheme {
 	char *dnames;
 	char *snames;
 	IconDirectory *dirs;
+	IconIndex index;
 };
 
 struct IconThemeName {
@@ -49,6 +78,8 @@ struct IconThemeName {
 IconTheme *themes = NULL;
 IconThemeName *themenames = NULL;
 
+static IconIndex fallback;		/* icons in the fallback directories */
+
 void
 pushthemename(const char *name)
 {
@@ -86,6 +117,401 @@ freestringlist(char **list)
 	return (NULL);
 }
 
+static unsigned
+iconhash(const char *name, unsigned bits)
+{
+	unsigned h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (unsigned char) *name++) * 16777619U;
+	return (h & ((1U << bits) - 1));
+}
+
+static IconEntry *
+findiconentry(IconIndex *ix, const char *name)
+{
+	IconEntry *e;
+
+	if (!ix->buckets)
+		return (NULL);
+	for (e = ix->buckets[iconhash(name, ix->bits)]; e; e = e->next)
+		if (!strcmp(e->name, name))
+			return (e);
+	return (NULL);
+}
+
+static void
+growiconindex(IconIndex *ix)
+{
+	IconEntry **old = ix->buckets, *e, *next;
+	unsigned i, n = ix->buckets ? (1U << ix->bits) : 0;
+
+	ix->bits = ix->buckets ? ix->bits + 1 : 8;
+	ix->buckets = ecalloc(1U << ix->bits, sizeof(*ix->buckets));
+	for (i = 0; i < n; i++) {
+		for (e = old[i]; e; e = next) {
+			unsigned h = iconhash(e->name, ix->bits);
+
+			next = e->next;
+			e->next = ix->buckets[h];
+			ix->buckets[h] = e;
+		}
+	}
+	free(old);
+}
+
+static void
+addiconfile(IconIndex *ix, const char *name, size_t len, IconDirectory *dir,
+	    unsigned order, const char *path)
+{
+	IconEntry *e;
+	IconFile *f, **pf;
+	char *key = strndup(name, len);
+
+	if (!(e = findiconentry(ix, key))) {
+		unsigned h;
+
+		if (!ix->buckets || ix->count >= (1U << ix->bits))
+			growiconindex(ix);
+		h = iconhash(key, ix->bits);
+		e = ecalloc(1, sizeof(*e));
+		e->name = key;
+		e->next = ix->buckets[h];
+		ix->buckets[h] = e;
+		ix->count++;
+	} else
+		free(key);
+	f = ecalloc(1, sizeof(*f));
+	f->dir = dir;
+	f->order = order;
+	f->path = strdup(path);
+	for (pf = &e->files; *pf && (*pf)->order <= order; pf = &(*pf)->next) ;
+	f->next = *pf;
+	*pf = f;
+}
+
+static void
+freeiconindex(IconIndex *ix)
+{
+	IconEntry *e;
+	IconFile *f;
+	unsigned i;
+
+	for (i = 0; ix->buckets && i < (1U << ix->bits); i++) {
+		while ((e = ix->buckets[i])) {
+			ix->buckets[i] = e->next;
+			while ((f = e->files)) {
+				e->files = f->next;
+				free(f->path);
+				free(f);
+			}
+			free(e->name);
+			free(e);
+		}
+	}
+	free(ix->buckets);
+	ix->buckets = NULL;
+	ix->bits = 0;
+	ix->count = 0;
+}
+
+/*
+ * Files of an icon name and of its lower-cased form (the searches also try
+ * the lower-cased file name).
+ */
+static void
+geticonfiles(IconIndex *ix, const char *iconname, IconFile **files)
+{
+	IconEntry *e;
+	char *lower, *p;
+
+	files[0] = (e = findiconentry(ix, iconname)) ? e->files : NULL;
+	files[1] = NULL;
+	lower = strdup(iconname);
+	for (p = lower; *p; p++)
+		*p = tolower(*p);
+	if (strcmp(lower, iconname) && (e = findiconentry(ix, lower)))
+		files[1] = e->files;
+	free(lower);
+}
+
+/*
+ * The file names of indexed directories are kept in a cache file under the
+ * XDG cache directory, so that a directory whose modification time has not
+ * changed is not read again.  The file is mapped read-only while scanning:
+ *
+ *   "ADWMICN1" count
+ *   count * { size nfiles sec nsec path\0 name\0... } each padded to 8 bytes
+ */
+#define ICONCACHE_MAGIC "ADWMICN1"
+
+typedef struct {
+	uint32_t size;			/* bytes in this record */
+	uint32_t nfiles;		/* file names after the path */
+	int64_t sec, nsec;		/* modification time of the directory */
+} IconCacheRecord;
+
+typedef struct {
+	char *path;
+	struct timespec mtime;
+	char **files;			/* NULL terminated */
+	Bool owned;			/* strings allocated rather than mapped */
+	Bool used;			/* directory was indexed in this scan */
+} IconCacheDir;
+
+static struct {
+	char *file;
+	void *map;
+	size_t len;
+	IconCacheDir *dirs;		/* sorted by path: loaded first, read after */
+	unsigned loaded, count;
+	Bool dirty;
+	unsigned hits, reads;
+} iconcache;
+
+static int
+cmpcachedir(const void *a, const void *b)
+{
+	return strcmp(((const IconCacheDir *) a)->path, ((const IconCacheDir *) b)->path);
+}
+
+static void
+loadiconcache(void)
+{
+	const char *p, *end, *q;
+	struct stat st;
+	uint32_t count, i, j;
+	int fd;
+
+	iconcache.dirty = False;
+	iconcache.hits = iconcache.reads = 0;
+	if (!xdgdirs.cach)
+		return;
+	free(iconcache.file);
+	iconcache.file = ecalloc(strlen(xdgdirs.cach) + strlen("/" NAME "/icons.cache") + 1, 1);
+	strcpy(iconcache.file, xdgdirs.cach);
+	strcat(iconcache.file, "/" NAME "/icons.cache");
+	if ((fd = open(iconcache.file, O_RDONLY)) < 0)
+		return;
+	if (fstat(fd, &st) || (size_t) st.st_size < 16) {
+		close(fd);
+		return;
+	}
+	iconcache.len = st.st_size;
+	iconcache.map = mmap(NULL, iconcache.len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (iconcache.map == MAP_FAILED) {
+		iconcache.map = NULL;
+		return;
+	}
+	p = iconcache.map;
+	end = p + iconcache.len;
+	if (memcmp(p, ICONCACHE_MAGIC, 8))
+		goto bad;
+	memcpy(&count, p + 8, sizeof(count));
+	p += 16;
+	/* every record holds at least its header: do not trust count further */
+	if (count > (size_t) (end - p) / sizeof(IconCacheRecord))
+		goto bad;
+	iconcache.dirs = ecalloc(count + 1, sizeof(*iconcache.dirs));
+	for (i = 0; i < count; i++) {
+		IconCacheRecord rec;
+		IconCacheDir *d = &iconcache.dirs[i];
+
+		if (end - p < (ptrdiff_t) sizeof(rec))
+			goto bad;
+		memcpy(&rec, p, sizeof(rec));
+		if (rec.size < sizeof(rec) || (size_t) (end - p) < rec.size || rec.size & 7)
+			goto bad;
+		/* the path and each file name take at least their terminator */
+		if (rec.nfiles >= rec.size - sizeof(rec))
+			goto bad;
+		q = p + sizeof(rec);
+		end = p + rec.size;
+		d->path = (char *) q;
+		d->mtime.tv_sec = rec.sec;
+		d->mtime.tv_nsec = rec.nsec;
+		d->files = ecalloc(rec.nfiles + 1, sizeof(*d->files));
+		iconcache.loaded = i + 1;
+		for (j = 0; j <= rec.nfiles; j++) {
+			const char *z = memchr(q, '\0', end - q);
+
+			if (!z)
+				goto bad;
+			if (j)
+				d->files[j - 1] = (char *) q;
+			q = z + 1;
+		}
+		p = end;
+		end = (const char *) iconcache.map + iconcache.len;
+	}
+	if (p != end)
+		goto bad;
+	iconcache.count = iconcache.loaded;
+	return;
+      bad:
+	/* directories are read again and the cache rewritten */
+	EPRINTF("discarding corrupt icon cache %s\n", iconcache.file);
+	iconcache.dirty = True;
+	for (i = 0; i < iconcache.loaded; i++)
+		free(iconcache.dirs[i].files);
+	free(iconcache.dirs);
+	iconcache.dirs = NULL;
+	iconcache.loaded = iconcache.count = 0;
+	munmap(iconcache.map, iconcache.len);
+	iconcache.map = NULL;
+}
+
+static void
+saveiconcache(void)
+{
+	static const char zeros[8] = { 0, };
+	char *tmp, **f;
+	uint32_t count = 0;
+	unsigned i;
+	FILE *file;
+	char *slash;
+
+	if (!iconcache.file)
+		return;
+	for (i = 0; i < iconcache.count; i++)
+		if (iconcache.dirs[i].used)
+			count++;
+		else
+			iconcache.dirty = True;
+	if (!iconcache.dirty)
+		return;
+	qsort(iconcache.dirs, iconcache.count, sizeof(*iconcache.dirs), cmpcachedir);
+	if ((slash = strrchr(iconcache.file, '/'))) {
+		*slash = '\0';
+		mkdir(iconcache.file, 0755);
+		*slash = '/';
+	}
+	tmp = ecalloc(strlen(iconcache.file) + 5, 1);
+	strcpy(tmp, iconcache.file);
+	strcat(tmp, ".new");
+	if (!(file = fopen(tmp, "w"))) {
+		EPRINTF("%s: %s\n", tmp, strerror(errno));
+		free(tmp);
+		return;
+	}
+	fwrite(ICONCACHE_MAGIC, 8, 1, file);
+	fwrite(&count, sizeof(count), 1, file);
+	fwrite(zeros, 4, 1, file);
+	for (i = 0; i < iconcache.count; i++) {
+		IconCacheDir *d = &iconcache.dirs[i];
+		IconCacheRecord rec = { 0, };
+
+		if (!d->used)
+			continue;
+		rec.size = sizeof(rec) + strlen(d->path) + 1;
+		for (f = d->files; *f; f++, rec.nfiles++)
+			rec.size += strlen(*f) + 1;
+		rec.size = (rec.size + 7) & ~7U;
+		rec.sec = d->mtime.tv_sec;
+		rec.nsec = d->mtime.tv_nsec;
+		fwrite(&rec, sizeof(rec), 1, file);
+		fwrite(d->path, strlen(d->path) + 1, 1, file);
+		for (f = d->files; *f; f++)
+			fwrite(*f, strlen(*f) + 1, 1, file);
+		fwrite(zeros, (8 - ftell(file) % 8) % 8, 1, file);
+	}
+	if (fclose(file) || rename(tmp, iconcache.file))
+		EPRINTF("%s: %s\n", iconcache.file, strerror(errno));
+	free(tmp);
+}
+
+static void
+freeiconcache(void)
+{
+	unsigned i;
+	char **f;
+
+	for (i = 0; i < iconcache.count; i++) {
+		IconCacheDir *d = &iconcache.dirs[i];
+
+		if (d->owned) {
+			for (f = d->files; *f; f++)
+				free(*f);
+			free(d->path);
+		}
+		free(d->files);
+	}
+	free(iconcache.dirs);
+	iconcache.dirs = NULL;
+	iconcache.loaded = iconcache.count = 0;
+	if (iconcache.map)
+		munmap(iconcache.map, iconcache.len);
+	iconcache.map = NULL;
+}
+
+/* File names in a directory, from the cache when the directory is unchanged. */
+static char **
+listicondir(const char *path)
+{
+	IconCacheDir key = { .path = (char *) path, }, *d;
+	struct stat st;
+	DIR *dir;
+	struct dirent *ent;
+	unsigned n = 0;
+
+	if (stat(path, &st) || !S_ISDIR(st.st_mode))
+		return (NULL);
+	if ((d = bsearch(&key, iconcache.dirs, iconcache.loaded, sizeof(*d), cmpcachedir)) &&
+	    d->mtime.tv_sec == st.st_mtim.tv_sec && d->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+		d->used = True;
+		iconcache.hits++;
+		return (d->files);
+	}
+	if (d)
+		d->used = False;	/* stale: dropped when the cache is saved */
+	if (!(dir = opendir(path)))
+		return (NULL);
+	iconcache.dirs = erealloc(iconcache.dirs, (iconcache.count + 1) * sizeof(*d));
+	d = &iconcache.dirs[iconcache.count++];
+	d->path = strdup(path);
+	d->mtime = st.st_mtim;
+	d->files = ecalloc(1, sizeof(*d->files));
+	d->owned = True;
+	d->used = True;
+	while ((ent = readdir(dir))) {
+		if (ent->d_type != DT_REG && ent->d_type != DT_LNK && ent->d_type != DT_UNKNOWN)
+			continue;
+		if (ent->d_name[0] == '.' || !strchr(ent->d_name, '.'))
+			continue;
+		d->files = erealloc(d->files, (n + 2) * sizeof(*d->files));
+		d->files[n++] = strdup(ent->d_name);
+		d->files[n] = NULL;
+	}
+	closedir(dir);
+	iconcache.reads++;
+	iconcache.dirty = True;
+	return (d->files);
+}
+
+/* Add the files of a directory with one of the extensions to an index. */
+static void
+indexicondir(IconIndex *ix, const char *path, IconDirectory *dir, unsigned order)
+{
+	char **files, **f, **ext, *dot;
+	char buf[PATH_MAX + 1] = { 0, };
+	unsigned k;
+
+	if (!(files = listicondir(path)))
+		return;
+	for (f = files; *f; f++) {
+		if (!(dot = strrchr(*f, '.')))
+			continue;
+		for (k = 0, ext = exts; ext && *ext; ext++, k++)
+			if (!strcmp(dot + 1, *ext))
+				break;
+		if (!ext || !*ext)
+			continue;
+		snprintf(buf, sizeof(buf), "%s/%s", path, *f);
+		addiconfile(ix, *f, dot - *f, dir, order + k, buf);
+	}
+}
+
 static char *
 _FindAnyIconHelper(char **files, const char *iconname, int size, const char *ext)
 {
@@ -373,51 +799,34 @@ DirectorySizeDistance(IconDirectory *subdir, int iconsize)
 static char *
 _LookupIcon(const char *iconname, int size, IconTheme *theme, const char **fexts)
 {
-	IconDirectory *id;
-	char **ext, **xdg, *p;
-	char buf[PATH_MAX + 1] = { 0, };
-
-	if (!fexts)
-		fexts = (const char **) exts;
-	for (id = theme->dirs; id; id = id->next) {
-		if (DirectoryMatchesSize(id, size)) {
-			for (xdg = xdgs; xdg && *xdg; xdg++) {
-				for (ext = exts; ext && *ext; ext++) {
-					snprintf(buf, sizeof(buf), "%s/%s/%s/%s.%s", *xdg, theme->name, id->subdir, iconname, *ext);
-					if (!access(buf, R_OK))
-						return (strdup(buf));
-					/* try lower-casing the file name */
-					for (p = strrchr(buf, '/'); p && *p; p++)
-						*p = tolower(*p);
-					if (!access(buf, R_OK))
-						return (strdup(buf));
-				}
+	IconFile *files[2], *f, *best = NULL;
+	unsigned rank, best_rank = -1U;
+	int i, dist, minimal_size = 0x7fffffff;
+
+	(void) fexts;		/* the index holds the configured extensions */
+	geticonfiles(&theme->index, iconname, files);
+	/* lower-cased names rank after the exact name in the same place */
+	for (i = 0; i < 2; i++)
+		for (f = files[i]; f; f = f->next)
+			if ((rank = f->order * 2 + i) < best_rank && DirectoryMatchesSize(f->dir, size)) {
+				best = f;
+				best_rank = rank;
 			}
-		}
-	}
-	int minimal_size = 0x7fffffff, dist, missing;
-	char *closest = NULL;
-
-	for (id = theme->dirs; id; id = id->next) {
-		for (xdg = xdgs; xdg && *xdg; xdg++) {
-			for (ext = exts; ext && *ext; ext++) {
-				snprintf(buf, sizeof(buf), "%s/%s/%s/%s.%s", *xdg, theme->name, id->subdir, iconname, *ext);
-				if ((missing = access(buf, R_OK))) {
-					/* try lower-casing the file name */
-					for (p = strrchr(buf, '/'); p && *p; p++)
-						*p = tolower(*p);
-					missing = access(buf, R_OK);
-				}
-				if (!missing && (dist = DirectorySizeDistance(id, size)) < minimal_size) {
-					free(closest);
-					closest = strdup(buf);
-					minimal_size = dist;
-				}
+	if (best)
+		return (strdup(best->path));
+	for (i = 0; i < 2; i++) {
+		for (f = files[i]; f; f = f->next) {
+			rank = f->order * 2 + i;
+			dist = DirectorySizeDistance(f->dir, size);
+			if (dist < minimal_size || (dist == minimal_size && rank < best_rank)) {
+				best = f;
+				best_rank = rank;
+				minimal_size = dist;
 			}
 		}
 	}
-	if (closest)
-		return (closest);
+	if (best)
+		return (strdup(best->path));
 	return (NULL);
 }
 
@@ -446,23 +855,19 @@ _FindBestIconHelper(const char **iconlist, int size, const char *name, const cha
 static char *
 _LookupFallbackIcon(const char *iconname, const char **fexts)
 {
-	char **dir, **ext, *p;
-	char buf[PATH_MAX + 1] = { 0, };
-
-	if (!fexts)
-		fexts = (const char **) exts;
-	for (dir = dirs; dir && *dir; dir++) {
-		for (ext = exts; ext && *ext; ext++) {
-			snprintf(buf, sizeof(buf), "%s/%s.%s", *dir, iconname, *ext);
-			if (!access(buf, R_OK))
-				return strdup(buf);
-			/* try lower-casing the file name */
-			for (p = strrchr(buf, '/'); p && *p; p++)
-				*p = tolower(*p);
-			if (!access(buf, R_OK))
-				return strdup(buf);
+	IconFile *files[2], *best = NULL;
+	unsigned rank, best_rank = -1U;
+	int i;
+
+	(void) fexts;		/* the index holds the configured extensions */
+	geticonfiles(&fallback, iconname, files);
+	for (i = 0; i < 2; i++)
+		if (files[i] && (rank = files[i]->order * 2 + i) < best_rank) {
+			best = files[i];
+			best_rank = rank;
 		}
-	}
+	if (best)
+		return strdup(best->path);
 	return (NULL);
 }
 
@@ -555,6 +960,7 @@ freeicontheme(IconTheme *it)
 	free(it->inherits);
 	free(it->dnames);
 	free(it->snames);
+	freeiconindex(&it->index);
 	free(it);
 }
 
@@ -796,6 +1202,42 @@ newicontheme(const char *name, const char *path)
 	return (NULL);
 }
 
+/*
+ * Index the subdirectories of all themes under every XDG icon directory and
+ * the fallback directories.  The order of a file follows the search order:
+ * theme subdirectory, then XDG directory, then extension.
+ */
+static void
+indexicons(void)
+{
+	IconTheme *it;
+	IconDirectory *id;
+	char **xdg, **dir;
+	char buf[PATH_MAX + 1] = { 0, };
+	unsigned nexts = 0, order = 0, n = 0;
+
+	for (dir = exts; dir && *dir; dir++, nexts++) ;
+	loadiconcache();
+	for (it = themes; it; it = it->next) {
+		freeiconindex(&it->index);
+		for (order = 0, id = it->dirs; id; id = id->next) {
+			for (xdg = xdgs; xdg && *xdg; xdg++, order += nexts) {
+				snprintf(buf, sizeof(buf), "%s/%s/%s", *xdg, it->name, id->subdir);
+				indexicondir(&it->index, buf, id, order);
+			}
+		}
+		n += it->index.count;
+	}
+	freeiconindex(&fallback);
+	for (order = 0, dir = dirs; dir && *dir; dir++, order += nexts)
+		indexicondir(&fallback, *dir, NULL, order);
+	n += fallback.count;
+	OPRINTF("indexed %u icon names: %u directories cached, %u read\n", n,
+		iconcache.hits, iconcache.reads);
+	saveiconcache();
+	freeiconcache();
+}
+
 static void
 rescanicons(void)
 {
@@ -826,6 +1268,7 @@ rescanicons(void)
 		}
 		free(name);
 	}
+	indexicons();
 }
 
 static Bool
@@ -268,436 +268,227 @@ png_read_file_to_ximage(Display *display, Visual *visual, const char *file)
 }
 #endif
 
-XImage *
-dn_scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitmap)
+/*
+ * Scaling is separable: a horizontal pass into 8.8 fixed-point rows followed
+ * by a vertical pass, with integer weights in 1.14 fixed point that sum
+ * exactly to one for every destination pixel.  An axis that shrinks uses an
+ * area-averaging (box) filter: each destination pixel is the average of the
+ * source pixels under its footprint, weighted by overlap.  An axis that grows
+ * interpolates linearly between the two nearest source pixels (so that both
+ * growing gives bilinear filtering), since a box filter would just replicate
+ * pixels.  Colors are averaged premultiplied by alpha so that transparent
+ * pixels do not bleed into the edges of icons.
+ */
+#define SCALE_BITS	14
+#define SCALE_ONE	(1U << SCALE_BITS)
+
+typedef struct {
+	unsigned *first;		/* first source pixel of each destination pixel */
+	unsigned *count;		/* source pixels under each destination pixel */
+	unsigned *offset;		/* index of the first weight of each destination pixel */
+	uint16_t *weight;		/* overlap weights in 1.14 fixed point */
+} ScaleAxis;
+
+static void
+free_scale_axis(ScaleAxis *ax)
 {
-	XImage *xscale = NULL;
-	size_t elements = nw * nh;
-	double *counts = NULL;
-	double *colors = NULL;
-
-	if (!(xscale = XCreateImage(dpy, ds->visual, 32, ZPixmap, 0, NULL, nw, nh, 8, 0))) {
-		EPRINTF("could not create ximage\n");
-		goto error;
-	}
-	if (!(xscale->data = calloc(xscale->bytes_per_line, xscale->height))) {
-		EPRINTF("could not allocate ximage data\n");
-		goto error;
-	}
-	if (!(counts = ecalloc(elements, sizeof(*counts)))) {
-		EPRINTF("could not allocate %zu counts\n", elements);
-		goto error;
-	}
-	if (!(colors = ecalloc(elements, sizeof(*colors) << 2))) {
-		EPRINTF("could not allocate %zu colors\n", elements<<2);
-		goto error;
-	}
-
-	unsigned w = ximage->width;
-	unsigned h = ximage->height;
-	unsigned i, j, k, l, m, n;
-
-	double pppx = (double) nw / (double) w;
-	double pppy = (double) nh / (double) h;
-
-	double ty, by, lx, rx, xf, yf, ff;
-
-	unsigned long A, R, G, B, pixel;
-
-	XPRINTF("downscaling image %ux%ux%u to %ux%ux%u\n",
-			ximage->width, ximage->height, ximage->depth,
-			xscale->width, xscale->height, xscale->depth);
+	free(ax->first);
+	free(ax->weight);
+}
 
-	for (ty = 0.0, by = pppy, l = 0; l < h; l++, ty = by, by = (l + 1) * pppy) {
-
-		for (j = floor(ty); j < by; j++) {
-
-			if (ty < (j + 1) && (j + 1) < by) yf = (j + 1) - ty;
-			else if (ty < j && j < by) yf = by - j;
-			else yf = 1.0;
-
-			for (lx = 0.0, rx = pppx, k = 0; k < w; k++, lx = rx, rx = (k + 1) * pppx) {
-
-				for (i = floor(lx); i < rx; i++) {
-
-					if (lx < (i + 1) && (i + 1) < rx) xf = (i + 1) - lx;
-					else if (lx < i && i < rx) xf = rx - i;
-					else xf = 1.0;
-
-					ff = xf * yf;
-					m = j * nw + i;
-					n = m << 2;
-					counts[m] += ff;
-					pixel = XGetPixel(ximage, k, l);
-					if (bitmap && (pixel & 0x00ffffff))
-						pixel |= 0x00ffffff;
-					A = (pixel >> 24) & 0xff;
-					R = (pixel >> 16) & 0xff;
-					G = (pixel >> 8) & 0xff;
-					B = (pixel >> 0) & 0xff;
-					colors[n + 0] += A * ff;
-					colors[n + 1] += R * ff;
-					colors[n + 2] += G * ff;
-					colors[n + 3] += B * ff;
-				}
+static void
+init_scale_axis(ScaleAxis *ax, unsigned sn, unsigned dn)
+{
+	unsigned long lo, hi, a, b, cum, q, prev;
+	unsigned d, s, total = 0;
+
+	ax->first = ecalloc((size_t) dn * 3, sizeof(*ax->first));
+	ax->count = ax->first + dn;
+	ax->offset = ax->count + dn;
+	ax->weight = ecalloc((size_t) dn * (sn / dn + 2), sizeof(*ax->weight));
+	if (dn > sn) {
+		/* pixel centers map to (2d + 1) * sn / (2 * dn) - 1/2 in the source */
+		for (d = 0; d < dn; d++) {
+			ax->offset[d] = total;
+			lo = (unsigned long) (2 * d + 1) * sn;
+			if (lo < dn) {
+				ax->first[d] = 0;
+				q = 0;
+			} else {
+				ax->first[d] = (lo - dn) / (2 * dn);
+				q = (((lo - dn) % (2 * dn)) * SCALE_ONE + dn) / (2 * dn);
 			}
-		}
-	}
-	unsigned long amax = 0;
-
-	for (j = 0; j < nh; j++) {
-		for (i = 0; i < nw; i++) {
-			m = j * nw + i;
-			n = m << 2;
-			if (counts[m]) {
-				pixel = ((A = min(255, lround(colors[n + 0] / counts[m]))) << 24) |
-					((R = min(255, lround(colors[n + 1] / counts[m]))) << 16) |
-					((G = min(255, lround(colors[n + 2] / counts[m]))) <<  8) |
-					((B = min(255, lround(colors[n + 3] / counts[m]))) <<  0);
-				XPutPixel(xscale, i, j, pixel);
-				amax = max(amax, A);
+			if (q >= SCALE_ONE) {
+				/* rounded onto the next source pixel */
+				if (ax->first[d] + 1 < sn)
+					ax->first[d]++;
+				q = 0;
 			}
+			if (q && ax->first[d] + 1 < sn) {
+				ax->weight[total++] = SCALE_ONE - q;
+				ax->weight[total++] = q;
+			} else
+				ax->weight[total++] = SCALE_ONE;
+			ax->count[d] = total - ax->offset[d];
 		}
+		return;
 	}
-	/* no opacity, add some */
-	if (!amax)
-		for (j = 0; j < nh; j++)
-			for (i = 0; i < nw; i++)
-				XPutPixel(xscale, i, j, XGetPixel(xscale, i, j) | 0xff000000);
-#ifdef ALPHAMAX
-	else if (amax < 255UL) {
-		double bump = (double) 255 / (double) amax;
-
-		for (j = 0; j < nh; j++) {
-			for (i = 0; i < nw; i++) {
-				pixel = XGetPixel(xscale, i, j);
-				A = (pixel >> 24) & 0xff;
-				A = min(255, lround(A * bump));
-				pixel = (pixel & 0x00ffffff) | (A << 24);
-				XPutPixel(xscale, i, j, pixel);
-			}
+	for (d = 0; d < dn; d++) {
+		/* footprint in units of 1/dn of a source pixel */
+		lo = (unsigned long) d * sn;
+		hi = lo + sn;
+		ax->first[d] = lo / dn;
+		ax->offset[d] = total;
+		for (cum = prev = 0, s = lo / dn; s < sn && (unsigned long) s * dn < hi; s++) {
+			a = max(lo, (unsigned long) s * dn);
+			b = min(hi, (unsigned long) (s + 1) * dn);
+			cum += b - a;
+			q = (cum * SCALE_ONE + sn / 2) / sn;
+			ax->weight[total++] = q - prev;
+			prev = q;
 		}
+		ax->count[d] = total - ax->offset[d];
 	}
-#endif
-	free(counts);
-	free(colors);
-	XDestroyImage(ximage);
-	return (xscale);
-      error:
-	if (xscale)
-		XDestroyImage(xscale);
-	if (counts)
-		free(counts);
-	if (colors)
-		free(colors);
-	return (ximage);
 }
 
-XImage *
-up_scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitmap)
+static Bool
+native_argb(XImage *ximage)
 {
-	XImage *xscale = NULL;
-	size_t elements = nw * nh;
-
-	xscale = XCreateImage(dpy, ds->visual, 32, ZPixmap, 0, NULL, nw, nh, 8, 0);
-	if (!xscale)
-		return (ximage);
-	xscale->data = ecalloc(xscale->bytes_per_line, xscale->height);
-	if (!xscale->data) {
-		XDestroyImage(xscale);
-		return (ximage);
-	}
-	double *counts = ecalloc(elements, sizeof(*counts));
-	double *colors = ecalloc(elements, sizeof(*colors) << 2);
-
-	unsigned w = ximage->width;
-	unsigned h = ximage->height;
-	unsigned i, j, k, l, m, n;
-
-	double pppx = (double) w / (double) nw;
-	double pppy = (double) h / (double) nh;
-	double ty, by, lx, rx, xf, yf, ff;
-	unsigned long A, R, G, B, pixel;
-
-	for (ty = 0.0, by = pppy, l = 0; l < nh; l++, ty = by, by = (l + 1) *pppy) {
-
-		for (j = floor(ty); j < by; j++) {
+	static const unsigned one = 1;
 
-			if (ty < (j + 1) && (j + 1) < by)
-				yf = (j + 1) - ty;
-			else if (ty < j && j < by)
-				yf = by - j;
-			else
-				yf = 1.0;
-
-			for (lx = 0.0, rx = pppx, k = 0; k < nw; k++, lx = rx, rx = (k + 1) * pppx) {
-
-				for (i = floor(lx); i < rx; i++) {
-
-					if (lx < (i + 1) && (i + 1) < rx)
-						xf = (i + 1) - lx;
-					else if (lx < i && i < rx)
-						xf = rx - i;
-					else
-						xf = 1.0;
-
-					ff = xf * yf;
-
-					m = l * nw + k;
-					n = m << 2;
-					counts[m] += ff;
-					pixel = XGetPixel(ximage, i, j);
-					if (bitmap && (pixel & 0x00ffffff))
-						pixel |= 0x00ffffff;
-					A = (pixel >> 24) & 0xff;
-					R = (pixel >> 16) & 0xff;
-					G = (pixel >> 8) & 0xff;
-					B = (pixel >> 0) & 0xff;
-					colors[n + 0] += A * ff;
-					colors[n + 1] += R * ff;
-					colors[n + 2] += G * ff;
-					colors[n + 3] += B * ff;
-				}
-			}
-		}
-	}
-	unsigned long amax = 0;
+	return (ximage->format == ZPixmap && ximage->bits_per_pixel == 32 &&
+		ximage->byte_order == (*(const char *) &one ? LSBFirst : MSBFirst));
+}
 
-	for (j = 0; j < nh; j++) {
-		for (i = 0; i < nw; i++) {
-			m = j * nw + i;
-			n = m << 2;
-			if (counts[m]) {
-				pixel = ((A = min(255, lround(colors[n + 0] / counts[m]))) << 24) |
-					((R = min(255, lround(colors[n + 1] / counts[m]))) << 16) |
-					((G = min(255, lround(colors[n + 2] / counts[m]))) <<  8) |
-					((B = min(255, lround(colors[n + 3] / counts[m]))) <<  0);
-				XPutPixel(xscale, i, j, pixel);
-				amax = max(amax, A);
-			}
-		}
-	}
-	/* no opacity, add some */
-	if (!amax)
-		for (j = 0; j < nh; j++)
-			for (i = 0; i < nw; i++)
-				XPutPixel(xscale, i, j, XGetPixel(xscale, i, j) | 0xff000000);
-#ifdef ALPHAMAX
-	else if (amax < 255UL) {
-		double bump = (double) 255 / (double) amax;
+/* fetch a row of ARGB pixels, reading the image data directly when possible */
+static void
+get_argb_row(XImage *ximage, int row, uint32_t *argb, Bool bitmap)
+{
+	int i;
 
-		for (j = 0; j < nh; j++) {
-			for (i = 0; i < nw; i++) {
-				pixel = XGetPixel(xscale, i, j);
-				A = (pixel >> 24) & 0xff;
-				A = min(255, lround(A * bump));
-				pixel = (pixel & 0x00ffffff) | (A << 24);
-				XPutPixel(xscale, i, j, pixel);
-			}
-		}
-	}
-#endif
-	free(counts);
-	free(colors);
-	XDestroyImage(ximage);
-	return (xscale);
+	if (native_argb(ximage))
+		memcpy(argb, ximage->data + (size_t) row * ximage->bytes_per_line,
+		       ximage->width * sizeof(*argb));
+	else
+		for (i = 0; i < ximage->width; i++)
+			argb[i] = XGetPixel(ximage, i, row);
+	if (bitmap)
+		for (i = 0; i < ximage->width; i++)
+			if (argb[i] & 0x00ffffff)
+				argb[i] |= 0x00ffffff;
 }
 
-/* upscaling width, downscaling height */
 static XImage *
-wh_scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitmap)
+area_scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitmap)
 {
 	XImage *xscale = NULL;
-	size_t elements = nw * nh;
+	unsigned w = ximage->width;
+	unsigned h = ximage->height;
+	unsigned i, j, k, c;
+	uint32_t *row = NULL, *out = NULL, *acc = NULL, pixel, A, amax = 0;
+	uint16_t *rows = NULL;
+	ScaleAxis ax = { NULL, }, ay = { NULL, };
+	Bool opaque = True, direct;
 
-	xscale = XCreateImage(dpy, ds->visual, 32, ZPixmap, 0, NULL, nw, nh, 8, 0);
-	if (!xscale)
-		return(ximage);
-	xscale->data = ecalloc(xscale->bytes_per_line, xscale->height);
-	if (!xscale->data) {
+	if (!w || !h || !nw || !nh)
+		return (ximage);
+	if (!(xscale = XCreateImage(dpy, ds->visual, 32, ZPixmap, 0, NULL, nw, nh, 8, 0))) {
+		EPRINTF("could not create ximage\n");
+		return (ximage);
+	}
+	if (!(xscale->data = calloc(xscale->bytes_per_line, xscale->height))) {
+		EPRINTF("could not allocate ximage data\n");
 		XDestroyImage(xscale);
 		return (ximage);
 	}
-	double *counts = ecalloc(elements, sizeof(*counts));
-	double *colors = ecalloc(elements, sizeof(*colors) << 2);
-
-	unsigned w = ximage->width;
-	unsigned h = ximage->height;
-	unsigned i, j, k, l, m, n;
-
-	double pppx = (double) w / (double) nw;
-	double pppy = (double) nh / (double) h;
-	double ty, by, lx, rx, xf, yf, ff;
-	unsigned long A, R, G, B, pixel;
-
-	for (ty = 0.0, by = pppy, l = 0; l < h; l++, ty = by, by = (l + 1) * pppy) {
-
-		for (j = floor(ty); j < by; j++) {
+	XPRINTF("scaling image %ux%ux%u to %ux%ux%u\n",
+			ximage->width, ximage->height, ximage->depth,
+			xscale->width, xscale->height, xscale->depth);
 
-			if (ty < (j + 1) && (j + 1) < by)
-				yf = (j + 1) - ty;
-			else if (ty < j && j < by)
-				yf = by - j;
-			else
-				yf = 1.0;
-
-			for (lx = 0.0, rx = pppx, k = 0; k < nw; k++, lx = rx, rx = (k + 1) * pppx) {
-
-				for (i = floor(lx); i < rx; i++) {
-
-					if (lx < (i + 1) && (i + 1) < rx)
-						xf = (i + 1) - lx;
-					else if (lx < i && i < rx)
-						xf = rx - i;
-					else
-						xf = 1.0;
-
-					ff = xf * yf;
-
-					m = l * nw + k;
-					n = m << 2;
-					counts[m] += ff;
-					pixel = XGetPixel(ximage, i, j);
-					if (bitmap && (pixel & 0x00ffffff))
-						pixel |= 0x00ffffff;
-					A = (pixel >> 24) & 0xff;
-					R = (pixel >> 16) & 0xff;
-					G = (pixel >> 8) & 0xff;
-					B = (pixel >> 0) & 0xff;
-					colors[n + 0] += A * ff;
-					colors[n + 1] += R * ff;
-					colors[n + 2] += G * ff;
-					colors[n + 3] += B * ff;
-				}
+	init_scale_axis(&ax, w, nw);
+	init_scale_axis(&ay, h, nh);
+	row = ecalloc(w, sizeof(*row));
+	out = ecalloc(nw, sizeof(*out));
+	acc = ecalloc((size_t) nw * 4, sizeof(*acc));
+	/* horizontally scaled source rows, 8.8 fixed point, premultiplied */
+	rows = ecalloc((size_t) h * nw * 4, sizeof(*rows));
+
+	/* images without any alpha (plain pixmaps) are opaque */
+	for (j = 0; j < h && opaque; j++) {
+		get_argb_row(ximage, j, row, bitmap);
+		for (i = 0; i < w; i++)
+			if (row[i] & 0xff000000) {
+				opaque = False;
+				break;
 			}
-		}
 	}
-	unsigned long amax = 0;
-
-	for (j = 0; j < nh; j++) {
-		for (i = 0; i < nw; i++) {
-			m = j * nw + i;
-			n = m << 2;
-			if (counts[m]) {
-				pixel = ((A = min(255, lround(colors[n + 0] / counts[m]))) << 24) |
-					((R = min(255, lround(colors[n + 1] / counts[m]))) << 16) |
-					((G = min(255, lround(colors[n + 2] / counts[m]))) <<  8) |
-					((B = min(255, lround(colors[n + 3] / counts[m]))) <<  0);
-				XPutPixel(xscale, i, j, pixel);
-				amax = max(amax, A);
-			}
+	for (j = 0; j < h; j++) {
+		uint16_t *r = rows + (size_t) j * nw * 4;
+
+		get_argb_row(ximage, j, row, bitmap);
+		for (i = 0; i < w; i++) {
+			pixel = row[i];
+			A = opaque ? 0xff : (pixel >> 24);
+			if (A != 0xff)
+				pixel = (A << 24) |
+				    ((((pixel >> 16) & 0xff) * A + 127) / 255) << 16 |
+				    ((((pixel >> 8) & 0xff) * A + 127) / 255) << 8 |
+				    ((((pixel >> 0) & 0xff) * A + 127) / 255);
+			else
+				pixel |= 0xff000000;
+			row[i] = pixel;
 		}
-	}
-	/* no opacity, add some */
-	if (!amax)
-		for (j = 0; j < nh; j++)
-			for (i = 0; i < nw; i++)
-				XPutPixel(xscale, i, j, XGetPixel(xscale, i, j) | 0xff000000);
-#ifdef ALPHAMAX
-	else if (amax < 255UL) {
-		double bump = (double) 255 / (double) amax;
-
-		for (j = 0; j < nh; j++) {
-			for (i = 0; i < nw; i++) {
-				pixel = XGetPixel(xscale, i, j);
-				A = (pixel >> 24) & 0xff;
-				A = min(255, lround(A * bump));
-				pixel = (pixel & 0x00ffffff) | (A << 24);
-				XPutPixel(xscale, i, j, pixel);
+		for (i = 0; i < nw; i++, r += 4) {
+			const uint16_t *wt = ax.weight + ax.offset[i];
+			const uint32_t *p = row + ax.first[i];
+			uint32_t sa = 0, sr = 0, sg = 0, sb = 0;
+
+			for (k = 0; k < ax.count[i]; k++) {
+				sa += (p[k] >> 24) * wt[k];
+				sr += ((p[k] >> 16) & 0xff) * wt[k];
+				sg += ((p[k] >> 8) & 0xff) * wt[k];
+				sb += (p[k] & 0xff) * wt[k];
 			}
+			r[0] = (sa + (1U << (SCALE_BITS - 9))) >> (SCALE_BITS - 8);
+			r[1] = (sr + (1U << (SCALE_BITS - 9))) >> (SCALE_BITS - 8);
+			r[2] = (sg + (1U << (SCALE_BITS - 9))) >> (SCALE_BITS - 8);
+			r[3] = (sb + (1U << (SCALE_BITS - 9))) >> (SCALE_BITS - 8);
 		}
 	}
-#endif
-	free(counts);
-	free(colors);
-	XDestroyImage(ximage);
-	return (xscale);
-}
-
-/* downscaling width, upscaling height */
-static XImage *
-hw_scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitmap)
-{
-	XImage *xscale = NULL;
-	size_t elements = nw * nh;
-
-	xscale = XCreateImage(dpy, ds->visual, 32, ZPixmap, 0, NULL, nw, nh, 8, 0);
-	if (!xscale)
-		return(ximage);
-	xscale->data = ecalloc(xscale->bytes_per_line, xscale->height);
-	if (!xscale->data) {
-		XDestroyImage(xscale);
-		return (ximage);
-	}
-	double *counts = ecalloc(elements, sizeof(*counts));
-	double *colors = ecalloc(elements, sizeof(*colors) << 2);
-
-	unsigned w = ximage->width;
-	unsigned h = ximage->height;
-	unsigned i, j, k, l, m, n;
-
-	double pppx = (double) nw / (double) w;
-	double pppy = (double) h / (double) nh;
-	double ty, by, lx, rx, xf, yf, ff;
-	unsigned long A, R, G, B, pixel;
-
-	for (ty = 0.0, by = pppy, l = 0; l < nh; l++, ty = by, by = (l + 1) *pppy) {
+	direct = native_argb(xscale);
+	for (j = 0; j < nh; j++) {
+		const uint16_t *wt = ay.weight + ay.offset[j];
 
-		for (j = floor(ty); j < by; j++) {
+		memset(acc, 0, (size_t) nw * 4 * sizeof(*acc));
+		for (k = 0; k < ay.count[j]; k++) {
+			const uint16_t *r = rows + (size_t) (ay.first[j] + k) * nw * 4;
 
-			if (ty < (j + 1) && (j + 1) < by)
-				yf = (j + 1) - ty;
-			else if (ty < j && j < by)
-				yf = by - j;
-			else
-				yf = 1.0;
-
-			for (lx = 0.0, rx = pppx, k = 0; k < w; k++, lx = rx, rx = (k + 1) * pppx) {
-
-				for (i = floor(lx); i < rx; i++) {
-
-					if (lx < (i + 1) && (i + 1) < rx)
-						xf = (i + 1) - lx;
-					else if (lx < i && i < rx)
-						xf = rx - i;
-					else
-						xf = 1.0;
-
-					ff = xf * yf;
-
-					m = j * nw + i;
-					n = m << 2;
-					counts[m] += ff;
-					pixel = XGetPixel(ximage, i, j);
-					if (bitmap && (pixel & 0x00ffffff))
-						pixel |= 0x00ffffff;
-					A = (pixel >> 24) & 0xff;
-					R = (pixel >> 16) & 0xff;
-					G = (pixel >> 8) & 0xff;
-					B = (pixel >> 0) & 0xff;
-					colors[n + 0] += A * ff;
-					colors[n + 1] += R * ff;
-					colors[n + 2] += G * ff;
-					colors[n + 3] += B * ff;
-				}
-			}
+			for (c = 0; c < nw * 4; c++)
+				acc[c] += r[c] * wt[k];
 		}
-	}
-	unsigned long amax = 0;
-
-	for (j = 0; j < nh; j++) {
 		for (i = 0; i < nw; i++) {
-			m = j * nw + i;
-			n = m << 2;
-			if (counts[m]) {
-				pixel = ((A = min(255, lround(colors[n + 0] / counts[m]))) << 24) |
-					((R = min(255, lround(colors[n + 1] / counts[m]))) << 16) |
-					((G = min(255, lround(colors[n + 2] / counts[m]))) <<  8) |
-					((B = min(255, lround(colors[n + 3] / counts[m]))) <<  0);
-				XPutPixel(xscale, i, j, pixel);
-				amax = max(amax, A);
+			uint32_t *a = acc + i * 4, R, G, B;
+
+			A = (a[0] + (1U << (SCALE_BITS + 7))) >> (SCALE_BITS + 8);
+			R = (a[1] + (1U << (SCALE_BITS + 7))) >> (SCALE_BITS + 8);
+			G = (a[2] + (1U << (SCALE_BITS + 7))) >> (SCALE_BITS + 8);
+			B = (a[3] + (1U << (SCALE_BITS + 7))) >> (SCALE_BITS + 8);
+			if (A && A != 0xff) {
+				R = min(255, (R * 255 + A / 2) / A);
+				G = min(255, (G * 255 + A / 2) / A);
+				B = min(255, (B * 255 + A / 2) / A);
 			}
+			if (opaque)
+				A = 0xff;
+			out[i] = (A << 24) | (R << 16) | (G << 8) | B;
+			amax = max(amax, A);
 		}
+		if (direct)
+			memcpy(xscale->data + (size_t) j * xscale->bytes_per_line, out,
+			       nw * sizeof(*out));
+		else
+			for (i = 0; i < nw; i++)
+				XPutPixel(xscale, i, j, out[i]);
 	}
 	/* no opacity, add some */
 	if (!amax)
@@ -706,25 +497,40 @@ hw_scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitma
 				XPutPixel(xscale, i, j, XGetPixel(xscale, i, j) | 0xff000000);
 #ifdef ALPHAMAX
 	else if (amax < 255UL) {
-		double bump = (double) 255 / (double) amax;
-
 		for (j = 0; j < nh; j++) {
 			for (i = 0; i < nw; i++) {
 				pixel = XGetPixel(xscale, i, j);
-				A = (pixel >> 24) & 0xff;
-				A = min(255, lround(A * bump));
+				A = min(255, ((pixel >> 24) * 255 + amax / 2) / amax);
 				pixel = (pixel & 0x00ffffff) | (A << 24);
 				XPutPixel(xscale, i, j, pixel);
 			}
 		}
 	}
 #endif
-	free(counts);
-	free(colors);
+	free(rows);
+	free(acc);
+	free(out);
+	free(row);
+	free_scale_axis(&ax);
+	free_scale_axis(&ay);
 	XDestroyImage(ximage);
 	return (xscale);
 }
 
+/* downscaling both dimensions */
+XImage *
+dn_scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitmap)
+{
+	return area_scale_image(ds, ximage, nw, nh, bitmap);
+}
+
+/* upscaling both dimensions */
+XImage *
+up_scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitmap)
+{
+	return area_scale_image(ds, ximage, nw, nh, bitmap);
+}
+
 /* crop ARGB image down to non-transparent extents, consuming passed image */
 XImage *
 crop_image(AScreen *ds, XImage *ximage)
@@ -791,13 +597,9 @@ scale_image(AScreen *ds, XImage *ximage, unsigned nw, unsigned nh, Bool bitmap,
 		return dn_scale_image(ds, ximage, nw, nh, bitmap);
 	} else if (nw >= w && nh >= h) {
 		return up_scale_image(ds, ximage, nw, nh, bitmap);
-	} else if (nw >= w && nh <= h) {
-		return wh_scale_image(ds, ximage, nw, nh, bitmap);
-	} else if (nw <= w && nh >= h) {
-		return hw_scale_image(ds, ximage, nw, nh, bitmap);
 	} else {
-		/* can't happen */
-		return (NULL);
+		/* upscaling one dimension and downscaling the other */
+		return area_scale_image(ds, ximage, nw, nh, bitmap);
 	}
 }
 
@@ -821,106 +623,240 @@ static const unsigned char dither8[8][8] = {
 };
 #endif
 
+/*
+ * Row converters from ARGB to the pixel format of the screen visual.  One is
+ * chosen per screen by initimage() so that the per-pixel loops carry no
+ * format switches.  TrueColor channels are reduced and positioned with
+ * shifts instead of table lookups.
+ */
+#define TRUEPIXEL(ds, c) \
+	((((unsigned long) (c)->red >> (ds)->rgb[0].loss) << (ds)->rgb[0].shift) | \
+	 (((unsigned long) (c)->green >> (ds)->rgb[1].loss) << (ds)->rgb[1].shift) | \
+	 (((unsigned long) (c)->blue >> (ds)->rgb[2].loss) << (ds)->rgb[2].shift))
+
+static void
+convert_argb32(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	memcpy(p, c, width * sizeof(*c));
+}
+
+static void
+convert_true32_swap(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	uint32_t *q = (uint32_t *) p;
+	unsigned x;
+
+	if (ds->identity)
+		for (x = 0; x < width; x++)
+			q[x] = __builtin_bswap32(((const uint32_t *) c)[x]);
+	else
+		for (x = 0; x < width; x++, c++)
+			q[x] = __builtin_bswap32(TRUEPIXEL(ds, c) | ((uint32_t) c->alpha << 24));
+}
+
+static void
+convert_true32(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	uint32_t *q = (uint32_t *) p;
+	unsigned x;
+
+	for (x = 0; x < width; x++, c++)
+		q[x] = TRUEPIXEL(ds, c) | ((uint32_t) c->alpha << 24);
+}
+
+static void
+convert_true24_lsb(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	unsigned long pixel;
+	unsigned x;
+
+	for (x = 0; x < width; x++, c++) {
+		pixel = TRUEPIXEL(ds, c);
+		*p++ = pixel;
+		*p++ = pixel >> 8;
+		*p++ = pixel >> 16;
+	}
+}
+
+static void
+convert_true24_msb(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	unsigned long pixel;
+	unsigned x;
+
+	for (x = 0; x < width; x++, c++) {
+		pixel = TRUEPIXEL(ds, c);
+		*p++ = pixel >> 16;
+		*p++ = pixel >> 8;
+		*p++ = pixel;
+	}
+}
+
+static void
+convert_true16_lsb(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	unsigned long pixel;
+	unsigned x;
+
+	for (x = 0; x < width; x++, c++) {
+		pixel = TRUEPIXEL(ds, c);
+		*p++ = pixel;
+		*p++ = pixel >> 8;
+	}
+}
+
+static void
+convert_true16_msb(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	unsigned long pixel;
+	unsigned x;
+
+	for (x = 0; x < width; x++, c++) {
+		pixel = TRUEPIXEL(ds, c);
+		*p++ = pixel >> 8;
+		*p++ = pixel;
+	}
+}
+
+static void
+convert_true8(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	unsigned x;
+
+	for (x = 0; x < width; x++, c++)
+		*p++ = TRUEPIXEL(ds, c);
+}
+
+static void
+convert_palette(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	unsigned long r, g, b;
+	unsigned x;
+
+	for (x = 0; x < width; x++, c++) {
+		r = ds->rctab[c->red];
+		g = ds->gctab[c->green];
+		b = ds->bctab[c->blue];
+		*p++ = ds->colors[(r * ds->cpc * ds->cpc) + (g * ds->cpc) + b].pixel;
+	}
+}
+
+static void
+convert_gray(const AScreen *ds, const ARGB *c, unsigned char *p, unsigned width)
+{
+	unsigned long r, g, b;
+	unsigned x;
+
+	for (x = 0; x < width; x++, c++) {
+		r = ds->rctab[c->red];
+		g = ds->gctab[c->green];
+		b = ds->bctab[c->blue];
+		*p++ = ds->colors[((r * 30) + (g * 59) + (b * 11)) / 100].pixel;
+	}
+}
+
+/* conversion buffer reused between calls */
+static struct {
+	unsigned char *data;
+	size_t size;
+} scratch;
+
+/** @brief render an ARGB buffer to a drawable of the screen visual
+  *
+  * When ARGB is already the pixel format of the visual the buffer is sent as
+  * is; otherwise it is converted a row at a time into a reusable buffer.
+  */
 void
-renderimage(AScreen *ds, const ARGB *argb, const unsigned width, const unsigned height)
+renderimage(const AScreen *ds, Drawable d, GC gc, const ARGB *argb, int x, int y,
+	    unsigned width, unsigned height)
 {
 	XImage *image;
-	unsigned long r, g, b, pixel;
-	unsigned char *p, *pp, *data;
-	unsigned x, y;
-	const ARGB *c;
+	unsigned char *p;
+	size_t size;
+	unsigned row;
 
-	image = XCreateImage(dpy, ds->visual, ds->bpp, ZPixmap, 0, NULL, width, height, 32, 0);
+	if (!ds->convert || !width || !height)
+		return;
+	image = XCreateImage(dpy, ds->visual, ds->depth, ZPixmap, 0, NULL, width, height, 32, 0);
 	if (!image) {
 		XPRINTF("Could not create image\n");
 		return;
 	}
+	if (ds->convert == convert_argb32 && image->bytes_per_line == (int) (width * sizeof(*argb))) {
+		image->data = (char *) argb;
+	} else {
+		size = (size_t) image->bytes_per_line * height;
+		if (size > scratch.size) {
+			scratch.data = erealloc(scratch.data, size);
+			scratch.size = size;
+		}
+		for (p = scratch.data, row = 0; row < height; row++, p += image->bytes_per_line)
+			ds->convert(ds, argb + (size_t) row * width, p, width);
+		image->data = (char *) scratch.data;
+	}
+	XPutImage(dpy, d, gc, image, 0, 0, x, y, width, height);
 	image->data = NULL;
-	p = pp = data = calloc(image->bytes_per_line * (height + 1), sizeof(*data));
+	XDestroyImage(image);
+}
 
+static void
+initconvert(AScreen *ds)
+{
+	static const unsigned one = 1;
+	Bool msb = (ImageByteOrder(dpy) == MSBFirst);
+	Bool swap = (msb == (*(const char *) &one != 0));
+	unsigned long mask[3] = { ds->visual->red_mask, ds->visual->green_mask,
+		ds->visual->blue_mask };
+	int i, bits;
+
+	ds->convert = NULL;
+	ds->identity = False;
 	switch (ds->visual->class) {
-	case StaticColor:
-	case PseudoColor:
-		for (c = argb, y = 0; y < height; y++) {
-			for (x = 0; x < width; x++, c++) {
-				r = ds->rctab[c->red];
-				g = ds->gctab[c->green];
-				b = ds->bctab[c->blue];
-
-				pixel = (r * ds->cpc * ds->cpc) + (g * ds->cpc) + b;
-				*p++ = ds->colors[pixel].pixel;
-			}
-			p = (pp += image->bytes_per_line);
-		}
-		break;
 	case TrueColor:
-		for (c = argb, y = 0; y < height; y++) {
-			for (x = 0; x < width; x++, c++) {
-				r = ds->rctab[c->red];
-				g = ds->gctab[c->green];
-				b = ds->bctab[c->blue];
-
-				pixel = (((r << ds->visual->bits_per_rgb) | g) << ds->visual->bits_per_rgb) | b;
-				switch (ds->bpp + ((image->byte_order == MSBFirst) ? 1 : 0)) {
-				case 8:	/* 8bpp */
-					*p++ = pixel;
-					break;
-				case 16:	/* 16bpp LSB */
-					*p++ = pixel;
-					*p++ = pixel >> 8;
-					break;
-				case 17:	/* 16bpp MSB */
-					*p++ = pixel >> 8;
-					*p++ = pixel;
-					break;
-				case 24:	/* 24bpp LSB */
-					*p++ = pixel;
-					*p++ = pixel >> 8;
-					*p++ = pixel >> 16;
-					break;
-				case 25:	/* 24bpp MSB */
-					*p++ = pixel >> 16;
-					*p++ = pixel >> 8;
-					*p++ = pixel;
-					break;
-				case 32:	/* 32bpp LSB */
-					*p++ = pixel;
-					*p++ = pixel >> 8;
-					*p++ = pixel >> 16;
-					*p++ = pixel >> 24;
-					break;
-				case 33:	/* 32bpp MSB */
-					*p++ = pixel >> 24;
-					*p++ = pixel >> 16;
-					*p++ = pixel >> 8;
-					*p++ = pixel;
-					break;
-				}
-			}
-			p = (pp += image->bytes_per_line);
+	case DirectColor:
+		for (i = 0; i < 3; i++) {
+			if (!mask[i])
+				return;
+			for (ds->rgb[i].shift = 0; !(mask[i] & 0x1); mask[i] >>= 1, ds->rgb[i].shift++) ;
+			for (bits = 0; mask[i] & 0x1; mask[i] >>= 1, bits++) ;
+			ds->rgb[i].loss = bits < 8 ? 8 - bits : 0;
+		}
+		ds->identity = (ds->rgb[0].shift == 16 && ds->rgb[1].shift == 8 &&
+				ds->rgb[2].shift == 0 && !ds->rgb[0].loss &&
+				!ds->rgb[1].loss && !ds->rgb[2].loss);
+		switch (ds->bpp) {
+		case 32:
+			if (swap)
+				ds->convert = convert_true32_swap;
+			else if (ds->identity)
+				ds->convert = convert_argb32;
+			else
+				ds->convert = convert_true32;
+			break;
+		case 24:
+			ds->convert = msb ? convert_true24_msb : convert_true24_lsb;
+			break;
+		case 16:
+			ds->convert = msb ? convert_true16_msb : convert_true16_lsb;
+			break;
+		case 8:
+			ds->convert = convert_true8;
+			break;
 		}
 		break;
+	case StaticColor:
+	case PseudoColor:
+		if (ds->bpp == 8)
+			ds->convert = convert_palette;
+		break;
 	case StaticGray:
 	case GrayScale:
-		for (c = argb, y = 0; y < height; y++) {
-			for (x = 0; x < width; x++, c++) {
-				r = ds->rctab[c->red];
-				g = ds->gctab[c->green];
-				b = ds->bctab[c->blue];
-
-				g = ((r * 30) + (g * 59) + (b * 11)) / 100;
-				*p++ = ds->colors[g].pixel;
-			}
-			p = (pp += image->bytes_per_line);
-		}
+		if (ds->bpp == 8)
+			ds->convert = convert_gray;
 		break;
-	default:
-		XPRINTF("Unsupported visual class\n");
-		free(data);
-		XDestroyImage(image);
-		return;
 	}
-	image->data = (char *) data;
+	if (!ds->convert)
+		XPRINTF("Unsupported visual class %d bpp %u\n", ds->visual->class, ds->bpp);
 }
 
 void
@@ -1246,5 +1182,6 @@ initimage(void)
 		eprint("Unsuppoted visual class\n");
 		break;
 	}
+	initconvert(scr);
 }
 
@@ -22,8 +22,8 @@ int XReadBitmapFileImage(Display *display, Visual * visual, const char *file,
 #ifdef LIBPNG
 XImage *png_read_file_to_ximage(Display *display, Visual* visual, const char *file);
 #endif
-void renderimage(AScreen *ds, const ARGB *argb, const unsigned width,
-		 const unsigned height);
+void renderimage(const AScreen *ds, Drawable d, GC gc, const ARGB *argb, int x, int y,
+		 unsigned width, unsigned height);
 void initimage(void);
 
 #endif				/* __LOCAL_IMAGE_H__ */
@@ -5,6 +5,7 @@
 #include "draw.h"
 #include "ewmh.h"
 #include "config.h"
+#include "timer.h"
 #include "layout.h"		/* verification */
 
 #define MWFACT		(1<<0)	/* adjust master factor */
@@ -361,9 +362,191 @@ attachalist(Client *c, Bool front)
 	}
 }
 
+static int
+qsort_stackpos(const void *a, const void *b)
+{
+	const Client *ca = *(Client *const *) a;
+	const Client *cb = *(Client *const *) b;
+
+	return ((ca->stackpos > cb->stackpos) - (ca->stackpos < cb->stackpos));
+}
+
+/*
+ * Client frames are entered in a uniform grid of GRIDSIZE cells per screen so
+ * that overlap, occlusion and snapping queries only examine nearby windows.
+ * An item is stored in every cell it covers but only reported from the first
+ * cell that it shares with the query, so query results hold no duplicates.
+ * Rectangles outside the indexed area are clamped to its edge cells.
+ */
+static void
+grid_init(Grid *g, int x, int y, int w, int h)
+{
+	g->x = x;
+	g->y = y;
+	g->cols = max(1, (w + GRIDSIZE - 1) / GRIDSIZE);
+	g->rows = max(1, (h + GRIDSIZE - 1) / GRIDSIZE);
+	g->cells = ecalloc(g->cols * g->rows, sizeof(*g->cells));
+}
+
+static void
+grid_free(Grid *g)
+{
+	unsigned i;
+
+	for (i = 0; i < g->cols * g->rows; i++)
+		free(g->cells[i].items);
+	free(g->cells);
+	g->cells = NULL;
+	g->cols = g->rows = 0;
+}
+
+static unsigned
+grid_cell(int off, unsigned n)
+{
+	if (off < 0)
+		return (0);
+	return min((unsigned) (off / GRIDSIZE), n - 1);
+}
+
+/* cells covered by the rectangle x1 <= x < x2, y1 <= y < y2 */
+static void
+grid_span(const Grid *g, int x1, int y1, int x2, int y2,
+	  unsigned *c1, unsigned *r1, unsigned *c2, unsigned *r2)
+{
+	*c1 = grid_cell(x1 - g->x, g->cols);
+	*r1 = grid_cell(y1 - g->y, g->rows);
+	*c2 = grid_cell(max(x1, x2 - 1) - g->x, g->cols);
+	*r2 = grid_cell(max(y1, y2 - 1) - g->y, g->rows);
+}
+
+static void
+grid_insert(Grid *g, void *data, int x1, int y1, int x2, int y2)
+{
+	unsigned c1, r1, c2, r2, c, r;
+	GridCell *cell;
+
+	grid_span(g, x1, y1, x2, y2, &c1, &r1, &c2, &r2);
+	for (r = r1; r <= r2; r++) {
+		for (c = c1; c <= c2; c++) {
+			cell = &g->cells[r * g->cols + c];
+			if (cell->n >= cell->size) {
+				cell->size = cell->size ? 2 * cell->size : 8;
+				cell->items = erealloc(cell->items, cell->size * sizeof(*cell->items));
+			}
+			cell->items[cell->n].data = data;
+			cell->items[cell->n].cx = c1;
+			cell->items[cell->n].cy = r1;
+			cell->n++;
+		}
+	}
+}
+
+static void
+grid_remove(Grid *g, void *data, int x1, int y1, int x2, int y2)
+{
+	unsigned c1, r1, c2, r2, c, r, i;
+	GridCell *cell;
+
+	grid_span(g, x1, y1, x2, y2, &c1, &r1, &c2, &r2);
+	for (r = r1; r <= r2; r++) {
+		for (c = c1; c <= c2; c++) {
+			cell = &g->cells[r * g->cols + c];
+			for (i = 0; i < cell->n; i++) {
+				if (cell->items[i].data == data) {
+					cell->items[i] = cell->items[--cell->n];
+					break;
+				}
+			}
+		}
+	}
+}
+
+/* collect the items whose cells meet the rectangle; the result is reused */
+static unsigned
+grid_query(const Grid *g, int x1, int y1, int x2, int y2, void ***found)
+{
+	static void **buf = NULL;
+	static unsigned size = 0;
+	unsigned c1, r1, c2, r2, c, r, i, n = 0;
+	const GridCell *cell;
+	const GridItem *it;
+
+	if (!g->cells) {
+		*found = NULL;
+		return (0);
+	}
+	grid_span(g, x1, y1, x2, y2, &c1, &r1, &c2, &r2);
+	for (r = r1; r <= r2; r++) {
+		for (c = c1; c <= c2; c++) {
+			cell = &g->cells[r * g->cols + c];
+			for (i = 0, it = cell->items; i < cell->n; i++, it++) {
+				if (c != max(it->cx, c1) || r != max(it->cy, r1))
+					continue;
+				if (n >= size) {
+					size = size ? 2 * size : 64;
+					buf = erealloc(buf, size * sizeof(*buf));
+				}
+				buf[n++] = it->data;
+			}
+		}
+	}
+	*found = buf;
+	return (n);
+}
+
+static void
+unindexclient(Client *c)
+{
+	if (c->indexed.grid) {
+		grid_remove(c->indexed.grid, c, c->indexed.x1, c->indexed.y1,
+			    c->indexed.x2, c->indexed.y2);
+		c->indexed.grid = NULL;
+	}
+}
+
+/* enter or update the frame of a client in the index of the current screen */
+static void
+indexclient(Client *c)
+{
+	int x1 = c->c.x, y1 = c->c.y;
+	int x2 = x1 + c->c.w + 2 * c->c.b, y2 = y1 + c->c.h + 2 * c->c.b;
+
+	if (c->indexed.grid == &scr->grid && c->indexed.x1 == x1 && c->indexed.y1 == y1
+	    && c->indexed.x2 == x2 && c->indexed.y2 == y2)
+		return;
+	unindexclient(c);
+	if (!scr->grid.cells)
+		grid_init(&scr->grid, 0, 0, DisplayWidth(dpy, scr->screen),
+			  DisplayHeight(dpy, scr->screen));
+	grid_insert(&scr->grid, c, x1, y1, x2, y2);
+	c->indexed.grid = &scr->grid;
+	c->indexed.x1 = x1;
+	c->indexed.y1 = y1;
+	c->indexed.x2 = x2;
+	c->indexed.y2 = y2;
+}
+
+/* clients of the screen whose frames may meet the rectangle, in stacking order */
+static unsigned
+stackedclients(AScreen *ds, int x1, int y1, int x2, int y2, Client ***found)
+{
+	Client *s;
+	unsigned i, n;
+
+	if (!ds->numbered) {
+		for (i = 0, s = ds->stack; s; s = s->snext)
+			s->stackpos = i++;
+		ds->numbered = True;
+	}
+	n = grid_query(&ds->grid, x1, y1, x2, y2, (void ***) found);
+	qsort(*found, n, sizeof(**found), &qsort_stackpos);
+	return (n);
+}
+
 static void
 attachstack(Client *c, Bool front)
 {
+	scr->numbered = False;
 	if (front) {
 		assert(c && c->snext == NULL);
 		c->snext = scr->stack;
@@ -435,6 +618,7 @@ detachstack(Client *c)
 	assert(*cp == c);
 	*cp = c->snext;
 	c->snext = NULL;
+	scr->numbered = False;
 }
 
 static void
@@ -583,6 +767,36 @@ sloppyfocus(Client *c)
  * however.  Or we can select them here, but let the autoraise function delay
  * until some time after the selected/focus time.  */
 
+/*
+ * The strut delay has passed without further motion: focus (and so raise) the
+ * dock if the pointer is still over it.
+ */
+static void
+strut_timeout(Timer *t __attribute__((unused)), void *data)
+{
+	View *v = data;
+	Client *c;
+	AScreen *s, *save = scr;
+	Window proot, child;
+	int x, y, wx, wy;
+	unsigned mask;
+
+	if (!v->strut_time)
+		return;
+	v->strut_time = None;
+	if (!(c = getmanaged(v->strut_win, ClientWindow)) || c->cview != v)
+		return;
+	if (!(s = getscreen(c->win, False)))
+		return;
+	scr = s;
+	if (XQueryPointer(dpy, scr->root, &proot, &child, &x, &y, &wx, &wy, &mask) &&
+	    x >= c->c.x && x < c->c.x + c->c.w + 2 * c->c.b &&
+	    y >= c->c.y && y < c->c.y + c->c.h + 2 * c->c.b &&
+	    isdock(c) && !isdock(sel))
+		sloppyfocus(c);
+	scr = save;
+}
+
 static Bool
 delayedfocus(Client *c, Time t)
 {
@@ -601,11 +815,16 @@ delayedfocus(Client *c, Time t)
 		/* fall through */
 		__attribute__((fallthrough));
 	case StrutsHide:
-		if (!v->strut_time)
+		v->strut_win = c->win;
+		if (!v->strut_time) {
 			v->strut_time = t;
-		/* FIXME: config setting for strut delay */
+			/* fire even if the pointer stops moving */
+			timer_init(&v->strut_timer, strut_timeout, v);
+			timer_start(&v->strut_timer, scr->options.strutsdelay, 0);
+		}
 		if (t >= v->strut_time + scr->options.strutsdelay) {
 			v->strut_time = None;
+			timer_stop(&v->strut_timer);
 			sloppyfocus(c);
 		}
 		return True;
@@ -616,6 +835,7 @@ delayedfocus(Client *c, Time t)
 	}
       cancel_delay:
 	v->strut_time = None;
+	timer_stop(&v->strut_timer);
 	return False;
 }
 
@@ -823,6 +1043,8 @@ reconfigure_dockapp(Client *c, const ClientGeometry *n, Bool force)
 		c->r.y = (n->h - c->r.h) / 2;
 		wmask |= CWY;
 	}
+	if (c->indexed.grid)
+		indexclient(c);
 	getdockappgeometry(c, &c->r);
 	XMapWindow(dpy, c->frame);	/* not mapped for some reason... */
 	wwc.width = c->r.w;
@@ -883,9 +1105,10 @@ reconfigure(Client *c, const ClientGeometry *n, Bool force)
 	Bool gchange = False;		/* grip height or presense changed */
 	Bool vchange = False;		/* all-around grip width or presence changed */
 	Bool shaded = False;		/* the window will be shaded */
-	int t = c->title ? n->t : 0;
-	int g = c->grips ? n->g : 0;
-	int v = c->grips ? n->v : 0;
+	/* not yet realized decorations are laid out as though they were */
+	int t = (c->title || c->lazy.title) ? n->t : 0;
+	int g = (c->grips || c->lazy.grips) ? n->g : 0;
+	int v = (c->grips || c->lazy.grips) ? n->v : 0;
 
 	if (n->w <= 0 || n->h <= 0) {
 		EPRINTF(__CFMTS(c) "zero width %d or height %d\n", __CARGS(c), n->w, n->h);
@@ -980,6 +1203,8 @@ reconfigure(Client *c, const ClientGeometry *n, Bool force)
 #endif
 	}
 	getclientgeometry(c, &c->c);
+	if (c->indexed.grid)
+		indexclient(c);
 	/* do we send sync request _before_ configure? */
 	if ((wmask & (CWWidth | CWHeight)) && !newsize(c, wwc.width, wwc.height, CurrentTime))
 		wmask &= ~(CWWidth | CWHeight);
@@ -1342,7 +1567,7 @@ calc_maxh(Workarea *wa, ClientGeometry *g)
 static void
 get_decor(Client *c, View *v, ClientGeometry *g)
 {
-	Bool decorate;
+	Bool decorate, title, grips;
 
 	if (c->is.dockapp) {
 		g->t = 0;
@@ -1371,9 +1596,11 @@ get_decor(Client *c, View *v, ClientGeometry *g)
 	} else {
 		decorate = (v->dectiled || VFEATURES(v, OVERLAP)) ? True : False;
 	}
-	g->t = decorate ? ((c->title && c->has.title) ? scr->style.titleheight : 0) : 0;
-	g->g = decorate ? ((c->grips && c->has.grips) ? scr->style.gripsheight : 0) : 0;
-	g->v = decorate ? ((c->grips && c->has.grips && scr->style.fullgrips) ?  g->g : 0) : 0;
+	title = (c->title || c->lazy.title) && c->has.title;
+	grips = (c->grips || c->lazy.grips) && c->has.grips;
+	g->t = decorate ? (title ? scr->style.titleheight : 0) : 0;
+	g->g = decorate ? (grips ? scr->style.gripsheight : 0) : 0;
+	g->v = decorate ? ((grips && scr->style.fullgrips) ?  g->g : 0) : 0;
 }
 
 static void
@@ -2535,7 +2762,7 @@ arrangeview(View *v)
 		}
 	}
 	for (c = scr->stack; c; c = c->snext)
-		ewmh_update_net_window_state(c);
+		ewmh_update_net_window_state(c);	/* deferred */
 }
 
 static Bool
@@ -2554,12 +2781,41 @@ typedef struct StackContext {
 	unsigned n;			/* number of clients in stack */
 	unsigned i;			/* current client being considered */
 	unsigned j;			/* current stack position */
+	unsigned size;			/* allocated size of the lists */
 	Window *wl;			/* frame window list */
 	Client **ol;			/* original client list */
 	Client **cl;			/* unstacked client list */
 	Client **sl;			/* stacked client list */
+	int *layer;			/* layer of each original client */
+	unsigned *order;		/* original clients sorted by layer */
+	int *pos;			/* previous position of each frame */
+	unsigned *tail;			/* diff: subsequence tails */
+	int *link;			/* diff: subsequence predecessors */
+	Bool *keep;			/* diff: frames that need not move */
+	Window *sorted;			/* diff: previous frames and positions */
 } StackContext;
 
+static StackContext stack_ctx;		/* scratch lists reused by restack() */
+
+static void
+stack_reserve(StackContext *s, unsigned n)
+{
+	if (n <= s->size)
+		return;
+	s->size = n + (n >> 1) + 16;
+	s->wl = erealloc(s->wl, s->size * sizeof(*s->wl));
+	s->ol = erealloc(s->ol, s->size * sizeof(*s->ol));
+	s->cl = erealloc(s->cl, s->size * sizeof(*s->cl));
+	s->sl = erealloc(s->sl, s->size * sizeof(*s->sl));
+	s->layer = erealloc(s->layer, s->size * sizeof(*s->layer));
+	s->order = erealloc(s->order, s->size * sizeof(*s->order));
+	s->pos = erealloc(s->pos, s->size * sizeof(*s->pos));
+	s->tail = erealloc(s->tail, s->size * sizeof(*s->tail));
+	s->link = erealloc(s->link, s->size * sizeof(*s->link));
+	s->keep = erealloc(s->keep, s->size * sizeof(*s->keep));
+	s->sorted = erealloc(s->sorted, 2 * s->size * sizeof(*s->sorted));
+}
+
 void
 stack_client(StackContext *s, Client *c)
 {
@@ -2626,6 +2882,128 @@ stack_clients(StackContext * s, Client *c)
 	return stack_client(s, c);
 }
 
+/* stacking layers, from top to bottom (see restack()) */
+enum {
+	StackLayerModal,
+	StackLayerFull,
+	StackLayerDockSel,
+	StackLayerAbove,
+	StackLayerFloat,
+	StackLayerTiled,
+	StackLayerBelow,
+	StackLayerDesk,
+	StackLayerLast
+};
+
+static int
+stack_layer(Client *c, Bool docksel)
+{
+	Bool desk = WTCHECK(c, WindowTypeDesk) ? True : False;
+
+	if (window_stack.modal_transients && c->is.modal == ModalSystem)
+		return StackLayerModal;
+	if (!desk && took == c && c->is.full)
+		return StackLayerFull;
+	if (docksel && isdock(c))
+		return StackLayerDockSel;
+	if (!desk && !isdock(c) && !c->is.below &&
+	    (WTCHECK(c, WindowTypeDock) || WTCHECK(c, WindowTypeSplash) || c->is.above))
+		return StackLayerAbove;
+	if (!desk && !WTCHECK(c, WindowTypeDock) && !c->is.dockapp && !c->is.below)
+		return isfloater(c) ? StackLayerFloat : StackLayerTiled;
+	if (!desk && (isbar(c) || c->is.below))
+		return StackLayerBelow;
+	if (desk)
+		return StackLayerDesk;
+	return -1;
+}
+
+static int
+stack_cmpwin(const void *a, const void *b)
+{
+	Window wa = *(const Window *) a, wb = *(const Window *) b;
+
+	return (wa < wb) ? -1 : ((wa > wb) ? 1 : 0);
+}
+
+/** @brief - send a new stacking order to the server with the fewest moves
+  *
+  * Frames whose relative order is the same as when last sent (a longest
+  * increasing subsequence of their previous positions) are left alone.  Each
+  * other frame is placed directly below its predecessor in the new order
+  * working from the top, or above the topmost unmoved frame when it belongs at
+  * the very top.
+  */
+static void
+stack_send(StackContext *s, Window *ow, unsigned on)
+{
+	Window *sorted = s->sorted;
+	unsigned i, k, len = 0, lo, hi, mid, moves = 0;
+	int first = -1;
+
+	if (!on) {
+		XRestackWindows(dpy, s->wl, s->n);
+		return;
+	}
+	/* previous position of each frame, or -1 for new frames */
+	for (i = 0; i < on; i++) {
+		sorted[2 * i] = ow[i];
+		sorted[2 * i + 1] = i;
+	}
+	qsort(sorted, on, 2 * sizeof(*sorted), stack_cmpwin);
+	for (k = 0; k < s->n; k++) {
+		Window *w = bsearch(&s->wl[k], sorted, on, 2 * sizeof(*sorted), stack_cmpwin);
+
+		s->pos[k] = w ? (int) w[1] : -1;
+		s->keep[k] = False;
+	}
+
+	/* longest increasing subsequence of previous positions */
+	for (k = 0; k < s->n; k++) {
+		if (s->pos[k] < 0)
+			continue;
+		for (lo = 0, hi = len; lo < hi;) {
+			mid = (lo + hi) / 2;
+			if (s->pos[s->tail[mid]] < s->pos[k])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		s->link[k] = lo ? (int) s->tail[lo - 1] : -1;
+		s->tail[lo] = k;
+		if (lo == len)
+			len++;
+	}
+	if (!len) {
+		XRestackWindows(dpy, s->wl, s->n);
+		return;
+	}
+	for (i = s->tail[len - 1];; i = s->link[i]) {
+		s->keep[i] = True;
+		first = i;
+		if (s->link[i] < 0)
+			break;
+	}
+
+	for (k = 0; k < s->n; k++) {
+		XWindowChanges wc;
+
+		if (s->keep[k])
+			continue;
+		if (k == 0) {
+			wc.sibling = s->wl[first];
+			wc.stack_mode = Above;
+		} else {
+			wc.sibling = s->wl[k - 1];
+			wc.stack_mode = Below;
+		}
+		XConfigureWindow(dpy, s->wl[k], CWSibling | CWStackMode, &wc);
+		moves++;
+	}
+	XPRINTF("Restacked %u of %u frames\n", moves, s->n);
+	(void) moves;
+}
+
 /** @brief - restack windows
   *
   * The rationale is as follows: (from top to bottom)
@@ -2644,124 +3022,60 @@ stack_clients(StackContext * s, Client *c)
   *    Below was not set.
   * 5. Unfocused windows with both state Above and Below are treated as though
   *    Above was not set.
+  *
+  * Each client is placed in the bucket of the first layer that takes it (with
+  * floating windows above tiled ones in layer 5) and the buckets are then
+  * stacked in order, keeping the existing stacking order within a layer.
+  * Transients and group modals are pulled up with the windows they belong to.
   */
 static Bool
 restack()
 {
-	StackContext s = { 0, };
+	StackContext *s = &stack_ctx;
+	unsigned count[StackLayerLast + 1] = { 0, };
+	Bool docksel = isdock(sel);
 	Client *c;
+	int l;
 
 	XPRINTF("%s\n", "RESTACKING: -------------------------------------");
-	for (s.n = 0, c = scr->stack; c; c = c->snext, s.n++)
+	for (s->n = 0, c = scr->stack; c; c = c->snext, s->n++)
 		c->breadcrumb = 0;
-	if (!s.n) {
+	if (!s->n) {
 		ewmh_update_net_client_list_stacking();
 		return False;
 	}
-	s.ol = ecalloc(s.n, sizeof(*s.ol));
-	s.cl = ecalloc(s.n, sizeof(*s.cl));
-	s.sl = ecalloc(s.n, sizeof(*s.sl));
-	s.wl = ecalloc(s.n, sizeof(*s.wl));
-
-	for (s.i = 0, s.j = 0, c = scr->stack; c;
-	     s.ol[s.i] = s.cl[s.i] = c, s.i++, c = c->snext) ;
+	stack_reserve(s, max(s->n, scr->stacked.n));
 
-	/* 1. Global modal windows (if any). */
-	if (window_stack.modal_transients) {
-		for (s.i = 0; s.i < s.n; s.i++) {
-			if (!(c = s.cl[s.i]))
-				continue;
-			if (c->is.modal == ModalSystem)
-				stack_clients(&s, c);
-		}
+	/* classify into layers with a counting sort that keeps stacking order */
+	for (s->i = 0, s->j = 0, c = scr->stack; c; s->i++, c = c->snext) {
+		s->ol[s->i] = s->cl[s->i] = c;
+		s->layer[s->i] = l = stack_layer(c, docksel);
+		assert(l >= 0);
+		count[l + 1]++;
 	}
-	/* 2. Focused windows with state _NET_WM_STATE_FULLSCREEN (but not type Desk) */
-	for (s.i = 0; s.i < s.n; s.i++) {
-		if (!(c = s.cl[s.i]))
-			continue;
-		if (WTCHECK(c, WindowTypeDesk))
-			continue;
-		if (took == c && c->is.full)
-			stack_clients(&s, c);
-	}
-	/* 3. Dockapps when a dockapp is selected and docks when selected. */
-	if (isdock(sel)) {
-		for (s.i = 0; s.i < s.n; s.i++) {
-			if (!(c = s.cl[s.i]))
-				continue;
-			if (isdock(c))
-				stack_clients(&s, c);
-		}
-	}
-	/* 4. Window with type Dock and not state Below and windows with state Above. */
-	for (s.i = 0; s.i < s.n; s.i++) {
-		if (!(c = s.cl[s.i]))
-			continue;
-		if (WTCHECK(c, WindowTypeDesk))
-			continue;
-		if (isdock(c) || c->is.below)
-			continue;
-		if (WTCHECK(c, WindowTypeDock) || WTCHECK(c, WindowTypeSplash)
-		    || c->is.above)
-			stack_clients(&s, c);
-	}
-	/* 5. Windows (other than Desk or Dock) without state Below. */
-	/* floating above */
-	for (s.i = 0; s.i < s.n; s.i++) {
-		if (!(c = s.cl[s.i]))
-			continue;
-		if (WTCHECK(c, WindowTypeDesk))
-			continue;
-		if ((WTCHECK(c, WindowTypeDock) || c->is.dockapp))
-			continue;
-		if (c->is.below)
-			continue;
-		if (isfloater(c))
-			stack_clients(&s, c);
-	}
-	/* tiled below */
-	for (s.i = 0; s.i < s.n; s.i++) {
-		if (!(c = s.cl[s.i]))
-			continue;
-		if (WTCHECK(c, WindowTypeDesk))
-			continue;
-		if ((WTCHECK(c, WindowTypeDock) || c->is.dockapp))
-			continue;
-		if (c->is.below)
-			continue;
-		if (!isfloater(c))
-			stack_clients(&s, c);
-	}
-	/** 6. Windows with state Below (but not type Desk) and Dock not already stacked */
-	for (s.i = 0; s.i < s.n; s.i++) {
-		if (!(c = s.cl[s.i]))
-			continue;
-		if (WTCHECK(c, WindowTypeDesk))
-			continue;
-		if (isbar(c) || c->is.below)
-			stack_clients(&s, c);
-	}
-	/** 7. Windows with type Desk. **/
-	for (s.i = 0; s.i < s.n; s.i++) {
-		if (!(c = s.cl[s.i]))
-			continue;
-		if (WTCHECK(c, WindowTypeDesk))
-			stack_clients(&s, c);
+	for (l = 0; l < StackLayerLast; l++)
+		count[l + 1] += count[l];
+	for (s->i = 0; s->i < s->n; s->i++)
+		s->order[count[s->layer[s->i]]++] = s->i;
+
+	for (l = 0; l < (int) s->n; l++) {
+		s->i = s->order[l];
+		if ((c = s->cl[s->i]))
+			stack_clients(s, c);
 	}
-	assert(s.j == s.n);
-	free(s.cl);
-	s.cl = NULL;
+	assert(s->j == s->n);
 
-	if (bcmp(s.ol, s.sl, s.n * sizeof(*s.ol))) {
+	if (bcmp(s->ol, s->sl, s->n * sizeof(*s->ol))) {
 		XPRINTF("%s", "Old stacking order:\n");
 		for (c = scr->stack; c; c = c->snext)
 			XPRINTF("client frame 0x%08lx win 0x%08lx name %s%s\n",
 				c->frame, c->win, c->name,
 				c->is.bastard ? " (bastard)" : "");
-		scr->stack = s.sl[0];
-		for (s.i = 0; s.i < s.n - 1; s.i++)
-			s.sl[s.i]->snext = s.sl[s.i + 1];
-		s.sl[s.i]->snext = NULL;
+		scr->stack = s->sl[0];
+		scr->numbered = False;
+		for (s->i = 0; s->i < s->n - 1; s->i++)
+			s->sl[s->i]->snext = s->sl[s->i + 1];
+		s->sl[s->i]->snext = NULL;
 		XPRINTF("%s", "New stacking order:\n");
 		for (c = scr->stack; c; c = c->snext)
 			XPRINTF("client frame 0x%08lx win 0x%08lx name %s%s\n",
@@ -2770,25 +3084,22 @@ restack()
 	} else {
 		XPRINTF("%s", "No new stacking order\n");
 	}
-	free(s.ol);
-	s.ol = NULL;
-	free(s.sl);
-	s.sl = NULL;
-
-	if (!window_stack.members || (window_stack.count != s.n) ||
-	    bcmp(window_stack.members, s.wl, s.n * sizeof(*s.wl))) {
-		free(window_stack.members);
-		window_stack.members = s.wl;
-		window_stack.count = s.n;
 
-		XRestackWindows(dpy, s.wl, s.n);
+	if (!scr->stacked.wl || (scr->stacked.n != s->n) ||
+	    bcmp(scr->stacked.wl, s->wl, s->n * sizeof(*s->wl))) {
+		stack_send(s, scr->stacked.wl, scr->stacked.n);
+		/* remember the order sent for the next diff */
+		if (scr->stacked.size < s->n) {
+			scr->stacked.size = s->size;
+			scr->stacked.wl = erealloc(scr->stacked.wl, scr->stacked.size * sizeof(Window));
+		}
+		memcpy(scr->stacked.wl, s->wl, s->n * sizeof(Window));
+		scr->stacked.n = s->n;
 
 		ewmh_update_net_client_list_stacking();
 		return True;
 	} else {
 		XPRINTF("%s", "No new stacking order\n");
-		free(s.wl);
-		s.wl = NULL;
 		return False;
 	}
 }
@@ -2878,10 +3189,12 @@ client_occludes(Client *c, Client *o)
 static Bool
 client_occludes_any(Client *c)
 {
-	Client *s;
+	Client **found;
+	unsigned i, n;
 
-	for (s = c->snext; s; s = s->snext)
-		if (client_overlap(c, s))
+	n = stackedclients(scr, c->c.x, c->c.y, c->c.x + c->c.w, c->c.y + c->c.h, &found);
+	for (i = 0; i < n; i++)
+		if (found[i]->stackpos > c->stackpos && client_overlap(c, found[i]))
 			return True;
 	return False;
 }
@@ -2889,10 +3202,12 @@ client_occludes_any(Client *c)
 static Bool
 client_occluded_any(Client *c)
 {
-	Client *s;
+	Client **found;
+	unsigned i, n;
 
-	for (s = scr->stack; s && s != c; s = s->next)
-		if (client_overlap(c, s))
+	n = stackedclients(scr, c->c.x, c->c.y, c->c.x + c->c.w, c->c.y + c->c.h, &found);
+	for (i = 0; i < n && found[i]->stackpos < c->stackpos; i++)
+		if (client_overlap(c, found[i]))
 			return True;
 	return False;
 }
@@ -3023,8 +3338,8 @@ restack_client(Client *c, int stack_mode, Client *o)
 	default:
 		return;
 	}
-	if (restack())
-		focuslockclient(NULL);
+	scr->numbered = False;
+	needrestack();
 }
 
 void
@@ -3041,8 +3356,7 @@ toggleabove(Client *c)
 		return;
 	c->is.above = !c->is.above;
 	if (c->is.managed) {
-		if (restack())
-			focuslockclient(NULL);
+		needrestack();
 		ewmh_update_net_window_state(c);
 	}
 }
@@ -3054,12 +3368,38 @@ togglebelow(Client *c)
 		return;
 	c->is.below = !c->is.below;
 	if (c->is.managed) {
-		if (restack())
-			focuslockclient(NULL);
+		needrestack();
 		ewmh_update_net_window_state(c);
 	}
 }
 
+static void
+arrangenow(View *v)
+{
+	Monitor *m;
+	Workarea wa;
+
+	if (!(m = v->curmon))
+		return;
+	getworkarea(m, &wa);
+	if (scr->options.useveil) {
+		XMoveResizeWindow(dpy, m->veil, wa.x, wa.y, wa.w, wa.h);
+		XMapRaised(dpy, m->veil);
+	}
+	arrangeview(v);
+	if (scr->options.useveil) {
+		XUnmapWindow(dpy, m->veil);
+	}
+}
+
+/** @brief - schedule arrangement of a view
+  *
+  * Arrangement is deferred: the view (or the current view of each monitor when
+  * @v is NULL) is only marked.  The layout, restack, client lists and per-client
+  * _NET_WM_STATE are all brought up to date once by arrangeneeded(), which is
+  * called when the event queue drains, before focusing, and by interactive
+  * loops that do not return to the main loop.
+  */
 void
 arrange(View *ov)
 {
@@ -3068,23 +3408,10 @@ arrange(View *ov)
 	if (!ov) {
 		for (m = scr->monitors; m; m = m->next) {
 			assert(m->curview != NULL);
-			arrange(m->curview);
+			needarrange(m->curview);
 		}
-	} else if ((m = ov->curmon)) {
-		Workarea wa;
-
-		getworkarea(m, &wa);
-		if (scr->options.useveil) {
-			XMoveResizeWindow(dpy, m->veil, wa.x, wa.y, wa.w, wa.h);
-			XMapRaised(dpy, m->veil);
-		}
-		arrangeview(ov);
-		restack();
-		if (scr->options.useveil) {
-			XUnmapWindow(dpy, m->veil);
-		}
-		focuslockclient(NULL);
-	}
+	} else
+		needarrange(ov);
 }
 
 void
@@ -3099,18 +3426,48 @@ needarrange(View *v)
 		v->needarrange = True;
 }
 
+void
+needrestack(void)
+{
+	scr->dirty.restack = True;
+}
+
 void
 arrangeneeded(void)
 {
+	static Bool flushing = False;
+	Bool restacked = False;
 	unsigned i;
 	View *v;
 
+	if (flushing)
+		return;
+	flushing = True;
 	for (v = scr->views, i = 0; i < scr->ntags; i++, v++) {
 		if (v->needarrange) {
-			arrange(v);
 			v->needarrange = False;
+			if (v->curmon) {
+				arrangenow(v);
+				scr->dirty.restack = True;
+			}
 		}
 	}
+	if (scr->dirty.restack) {
+		scr->dirty.restack = False;
+		if (restack())
+			restacked = True;
+	}
+	if (pending_states) {
+		Client *c;
+
+		for (c = scr->clients; c; c = c->next)
+			if (c->needstate)
+				ewmh_flush_net_window_state(c);
+	}
+	ewmh_flush_net_client_lists();
+	if (restacked)
+		focuslockclient(NULL);
+	flushing = False;
 }
 
 Arrangement arrangement_FLOAT = {
@@ -3179,8 +3536,7 @@ raiseclient(Client *c)
 {
 	detachstack(c);
 	attachstack(c, True);
-	if (restack())
-		focuslockclient(NULL);
+	needrestack();
 }
 
 void
@@ -3188,8 +3544,7 @@ lowerclient(Client *c)
 {
 	detachstack(c);
 	attachstack(c, False);
-	if (restack())
-		focuslockclient(NULL);
+	needrestack();
 }
 
 void
@@ -3440,31 +3795,31 @@ reparentclient(Client *c, AScreen *new_scr, int x, int y)
 		delclient(c);
 		ewmh_del_client(c, CauseReparented);
 		if (c->title)
-			XDeleteContext(dpy, c->title, context[ScreenContext]);
+			winmap_delete(c->title, ScreenContext);
 		if (c->grips)
-			XDeleteContext(dpy, c->grips, context[ScreenContext]);
+			winmap_delete(c->grips, ScreenContext);
 		if (c->tgrip) {
-			XDeleteContext(dpy, c->tgrip, context[ScreenContext]);
-			XDeleteContext(dpy, c->lgrip, context[ScreenContext]);
-			XDeleteContext(dpy, c->rgrip, context[ScreenContext]);
+			winmap_delete(c->tgrip, ScreenContext);
+			winmap_delete(c->lgrip, ScreenContext);
+			winmap_delete(c->rgrip, ScreenContext);
 		}
-		XDeleteContext(dpy, c->frame, context[ScreenContext]);
-		XDeleteContext(dpy, c->win, context[ScreenContext]);
+		winmap_delete(c->frame, ScreenContext);
+		winmap_delete(c->win, ScreenContext);
 		XUnmapWindow(dpy, c->frame);
 		c->is.managed = False;
 		scr = new_scr;
 		/* some of what manage() does */
 		if (c->title)
-			XSaveContext(dpy, c->title, context[ScreenContext], (XPointer) scr);
+			winmap_save(c->title, ScreenContext, scr);
 		if (c->grips)
-			XSaveContext(dpy, c->grips, context[ScreenContext], (XPointer) scr);
+			winmap_save(c->grips, ScreenContext, scr);
 		if (c->tgrip) {
-			XSaveContext(dpy, c->tgrip, context[ScreenContext], (XPointer) scr);
-			XSaveContext(dpy, c->lgrip, context[ScreenContext], (XPointer) scr);
-			XSaveContext(dpy, c->rgrip, context[ScreenContext], (XPointer) scr);
+			winmap_save(c->tgrip, ScreenContext, scr);
+			winmap_save(c->lgrip, ScreenContext, scr);
+			winmap_save(c->rgrip, ScreenContext, scr);
 		}
-		XSaveContext(dpy, c->frame, context[ScreenContext], (XPointer) scr);
-		XSaveContext(dpy, c->win, context[ScreenContext], (XPointer) scr);
+		winmap_save(c->frame, ScreenContext, scr);
+		winmap_save(c->win, ScreenContext, scr);
 		if (!(v = getview(x, y)))
 			v = nearview();
 		c->tags = (1ULL << v->index);
@@ -3698,6 +4053,114 @@ findcorner_move(Client *c, int x_root, int y_root)
 	return (from);
 }
 
+/*
+ * Interactive moves and resizes apply at most one geometry update per frame.
+ * Pointer motion read within a frame is merged into the next update.  When
+ * resizing a client that supports _NET_WM_SYNC_REQUEST, updates also wait for
+ * the client to acknowledge the last size (for up to SYNCFRAMES frames)
+ * rather than synchronizing with the server on every motion, and the frame
+ * interval is stretched to the client's measured answer latency.
+ */
+typedef struct {
+	struct timeval next;		/* when the next frame is due */
+	struct timeval first;		/* when the oldest merged motion was read */
+	unsigned long interval;		/* frame interval (usec) */
+	unsigned missed;		/* frames missed waiting for the client */
+	Bool pending;			/* merged motion waiting for the next frame */
+	XEvent motion;			/* the latest merged motion */
+} FramePacer;
+
+#define SYNCFRAMES	4
+#define SYNCFRAME	100000	/* slowest frame interval (usec) for slow clients */
+
+MoveStats movestats = { 0, };
+
+static void
+pacer_init(FramePacer *fp, View *v)
+{
+	if (scr->options.framerate > 0)
+		fp->interval = 1000000 / scr->options.framerate;
+	else if (v && v->curmon && v->curmon->frame)
+		fp->interval = v->curmon->frame;
+	else
+		fp->interval = 1000000 / FRAMERATE;
+	gettimeofday(&fp->next, NULL);
+	fp->missed = 0;
+	fp->pending = False;
+}
+
+/*
+ * Like XIfEvent(), but motion is only returned once per frame.  Button events
+ * flush merged motion ahead of themselves so that a drag ends where the
+ * pointer was released.
+ */
+static void
+pacer_event(FramePacer *fp, Client *c, XEvent *ev, Bool resizing,
+	    Bool (*predicate) (Display *, XEvent *, XPointer))
+{
+	struct pollfd pfd = { .fd = ConnectionNumber(dpy), .events = POLLIN, };
+	struct timeval now, due, frame;
+	unsigned long usec = fp->interval;
+	int timeout;
+
+	/* do not resize faster than the client can keep up with */
+	if (resizing && c->sync.alarm && c->sync.latency > usec)
+		usec = (c->sync.latency < SYNCFRAME) ? c->sync.latency : SYNCFRAME;
+	frame.tv_sec = usec / 1000000;
+	frame.tv_usec = usec % 1000000;
+
+	for (;;) {
+		if (XCheckIfEvent(dpy, ev, predicate, (XPointer) c)) {
+			if (ev->type == MotionNotify) {
+				movestats.motions++;
+				if (!fp->pending)
+					gettimeofday(&fp->first, NULL);
+				fp->pending = True;
+				fp->motion = *ev;
+				continue;
+			}
+			if (fp->pending && (ev->type == ButtonPress || ev->type == ButtonRelease)) {
+				XPutBackEvent(dpy, ev);
+				break;
+			}
+			return;
+		}
+		if (fp->pending) {
+			gettimeofday(&now, NULL);
+			if (!timercmp(&now, &fp->next, <)) {
+				if (!resizing || !c->sync.waiting || fp->missed >= SYNCFRAMES)
+					break;
+				/* client has not caught up: skip this frame */
+				movestats.dropped++;
+				fp->missed++;
+				timeradd(&now, &frame, &fp->next);
+				continue;
+			}
+			timersub(&fp->next, &now, &due);
+			timeout = (due.tv_sec * 1000000 + due.tv_usec + 999) / 1000;
+		} else
+			timeout = -1;
+		XFlush(dpy);
+		if (poll(&pfd, 1, timeout) == -1 && errno != EINTR && errno != EAGAIN) {
+			EPRINTF("poll: %s\n", strerror(errno));
+			XIfEvent(dpy, ev, predicate, (XPointer) c);
+			XPutBackEvent(dpy, ev);
+		}
+	}
+	/* deliver the merged motion as this frame */
+	gettimeofday(&now, NULL);
+	timersub(&now, &fp->first, &due);
+	usec = due.tv_sec * 1000000 + due.tv_usec;
+	movestats.frames++;
+	movestats.latency += usec;
+	if (usec > movestats.maxlatency)
+		movestats.maxlatency = usec;
+	timeradd(&now, &frame, &fp->next);
+	fp->missed = 0;
+	fp->pending = False;
+	*ev = fp->motion;
+}
+
 static Bool
 ismoveevent(Display *display __attribute__((unused)), XEvent *event, XPointer arg __attribute__((unused)))
 {
@@ -3868,6 +4331,7 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 	Bool moved = False, x_snapped = False, y_snapped = False, isfloater;
 	IsUnion was = {.is = 0 };
 	long data[5] = { 0, };
+	FramePacer fp;
 
 	x_root = e->xbutton.x_root;
 	y_root = e->xbutton.y_root;
@@ -3921,17 +4385,16 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 	XChangeProperty(dpy, c->win, _XA_NET_WM_MOVING, XA_CARDINAL, 32,
 			PropModeReplace, (unsigned char *) data, 5);
 
+	pacer_init(&fp, v);
 	for (;;) {
 		Bool sl, sr, st, sb;
 		int snap;
 		Client *s;
 		XEvent ev;
 
-		XIfEvent(dpy, &ev, &ismoveevent, (XPointer) c);
-		if (ev.type == MotionNotify) {
-			XSync(dpy, False);
-			while (XCheckMaskEvent(dpy, PointerMotionMask, &ev)) ;
-		}
+		/* the main loop does not run while we are grabbed */
+		arrangeneeded();
+		pacer_event(&fp, c, &ev, False, &ismoveevent);
 		geteventscr(&ev);
 
 		switch (ev.type) {
@@ -3959,7 +4422,6 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 			handle_event(&ev);
 			continue;
 		case MotionNotify:
-			XSync(dpy, False);
 			dx = (ev.xmotion.x_root - x_root);
 			dy = (ev.xmotion.y_root - y_root);
 			pushtime(ev.xmotion.time);
@@ -3987,6 +4449,7 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 						   ev.xmotion.y_root))) {
 					swapstacked(c, s);
 					arrange(v);
+					arrangeneeded();
 				}
 				/* move center to new position */
 				n = c->c;
@@ -4121,6 +4584,8 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 							int wayc = wa.y + wa.h / 2;
 							Bool x_snapping = False;
 							Bool y_snapping = False;
+							Client **near;
+							unsigned k, nnear;
 
 							if (!x_snapped)
 								data[0] = n.x + n.w / 2 + c->c.b;
@@ -4152,9 +4617,13 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 								n.x += waxc - nx2;
 								data[0] = waxc;
 							} else {
-								for (s = event_scr->stack; s && !x_snapping; s = s->snext) {
-									int sx2 = s->c.x + s->c.w + 2 * s->c.b;
-									int sy2 = s->c.y + s->c.h + 2 * s->c.b;
+								nnear = stackedclients(event_scr, n.x - snap, n.y, nx2 + snap, ny2, &near);
+								for (k = 0; k < nnear && !x_snapping; k++) {
+									int sx2, sy2;
+
+									s = near[k];
+									sx2 = s->c.x + s->c.w + 2 * s->c.b;
+									sy2 = s->c.y + s->c.h + 2 * s->c.b;
 
 									if (s == c)
 										continue;
@@ -4174,9 +4643,12 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 										break;
 									}
 								}
-								for (s = event_scr->stack; s && !x_snapping; s = s->snext) {
-									int sx2 = s->c.x + s->c.w + 2 * s->c.b;
-									int sy2 = s->c.y + s->c.h + 2 * s->c.b;
+								for (k = 0; k < nnear && !x_snapping; k++) {
+									int sx2, sy2;
+
+									s = near[k];
+									sx2 = s->c.x + s->c.w + 2 * s->c.b;
+									sy2 = s->c.y + s->c.h + 2 * s->c.b;
 
 									if (s == c)
 										continue;
@@ -4222,9 +4694,14 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 								n.y += wayc - ny2;
 								data[1] = wayc;
 							} else {
-								for (s = event_scr->stack; s && !y_snapping; s = s->snext) {
-									int sx2 = s->c.x + s->c.w + 2 * s->c.b;
-									int sy2 = s->c.y + s->c.h + 2 * s->c.b;
+								nnear = stackedclients(event_scr, min(n.x, nx2), n.y - snap,
+										       max(n.x, nx2), ny2 + snap, &near);
+								for (k = 0; k < nnear && !y_snapping; k++) {
+									int sx2, sy2;
+
+									s = near[k];
+									sx2 = s->c.x + s->c.w + 2 * s->c.b;
+									sy2 = s->c.y + s->c.h + 2 * s->c.b;
 
 									if (s == c)
 										continue;
@@ -4244,9 +4721,12 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 										break;
 									}
 								}
-								for (s = event_scr->stack; s && !y_snapping; s = s->snext) {
-									int sx2 = s->c.x + s->c.w + 2 * s->c.b;
-									int sy2 = s->c.y + s->c.h + 2 * s->c.b;
+								for (k = 0; k < nnear && !y_snapping; k++) {
+									int sx2, sy2;
+
+									s = near[k];
+									sx2 = s->c.x + s->c.w + 2 * s->c.b;
+									sy2 = s->c.y + s->c.h + 2 * s->c.b;
 
 									if (s == c)
 										continue;
@@ -4297,6 +4777,7 @@ mousemove_from(Client *c, int from, XEvent *e, Bool toggle)
 				drawclient(c);
 				ewmh_update_net_window_extents(c);
 				arrange(NULL);
+				arrangeneeded();
 				v = nv;
 			}
 			if (!isfloater || (!c->is.max && !c->is.lhalf && !c->is.rhalf)) {
@@ -4506,6 +4987,7 @@ mouseresize_from(Client *c, int from, XEvent *e, Bool toggle)
 	Bool resized = False, x_snapped = False, y_snapped = False;
 	IsUnion was = {.is = 0 };
 	long data[5] = { 0, };
+	FramePacer fp;
 
 	x_root = e->xbutton.x_root;
 	y_root = e->xbutton.y_root;
@@ -4544,17 +5026,16 @@ mouseresize_from(Client *c, int from, XEvent *e, Bool toggle)
 	XChangeProperty(dpy, c->win, _XA_NET_WM_RESIZING, XA_CARDINAL, 32,
 			PropModeReplace, (unsigned char *) data, 5);
 
+	pacer_init(&fp, v);
 	for (;;) {
 		Bool sl, st, sr, sb;
 		int snap;
 		Client *s;
 		XEvent ev;
 
-		XIfEvent(dpy, &ev, &isresizeevent, (XPointer) c);
-		if (ev.type == MotionNotify) {
-			XSync(dpy, False);
-			while (XCheckMaskEvent(dpy, PointerMotionMask, &ev)) ;
-		}
+		/* the main loop does not run while we are grabbed */
+		arrangeneeded();
+		pacer_event(&fp, c, &ev, True, &isresizeevent);
 		geteventscr(&ev);
 
 		switch (ev.type) {
@@ -4583,7 +5064,6 @@ mouseresize_from(Client *c, int from, XEvent *e, Bool toggle)
 		case MotionNotify:
 			if (event_scr != scr)
 				continue;
-			XSync(dpy, False);
 			dx = (ev.xmotion.x_root - x_root);
 			dy = (ev.xmotion.y_root - y_root);
 			pushtime(ev.xmotion.time);
@@ -5519,12 +5999,27 @@ place_geom(Client *c)
 	return &c->r;
 }
 
+/* whether a placement overlaps any of the windows in the grid */
+static Bool
+place_blocked(const Grid *grid, ClientGeometry *g)
+{
+	void **found;
+	unsigned i, n;
+
+	n = grid_query(grid, g->x, g->y, g->x + g->w, g->y + g->h, &found);
+	for (i = 0; i < n; i++)
+		if (place_overlap(g, found[i]))
+			return True;
+	return False;
+}
+
 static void
 place_smart(Client *c, WindowPlacement p, ClientGeometry *g, View *v, Workarea *w)
 {
 	Client *s;
-	ClientGeometry **stack = NULL, **unobs, *e, *o;
-	unsigned int num, i, j;
+	ClientGeometry **stack, *e;
+	unsigned int num, i;
+	Grid grid = { 0, };
 
 	/* XXX: this algorithm is smarter than the old place_smart: it first determines
 	   the top layer of windows by determining which windows are not obscured by any
@@ -5538,46 +6033,31 @@ place_smart(Client *c, WindowPlacement p, ClientGeometry *g, View *v, Workarea *
 
 	/* find all placeable windows in stacking order */
 	for (num = 0, s = nextplaced(c, scr->stack, v); s;
-	     num++, s = nextplaced(c, s->snext, v)) {
-		stack = erealloc(stack, (num + 1) * sizeof(*stack));
+	     num++, s = nextplaced(c, s->snext, v)) ;
+	stack = ecalloc(num + 1, sizeof(*stack));
+	for (num = 0, s = nextplaced(c, scr->stack, v); s;
+	     num++, s = nextplaced(c, s->snext, v))
 		stack[num] = place_geom(s);
-	}
 	XPRINTF("There are %d stacked windows\n", num);
 
-	unobs = ecalloc(num, sizeof(*unobs));
-	memcpy(unobs, stack, num * sizeof(*unobs));
-
-	/* nulls all occluded windows */
-	for (i = 0; i < num; i++)
-		if ((e = stack[i]))
-			for (j = i + 1; j < num; j++)
-				if ((o = unobs[j]) && place_overlap(e, o))
-					unobs[j] = NULL;
+	/* keep windows from the top of the stack down to the first one that is
+	   occluded by a window above it; the grid indexes the windows kept */
+	grid_init(&grid, w->x, w->y, w->w, w->h);
+	for (i = 0; i < num && !place_blocked(&grid, stack[i]); i++)
+		grid_insert(&grid, stack[i], stack[i]->x, stack[i]->y,
+			    stack[i]->x + stack[i]->w, stack[i]->y + stack[i]->h);
 
-	/* collect non-nulls to the start */
-	for (i = 0, j = 0; i < num; i++) {
-		if (!(e = unobs[i]))
-			break;
-		stack[j++] = e;
-	}
+	XPRINTF("There are %d unoccluded windows\n", i);
 
-	free(unobs);
-	unobs = NULL;
-
-	XPRINTF("There are %d unoccluded windows\n", j);
-
-	assert(j > 0 || num == 0);	/* first window always unoccluded */
-	num = j;
+	assert(i > 0 || num == 0);	/* first window always unoccluded */
+	num = i;
 
 	g->x = w->x;
 	g->y = w->y;
 
 	/* if northwest placement works, go with it */
-	for (i = 0; i < num && !place_overlap(g, stack[i]); i++) ;
-	if (i == num) {
-		free(stack);
-		return;
-	}
+	if (!place_blocked(&grid, g))
+		goto done;
 
 	switch (p) {
 	case RowSmartPlacement:
@@ -5618,13 +6098,10 @@ place_smart(Client *c, WindowPlacement p, ClientGeometry *g, View *v, Workarea *
 					g->y);
 				continue;
 			}
-			for (j = 0; j < num && !place_overlap(g, stack[j]);
-			     j++) ;
-			if (j == num) {
+			if (!place_blocked(&grid, g)) {
 				XPRINTF("below: %dx%d+%d+%d good\n", g->w, g->h, g->x,
 					g->y);
-				free(stack);
-				return;
+				goto done;
 			}
 			XPRINTF("below: %dx%d+%d+%d no good\n", g->w, g->h, g->x, g->y);
 		}
@@ -5640,13 +6117,10 @@ place_smart(Client *c, WindowPlacement p, ClientGeometry *g, View *v, Workarea *
 					g->y);
 				continue;
 			}
-			for (j = 0; j < num && !place_overlap(g, stack[j]);
-			     j++) ;
-			if (j == num) {
+			if (!place_blocked(&grid, g)) {
 				XPRINTF("right: %dx%d+%d+%d good\n", g->w, g->h, g->x,
 					g->y);
-				free(stack);
-				return;
+				goto done;
 			}
 			XPRINTF("right: %dx%d+%d+%d no good\n", g->w, g->h, g->x, g->y);
 		}
@@ -5667,13 +6141,10 @@ place_smart(Client *c, WindowPlacement p, ClientGeometry *g, View *v, Workarea *
 					g->y);
 				continue;
 			}
-			for (j = 0; j < num && !place_overlap(g, stack[j]);
-			     j++) ;
-			if (j == num) {
+			if (!place_blocked(&grid, g)) {
 				XPRINTF("right: %dx%d+%d+%d good\n", g->w, g->h, g->x,
 					g->y);
-				free(stack);
-				return;
+				goto done;
 			}
 			XPRINTF("right: %dx%d+%d+%d no good\n", g->w, g->h, g->x, g->y);
 		}
@@ -5689,13 +6160,10 @@ place_smart(Client *c, WindowPlacement p, ClientGeometry *g, View *v, Workarea *
 					g->y);
 				continue;
 			}
-			for (j = 0; j < num && !place_overlap(g, stack[j]);
-			     j++) ;
-			if (j == num) {
+			if (!place_blocked(&grid, g)) {
 				XPRINTF("below: %dx%d+%d+%d good\n", g->w, g->h, g->x,
 					g->y);
-				free(stack);
-				return;
+				goto done;
 			}
 			XPRINTF("below: %dx%d+%d+%d no good\n", g->w, g->h, g->x, g->y);
 		}
@@ -5716,20 +6184,197 @@ place_smart(Client *c, WindowPlacement p, ClientGeometry *g, View *v, Workarea *
 		g->y = w->y;
 	if (g->x + g->w > w->x + w->w && g->x > w->x)
 		g->x = w->x;
-
+      done:
+	grid_free(&grid);
 	free(stack);
-	return;
+}
+
+static int
+qsort_coord(const void *a, const void *b)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+/* sort the candidate coordinates, clamp them to [lo, hi] and drop duplicates */
+static unsigned
+place_coords(int *v, unsigned n, int lo, int hi)
+{
+	unsigned i, k;
+
+	for (i = 0; i < n; i++)
+		v[i] = max(lo, min(v[i], hi));
+	qsort(v, n, sizeof(*v), &qsort_coord);
+	for (i = k = 0; i < n; i++)
+		if (!k || v[i] != v[k - 1])
+			v[k++] = v[i];
+	return k;
+}
+
+/*
+ * Overlap of placed windows within a horizontal strip, swept one candidate row
+ * at a time.  Across the strip each window covers its vertical overlap with it
+ * over its width, so the covered area left of a point is piecewise linear with
+ * breaks at the window x edges: the strip holds its value and slope at each
+ * edge, and the overlap of a candidate is the difference between its sides.
+ */
+typedef struct {
+	int *xs;			/* distinct window x edges, ascending */
+	unsigned n;
+	long *rate;			/* covered height right of each edge */
+	unsigned long *sum;		/* covered area left of each edge */
+} Strip;
+
+/* index of the last edge at or before v, or -1 when v is before them all */
+static int
+strip_edge(const Strip *st, int v)
+{
+	int lo = 0, hi = (int) st->n - 1, mid;
+
+	if (!st->n || v < st->xs[0])
+		return -1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (st->xs[mid] <= v)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
 }
 
+static void
+strip_sweep(Strip *st, ClientGeometry **geoms, const int *edges, unsigned num, int y1, int y2)
+{
+	ClientGeometry *o;
+	unsigned k;
+	long h, rate = 0;
+	unsigned long sum = 0;
+
+	memset(st->rate, 0, st->n * sizeof(*st->rate));
+	for (k = 0; k < num; k++) {
+		o = geoms[k];
+		h = min(y2, o->y + o->h + 2 * o->b) - max(y1, o->y);
+		if (h > 0) {
+			st->rate[edges[2 * k]] += h;
+			st->rate[edges[2 * k + 1]] -= h;
+		}
+	}
+	for (k = 0; k < st->n; k++) {
+		st->sum[k] = sum;
+		st->rate[k] = (rate += st->rate[k]);
+		if (k + 1 < st->n)
+			sum += (unsigned long) rate * (st->xs[k + 1] - st->xs[k]);
+	}
+}
+
+/* covered area left of x, where e is strip_edge() of x */
+static unsigned long
+strip_left(const Strip *st, int x, int e)
+{
+	if (e < 0)
+		return 0;
+	return st->sum[e] + (unsigned long) st->rate[e] * (x - st->xs[e]);
+}
+
+/*
+ * Minimum overlap placement.  The overlap is bilinear between the positions at
+ * which a side of the new window meets an edge of a placed window, so its
+ * minimum lies on one of them: every x at which the left or right side meets a
+ * window's left or right edge is tried with every such y, clamped to the work
+ * area, along with the work area corners.  That is O(n^2) candidates for n
+ * windows; each row of them is scored in O(n) from one strip sweep, which makes
+ * each candidate constant time.  Candidates are tried top to bottom, left to
+ * right, so ties go to the top-left and the first free position ends the
+ * search.
+ */
 static void
 place_minoverlap(Client *c, WindowPlacement p, ClientGeometry *g, View *v, Workarea *w)
 {
-	/* TODO: write this */
-	(void) c;
+	Client *s;
+	ClientGeometry *o, **geoms;
+	Strip st = { NULL, };
+	int *xs, *ys, *ix, *edges;
+	unsigned num, nx, ny, i, j, k;
+	unsigned long area, best = ULONG_MAX;
+	int W = g->w + 2 * g->b, H = g->h + 2 * g->b;
+	int xmax = max(w->x, w->x + w->w - W);
+	int ymax = max(w->y, w->y + w->h - H);
+	int ox2, oy2;
+
 	(void) p;
-	(void) g;
-	(void) v;
-	(void) w;
+	for (num = 0, s = nextplaced(c, scr->stack, v); s;
+	     num++, s = nextplaced(c, s->snext, v)) ;
+	geoms = ecalloc(num + 1, sizeof(*geoms));
+	xs = ecalloc(4 * num + 2, sizeof(*xs));
+	ys = ecalloc(4 * num + 2, sizeof(*ys));
+	st.xs = ecalloc(2 * num + 1, sizeof(*st.xs));
+
+	nx = ny = k = 0;
+	xs[nx++] = w->x;
+	xs[nx++] = xmax;
+	ys[ny++] = w->y;
+	ys[ny++] = ymax;
+	for (s = nextplaced(c, scr->stack, v); s; s = nextplaced(c, s->snext, v)) {
+		o = place_geom(s);
+		ox2 = o->x + o->w + 2 * o->b;
+		oy2 = o->y + o->h + 2 * o->b;
+		st.xs[2 * k] = o->x;
+		st.xs[2 * k + 1] = ox2;
+		geoms[k++] = o;
+		/* beside the window or aligned with it, on either side */
+		xs[nx++] = o->x - W;
+		xs[nx++] = o->x;
+		xs[nx++] = ox2 - W;
+		xs[nx++] = ox2;
+		ys[ny++] = o->y - H;
+		ys[ny++] = o->y;
+		ys[ny++] = oy2 - H;
+		ys[ny++] = oy2;
+	}
+	/* keep the window inside the work area */
+	nx = place_coords(xs, nx, w->x, xmax);
+	ny = place_coords(ys, ny, w->y, ymax);
+	st.n = place_coords(st.xs, 2 * num, INT_MIN, INT_MAX);
+	st.rate = ecalloc(st.n + 1, sizeof(*st.rate));
+	st.sum = ecalloc(st.n + 1, sizeof(*st.sum));
+
+	/* strip edges of the windows and of the sides of each candidate */
+	edges = ecalloc(2 * num + 1, sizeof(*edges));
+	for (k = 0; k < num; k++) {
+		edges[2 * k] = strip_edge(&st, geoms[k]->x);
+		edges[2 * k + 1] = strip_edge(&st, geoms[k]->x + geoms[k]->w + 2 * geoms[k]->b);
+	}
+	ix = ecalloc(2 * nx, sizeof(*ix));
+	for (i = 0; i < nx; i++) {
+		ix[2 * i] = strip_edge(&st, xs[i]);
+		ix[2 * i + 1] = strip_edge(&st, xs[i] + W);
+	}
+
+	g->x = w->x;
+	g->y = w->y;
+	for (j = 0; j < ny && best; j++) {
+		strip_sweep(&st, geoms, edges, num, ys[j], ys[j] + H);
+		for (i = 0; i < nx && best; i++) {
+			area = strip_left(&st, xs[i] + W, ix[2 * i + 1]) -
+			    strip_left(&st, xs[i], ix[2 * i]);
+			if (area < best) {
+				best = area;
+				g->x = xs[i];
+				g->y = ys[j];
+			}
+		}
+	}
+	XPRINTF("placed %dx%d+%d+%d with overlap %lu among %u windows\n",
+		g->w, g->h, g->x, g->y, best, num);
+
+	free(st.xs);
+	free(st.rate);
+	free(st.sum);
+	free(edges);
+	free(ix);
+	free(geoms);
+	free(xs);
+	free(ys);
 }
 
 static void
@@ -6118,6 +6763,7 @@ addclient(Client *c, Bool choseme, Bool focusme, Bool raiseme)
 	attachalist(c, choseme);
 	attachflist(c, focusme);
 	attachstack(c, raiseme);
+	indexclient(c);
 	ewmh_update_net_client_lists();
 	if (c->is.managed)
 		ewmh_update_net_window_desktop(c);
@@ -6161,6 +6807,7 @@ delclient(Client *c)
 	detachflist(c);
 	detachalist(c);
 	detachstack(c);
+	unindexclient(c);
 	if (c->is.dockapp) {
 		deldockapp(c);
 		return;
@@ -6811,8 +7458,7 @@ togglefull(Client *c)
 	if (c->is.managed) {
 		ewmh_update_net_window_state(c);
 		updatefloat(c, v);
-		if (restack())
-			focuslockclient(NULL);
+		needrestack();
 	}
 }
 
@@ -6827,8 +7473,7 @@ togglemax(Client *c)
 	if (c->is.managed) {
 		ewmh_update_net_window_state(c);
 		updatefloat(c, v);
-		if (restack())
-			focuslockclient(NULL);
+		needrestack();
 	}
 }
 
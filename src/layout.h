@@ -75,6 +75,7 @@ void toggleabove(Client *c);
 void togglebelow(Client *c);
 void arrange(View *v);
 void needarrange(View *v);
+void needrestack(void);
 void arrangeneeded(void);
 void setlayout(const char *arg);
 void raisefloater(Client *c);
@@ -583,11 +583,116 @@ initmodkey()
 	}
 }
 
+/*
+ * Bindings are indexed by keycode and modifier mask whenever the keys are
+ * grabbed.  Chained bindings are indexed by the key they follow (NULL at the
+ * top level), making the table a trie over key sequences, so that each press
+ * is resolved with a single lookup and without translating the keycode.
+ */
+struct KeyBinding {
+	KeyBinding *next;
+	Key *parent;
+	Key *key;
+	unsigned long mod;
+	KeyCode code;
+};
+
+static unsigned
+hashbinding(Key *parent, KeyCode code, unsigned long mod)
+{
+	unsigned long h = (unsigned long) (uintptr_t) parent >> 4;
+
+	h = (h * 31 + code) * 257 + mod;
+	return (h ^ (h >> 16)) & (scr->keymap.size - 1);
+}
+
+static unsigned
+countkeys(Key *k)
+{
+	unsigned n;
+
+	for (n = 0; k; k = k->cnext)
+		n += 1 + countkeys(k->chain);
+	return (n);
+}
+
+static void
+mapchain(Key *parent, Key *k)
+{
+	KeyBinding *b;
+	KeyCode code;
+	unsigned h;
+
+	for (; k; k = k->cnext) {
+		/* a press matches the keysym at the first level of its keycode */
+		k->code = 0;
+		if ((code = XKeysymToKeycode(dpy, k->keysym)) &&
+		    XkbKeycodeToKeysym(dpy, code, 0, 0) == k->keysym) {
+			k->code = code;
+			b = ecalloc(1, sizeof(*b));
+			b->parent = parent;
+			b->key = k;
+			b->mod = k->mod;
+			b->code = code;
+			h = hashbinding(parent, code, k->mod);
+			b->next = scr->keymap.buckets[h];
+			scr->keymap.buckets[h] = b;
+		}
+		mapchain(k, k->chain);
+	}
+}
+
+void
+unmapkeys(void)
+{
+	KeyBinding *b, *next;
+	unsigned h;
+
+	for (h = 0; h < scr->keymap.size; h++) {
+		for (b = scr->keymap.buckets[h]; b; b = next) {
+			next = b->next;
+			free(b);
+		}
+	}
+	free(scr->keymap.buckets);
+	scr->keymap.buckets = NULL;
+	scr->keymap.size = 0;
+}
+
+/** @brief rebuild the binding index from the key list and keyboard mapping
+  */
+void
+mapkeys(void)
+{
+	unsigned n = countkeys(scr->keylist);
+
+	unmapkeys();
+	for (scr->keymap.size = 64; scr->keymap.size < 2 * n; scr->keymap.size <<= 1) ;
+	scr->keymap.buckets = ecalloc(scr->keymap.size, sizeof(*scr->keymap.buckets));
+	mapchain(NULL, scr->keylist);
+}
+
+/** @brief find the binding for a key press following parent (NULL at top level)
+  */
+Key *
+findkey(Key *parent, KeyCode code, unsigned long mod)
+{
+	KeyBinding *b;
+
+	if (!scr->keymap.size)
+		return (NULL);
+	for (b = scr->keymap.buckets[hashbinding(parent, code, mod)]; b; b = b->next)
+		if (b->parent == parent && b->code == code && b->mod == mod)
+			return (b->key);
+	return (NULL);
+}
+
 void
 freekeys(void)
 {
 	Key *k, *knext;
 
+	unmapkeys();
 	knext = scr->keylist;
 	scr->keylist = NULL;
 	while ((k = knext)) {
@@ -1018,44 +1123,278 @@ parserule(const char *s, Rule *r)
 	r->has.set.grips = 1;
 }
 
+/*
+ * Rules are matched against "class:name:role:title".  When compiled, rules
+ * whose prop regex is anchored to a literal class ("^Class:...") are hashed
+ * by that class, and every other rule records the longest literal its regex
+ * requires, so that regexec() only runs on rules that can still match.
+ */
+typedef struct RuleClass RuleClass;
+
+struct RuleClass {
+	RuleClass *next;
+	char *name;
+	unsigned long long rules;	/* rules anchored to this class */
+};
+
+static struct {
+	RuleClass **buckets;
+	unsigned size;
+	unsigned long long anchored;	/* rules with a class prefix */
+	unsigned long long scanned;	/* all other rules with a prop regex */
+} matcher;
+
+static unsigned long long
+hashstring(unsigned long long h, const char *s)
+{
+	for (; *s; s++)
+		h = (h ^ (unsigned char) *s) * 0x100000001b3ULL;
+	return (h);
+}
+
+static RuleClass **
+findruleclass(const char *name)
+{
+	RuleClass **rcp;
+
+	rcp = &matcher.buckets[hashstring(0xcbf29ce484222325ULL, name) & (matcher.size - 1)];
+	for (; *rcp && strcmp((*rcp)->name, name); rcp = &(*rcp)->next) ;
+	return (rcp);
+}
+
+/* literal anchored class of "^Class:rest", setting exact when rest matches anything */
+static char *
+ruleprefix(const char *re, Bool *exact)
+{
+	const char *p;
+	char *prefix;
+
+	if (*re != '^' || strchr(re, '|'))
+		return (NULL);
+	for (p = re + 1; *p && *p != ':' && !strchr(".[]()*+?{}^$\\", *p); p++) ;
+	if (*p != ':' || p == re + 1 || (p[1] && strchr("*+?{", p[1])))
+		return (NULL);
+	prefix = ecalloc(p - re, sizeof(*prefix));
+	memcpy(prefix, re + 1, p - re - 1);
+	*exact = (!strcmp(p + 1, "") || !strcmp(p + 1, ".*"));
+	return (prefix);
+}
+
+/* longest literal that every match of an ERE without alternation contains */
+static char *
+ruleliteral(const char *re)
+{
+	char run[128], best[128];
+	size_t n = 0, bn = 0;
+	const char *p;
+
+	if (strpbrk(re, "|()"))
+		return (NULL);
+	for (p = re;; p++) {
+		switch (*p) {
+		case '\\':
+			/* escaped specials are literal; GNU \< \> \b \w etc. are not */
+			if (p[1] && strchr(".[]()*+?{}|^$\\", p[1])) {
+				if (n < sizeof(run) - 1)
+					run[n++] = *++p;
+				continue;
+			}
+			if (p[1])
+				p++;
+			break;
+		case '[':
+			p++;
+			if (*p == '^')
+				p++;
+			if (*p == ']')
+				p++;
+			for (; *p && *p != ']'; p++) {
+				/* [:class:], [=equiv=] and [.coll.] contain a ']' */
+				if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+					const char *q;
+
+					for (q = p + 2; *q && !(q[0] == p[1] && q[1] == ']'); q++) ;
+					if (!*q)
+						return (NULL);
+					p = q + 1;
+				}
+			}
+			if (!*p)
+				return (NULL);
+			break;
+		case '*':
+		case '?':
+		case '{':
+			/* the preceding atom is optional */
+			if (n)
+				n--;
+			if (*p == '{' && !(p = strchr(p, '}')))
+				return (NULL);
+			break;
+		case '+':
+		case '.':
+		case '^':
+		case '$':
+		case '\0':
+			break;
+		default:
+			if (n < sizeof(run) - 1)
+				run[n++] = *p;
+			continue;
+		}
+		if (n > bn) {
+			memcpy(best, run, n);
+			bn = n;
+		}
+		n = 0;
+		if (!*p)
+			break;
+	}
+	if (!bn)
+		return (NULL);
+	best[bn] = '\0';
+	return (strdup(best));
+}
+
 static void
 compileregs(void)
 {
 	int i;
 	regex_t *reg;
+	RuleClass **rcp;
+	Rule *r;
 
+	for (matcher.size = 16; matcher.size < (unsigned) nrules; matcher.size <<= 1) ;
+	matcher.buckets = ecalloc(matcher.size, sizeof(*matcher.buckets));
+	matcher.anchored = matcher.scanned = 0;
 	for (i = 0; i < nrules; i++) {
-		if (rules[i]->prop && strcmp(rules[i]->prop, "NULL")) {
+		r = rules[i];
+		if (r->prop && strcmp(r->prop, "NULL")) {
 			reg = emallocz(sizeof(regex_t));
-			if (regcomp(reg, rules[i]->prop, REG_EXTENDED))
+			if (regcomp(reg, r->prop, REG_EXTENDED))
 				free(reg);
 			else
-				rules[i]->propregex = reg;
+				r->propregex = reg;
 		}
-		if (rules[i]->tags && strcmp(rules[i]->tags, "NULL")) {
+		if (r->tags && strcmp(r->tags, "NULL")) {
 			reg = emallocz(sizeof(regex_t));
-			if (regcomp(reg, rules[i]->tags, REG_EXTENDED))
+			if (regcomp(reg, r->tags, REG_EXTENDED))
 				free(reg);
 			else
-				rules[i]->tagregex = reg;
+				r->tagregex = reg;
+		}
+		if (!r->propregex)
+			continue;
+		if ((r->prefix = ruleprefix(r->prop, &r->exact))) {
+			if (!*(rcp = findruleclass(r->prefix))) {
+				*rcp = ecalloc(1, sizeof(**rcp));
+				(*rcp)->name = strdup(r->prefix);
+			}
+			(*rcp)->rules |= (1ULL << i);
+			matcher.anchored |= (1ULL << i);
+		} else {
+			r->literal = ruleliteral(r->prop);
+			matcher.scanned |= (1ULL << i);
 		}
 	}
 }
 
+/** @brief return the mask of rules whose prop regex matches
+  *
+  * prop is the "class:name:role:title" string of the window and res_class its
+  * class.
+  */
+unsigned long long
+matchrules(const char *res_class, const char *prop)
+{
+	unsigned long long candidates, hashed = 0, matched = 0, bit;
+	RuleClass *rc;
+	regmatch_t tmp;
+	Rule *r;
+	int i;
+
+	if (!nrules || !matcher.buckets)
+		return (0);
+	if ((rc = *findruleclass(res_class)))
+		hashed = rc->rules;
+	candidates = matcher.scanned | hashed;
+	/* a class containing the separator can match prefixes ambiguously */
+	if (strchr(res_class, ':'))
+		candidates |= matcher.anchored;
+	for (i = 0; i < nrules; i++) {
+		if (!(candidates & (bit = 1ULL << i)))
+			continue;
+		r = rules[i];
+		if (r->exact && (hashed & bit)) {
+			matched |= bit;
+			continue;
+		}
+		if (r->literal && !strstr(prop, r->literal))
+			continue;
+		if (!regexec(r->propregex, prop, 1, &tmp, 0))
+			matched |= bit;
+	}
+	return (matched);
+}
+
+/** @brief return the tags of the current screen matched by a rule
+  *
+  * The result is cached against the tag names it was computed for.
+  */
+unsigned long long
+ruletags(Rule *r)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	regmatch_t tmp;
+	unsigned j;
+
+	if (!r->tagregex)
+		return (0);
+	for (j = 0; j < scr->ntags; j++)
+		hash = hashstring(hash, scr->tags[j].name) * 0x100000001b3ULL;
+	if (r->tagcache.ds != scr || r->tagcache.hash != hash) {
+		r->tagcache.ds = scr;
+		r->tagcache.hash = hash;
+		r->tagcache.tags = 0;
+		for (j = 0; j < scr->ntags; j++)
+			if (!regexec(r->tagregex, scr->tags[j].name, 1, &tmp, 0))
+				r->tagcache.tags |= (1ULL << j);
+	}
+	return (r->tagcache.tags);
+}
+
 static void
 freerules(void)
 {
+	RuleClass *rc, *next;
+	unsigned b;
 	int i;
 
+	for (b = 0; b < matcher.size; b++) {
+		for (rc = matcher.buckets[b]; rc; rc = next) {
+			next = rc->next;
+			free(rc->name);
+			free(rc);
+		}
+	}
+	free(matcher.buckets);
+	matcher.buckets = NULL;
+	matcher.size = 0;
 	if (!rules)
 		return;
 	for (i = 0; i < 64; i++) {
 		if (!rules[i])
 			continue;
+		if (rules[i]->propregex)
+			regfree(rules[i]->propregex);
 		free(rules[i]->propregex);
 		rules[i]->propregex = NULL;
+		if (rules[i]->tagregex)
+			regfree(rules[i]->tagregex);
 		free(rules[i]->tagregex);
 		rules[i]->tagregex = NULL;
+		free(rules[i]->prefix);
+		free(rules[i]->literal);
 		free(rules[i]->prop);
 		rules[i]->prop = NULL;
 		free(rules[i]->tags);
@@ -1065,6 +1404,7 @@ freerules(void)
 	}
 	free(rules);
 	rules = NULL;
+	nrules = 0;
 }
 
 void
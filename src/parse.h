@@ -10,8 +10,13 @@ extern char *can_fields[32];
 extern char *with_fields[32];
 
 void initrules(Bool reload);
+unsigned long long matchrules(const char *res_class, const char *prop);
+unsigned long long ruletags(Rule *r);
 void initkeys(Bool reload);
 void freekeys(void);
+void mapkeys(void);
+void unmapkeys(void);
+Key *findkey(Key *parent, KeyCode code, unsigned long mod);
 void parsekeys(const char *s, Key *spec);
 void addchain(Key *chain);
 void freechain(Key *chain);
@@ -997,7 +997,7 @@ render_drawtext(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdr
 {
 	int w, h;
 	char buf[256];
-	unsigned int len, olen;
+	unsigned int len;
 	int gap;
 	XftFont *font = ds->style.font[hilite];
 	struct _FontInfo *info = &ds->dc.font[hilite];
@@ -1008,29 +1008,12 @@ render_drawtext(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdr
 	(void) drawable;	/* XXX */
 	if (!text)
 		return 0;
-	olen = len = strlen(text);
-	w = 0;
-	if (len >= sizeof buf)
-		len = sizeof buf - 1;
-	memcpy(buf, text, len);
-	buf[len] = 0;
 	h = ds->style.titleheight;
 	y = ds->dc.h / 2 + info->ascent / 2 - 1 - ds->style.outline;
 	gap = info->height / 2;
 	x += gap;
 	/* shorten text if necessary */
-	while (len && (w = textnw(ds, buf, len, hilite)) > mw) {
-		buf[--len] = 0;
-	}
-	if (len < olen) {
-		if (len > 1)
-			buf[len - 1] = '.';
-		if (len > 2)
-			buf[len - 2] = '.';
-		if (len > 3)
-			buf[len - 3] = '.';
-	}
-	if (w > mw)
+	if ((w = textfit(ds, text, hilite, mw, buf, sizeof buf, &len)) < 0)
 		return 0;	/* too long */
 	while (x <= 0)
 		x = ds->dc.x++;
@@ -1148,20 +1131,34 @@ render_drawnormal(AScreen *ds, Client *c)
 	ds->dc.x = ds->dc.y = 0;
 	ds->dc.w = c->c.w;
 	ds->dc.h = ds->style.titleheight;
-	if (ds->dc.draw.w < ds->dc.w)
+	if (ds->dc.draw.w < ds->dc.w) {
+		if (ds->dc.draw.pict) {
+			XRenderFreePicture(dpy, ds->dc.draw.pict);
+			ds->dc.draw.pict = None;
+		}
+		if (ds->dc.draw.pixmap)
+			XFreePixmap(dpy, ds->dc.draw.pixmap);
 		ds->dc.draw.w = ds->dc.w;
-
-	/* try freeing the old picture before creating the new one! */
-	if (c->pict.title) {
-		XRenderFreePicture(dpy, c->pict.title);
-		c->pict.title = None;
+		XPRINTF(__CFMTS(c) "creating title pixmap %dx%dx%d\n", __CARGS(c),
+			ds->dc.w, ds->dc.draw.h, ds->depth);
+		ds->dc.draw.pixmap = XCreatePixmap(dpy, ds->root, ds->dc.w,
+						   ds->dc.draw.h, ds->depth);
+		XftDrawChange(ds->dc.draw.xft, ds->dc.draw.pixmap);
+	}
+	/* draw into the back buffer and composite the result in one request */
+	if (!ds->dc.draw.pict &&
+	    !(ds->dc.draw.pict = XRenderCreatePicture(dpy, ds->dc.draw.pixmap, ds->format,
+						       pamask, &pa))) {
+		EPRINTF("could not create back buffer picture\n");
+		return;
 	}
-	if (!(dst = XRenderCreatePicture(dpy, c->title, ds->format, pamask, &pa))) {
+	/* window pictures track the window size, so keep them while managed */
+	if (!c->pict.title &&
+	    !(c->pict.title = XRenderCreatePicture(dpy, c->title, ds->format, pamask, &pa))) {
 		EPRINTF("could not create title picture\n");
 		return;
 	}
-	c->pict.title = dst;
-	ds->dc.draw.pict = dst;
+	dst = ds->dc.draw.pict;
 
 	bg = &getcolor(ds, c, ColBG)->color;
 	bc = &getcolor(ds, c, ColBorder)->color;
@@ -1218,22 +1215,19 @@ render_drawnormal(AScreen *ds, Client *c)
 		XRenderFillRectangle(dpy, PictOpOver, dst, bc, 0, ds->dc.h - ds->style.border, ds->dc.w, ds->style.border);
 		xtrap_pop();
 	}
-	if (!c->grips)
+	XRenderComposite(dpy, PictOpSrc, dst, None, c->pict.title, 0, 0, 0, 0, 0, 0,
+			 ds->dc.w, ds->dc.h);
+	if (!c->grips || c->drawn.grips)
 		return;
 
 	ds->dc.x = ds->dc.y = 0;
 	ds->dc.w = c->c.w;
 	ds->dc.h = ds->style.gripsheight;
-	/* try freeing the old picture before creating the new one! */
-	if (c->pict.grips) {
-		XRenderFreePicture(dpy, c->pict.grips);
-		c->pict.grips = None;
-	}
-	if (!(dst = XRenderCreatePicture(dpy, c->grips, ds->format, pamask, &pa))) {
+	if (!c->pict.grips &&
+	    !(c->pict.grips = XRenderCreatePicture(dpy, c->grips, ds->format, pamask, &pa))) {
 		EPRINTF("could not create grips picture\n");
 		return;
 	}
-	c->pict.grips = dst;
 
 	{
 	xtrap_push(True,NULL);
@@ -1251,6 +1245,8 @@ render_drawnormal(AScreen *ds, Client *c)
 		XRenderFillRectangle(dpy, PictOpOver, dst, bc, ds->dc.x, 0, ds->style.border, ds->dc.h);
 		xtrap_pop();
 	}
+	XRenderComposite(dpy, PictOpSrc, dst, None, c->pict.grips, 0, 0, 0, 0, 0, 0,
+			 ds->dc.w, ds->dc.h);
 }
 
 Bool
@@ -74,14 +74,167 @@ void getshadow(const char *descrip, TextShadow * shadow);
 #endif				/* !defined PIXBUF || !defined USE_PIXBUF */
 #endif				/* !defined IMLIB2 || !defined USE_IMLIB2 */
 
+/*
+ * Resource lookups are memoized per database, name and class.  A miss splits
+ * off the last component and looks it up in the search list of the prefix
+ * (e.g. "adwm.screen0"), which is built once with XrmQGetSearchList() and
+ * shared by every resource under that prefix.  Both caches refer into the
+ * databases and are dropped by flushresources() whenever one is changed.
+ */
+typedef struct ResEntry ResEntry;
+
+struct ResEntry {
+	ResEntry *next;
+	XrmDatabase db;
+	char *name;			/* name followed by class */
+	const char *clas;
+	const char *value;		/* NULL when not found */
+};
+
+typedef struct ResList ResList;
+
+struct ResList {
+	ResList *next;
+	XrmDatabase db;
+	char *name;			/* prefix name followed by prefix class */
+	const char *clas;
+	XrmHashTable *list;
+	Bool ok;			/* XrmQGetSearchList() succeeded */
+};
+
+#define RESMEMO_SIZE	1024		/* buckets in the memo, a power of two */
+
+static struct {
+	ResEntry *entries[RESMEMO_SIZE];
+	ResList *lists;
+} resmemo;
+
+ResStats resstats = { 0, };
+
+static unsigned
+hashres(XrmDatabase db, const char *name, const char *clas)
+{
+	unsigned h = 2166136261U ^ (unsigned) (uintptr_t) db;
+
+	for (; *name; name++)
+		h = (h ^ (unsigned char) *name) * 16777619U;
+	for (; *clas; clas++)
+		h = (h ^ (unsigned char) *clas) * 16777619U;
+	return (h & (RESMEMO_SIZE - 1));
+}
+
+static char *
+dupnames(const char *name, size_t nlen, const char *clas, size_t clen, const char **cp)
+{
+	char *buf = ecalloc(nlen + clen + 2, sizeof(*buf));
+
+	memcpy(buf, name, nlen);
+	memcpy(buf + nlen + 1, clas, clen);
+	*cp = buf + nlen + 1;
+	return (buf);
+}
+
+static ResList *
+getreslist(XrmDatabase db, const char *name, size_t nlen, const char *clas, size_t clen)
+{
+	XrmQuark names[32], classes[32];
+	ResList *rl;
+	int size;
+
+	for (rl = resmemo.lists; rl; rl = rl->next)
+		if (rl->db == db && strlen(rl->name) == nlen && strlen(rl->clas) == clen &&
+		    !strncmp(rl->name, name, nlen) && !strncmp(rl->clas, clas, clen))
+			return (rl);
+	rl = ecalloc(1, sizeof(*rl));
+	rl->db = db;
+	rl->name = dupnames(name, nlen, clas, clen, &rl->clas);
+	XrmStringToQuarkList(rl->name, names);
+	XrmStringToQuarkList(rl->clas, classes);
+	for (size = 32;; size <<= 1) {
+		rl->list = erealloc(rl->list, size * sizeof(*rl->list));
+		if ((rl->ok = XrmQGetSearchList(db, names, classes, rl->list, size)))
+			break;
+		if (size >= 4096)
+			break;
+	}
+	rl->next = resmemo.lists;
+	resmemo.lists = rl;
+	resstats.lists++;
+	return (rl);
+}
+
+/** @brief look up a resource by fully qualified name and class
+  */
 const char *
-readres(const char *name, const char *clas, const char *defval)
+lookupres(XrmDatabase db, const char *name, const char *clas)
 {
-	char *type = NULL;
+	const char *nlast, *clast, *type = NULL;
+	XrmRepresentation qtype;
 	XrmValue value = { 0, NULL };
+	ResEntry *re;
+	ResList *rl;
+	unsigned h;
+
+	if (!db)
+		return (NULL);
+	resstats.lookups++;
+	h = hashres(db, name, clas);
+	for (re = resmemo.entries[h]; re; re = re->next)
+		if (re->db == db && !strcmp(re->name, name) && !strcmp(re->clas, clas)) {
+			resstats.hits++;
+			return (re->value);
+		}
+	re = ecalloc(1, sizeof(*re));
+	re->db = db;
+	re->name = dupnames(name, strlen(name), clas, strlen(clas), &re->clas);
+	nlast = strrchr(name, '.');
+	clast = strrchr(clas, '.');
+	if (nlast && clast && (rl = getreslist(db, name, nlast - name, clas, clast - clas)) &&
+	    rl->ok) {
+		if (XrmQGetSearchResource(rl->list, XrmStringToQuark(nlast + 1),
+					  XrmStringToQuark(clast + 1), &qtype, &value))
+			re->value = value.addr;
+	} else if (XrmGetResource(db, name, clas, (char **) &type, &value))
+		re->value = value.addr;
+	re->next = resmemo.entries[h];
+	resmemo.entries[h] = re;
+	return (re->value);
+}
+
+/** @brief forget memoized lookups after a resource database changes
+  */
+void
+flushresources(void)
+{
+	ResEntry *re, *rnext;
+	ResList *rl, *lnext;
+	unsigned h;
+
+	for (h = 0; h < RESMEMO_SIZE; h++) {
+		for (re = resmemo.entries[h]; re; re = rnext) {
+			rnext = re->next;
+			free(re->name);
+			free(re);
+		}
+		resmemo.entries[h] = NULL;
+	}
+	for (rl = resmemo.lists; rl; rl = lnext) {
+		lnext = rl->next;
+		free(rl->name);
+		free(rl->list);
+		free(rl);
+	}
+	resmemo.lists = NULL;
+	resstats.flushes++;
+}
+
+const char *
+readres(const char *name, const char *clas, const char *defval)
+{
+	const char *value;
 
-	if (XrmGetResource(xresdb, name, clas, &type, &value) && value.addr)
-		return value.addr;
+	if ((value = lookupres(xresdb, name, clas)))
+		return value;
 	return defval;
 }
 
@@ -168,6 +168,10 @@ save(FILE *file, Bool permanent)
 		fprintf(file, "Adwm*dock.monitor:\t\t%d\n", options.dockmon);
 	if (options.dragdist != 5)
 		fprintf(file, "Adwm*dragdistance:\t\t%d\n", options.dragdist);
+	if (options.framerate != 0)
+		fprintf(file, "Adwm*framerate:\t\t%d\n", options.framerate);
+	if (options.releasedelay != 0)
+		fprintf(file, "Adwm*releasedelay:\t\t%d\n", options.releasedelay);
 	if (options.mwfact != DEFMWFACT)
 		fprintf(file, "Adwm*mwfact:\t\t%f\n", options.mwfact);
 	if (options.mhfact != DEFMHFACT)
@@ -232,6 +236,10 @@ save(FILE *file, Bool permanent)
 			fprintf(file, "Adwm.screen%u.dock.monitor:\t\t%d\n", scr->screen, scr->options.dockmon);
 		if (scr->options.dragdist != options.dragdist)
 			fprintf(file, "Adwm.screen%u.dragdistance:\t\t%d\n", scr->screen, scr->options.dragdist);
+		if (scr->options.framerate != options.framerate)
+			fprintf(file, "Adwm.screen%u.framerate:\t\t%d\n", scr->screen, scr->options.framerate);
+		if (scr->options.releasedelay != options.releasedelay)
+			fprintf(file, "Adwm.screen%u.releasedelay:\t\t%d\n", scr->screen, scr->options.releasedelay);
 		if (scr->options.mwfact != options.mwfact)
 			fprintf(file, "Adwm.screen%u.mwfact:\t\t%f\n", scr->screen, scr->options.mwfact);
 		if (scr->options.mhfact != options.mhfact)
@@ -0,0 +1,224 @@
+/* See COPYING file for copyright and license details. */
+
+#include "adwm.h"
+#include "timer.h" /* verification */
+
+/*
+ * A hierarchical timer wheel with a resolution of one millisecond.  Level 0
+ * holds the timers due within the next WHEEL_SIZE ticks, one slot per tick;
+ * each higher level covers WHEEL_SIZE times the span of the level below and is
+ * cascaded into it whenever the lower level wraps.  Starting and stopping a
+ * timer is constant time, and run() asks timer_timeout() how long it may
+ * sleep in poll() before the next timer is due.
+ */
+
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1UL << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+#define WHEEL_SPAN	(1UL << (WHEEL_BITS * WHEEL_LEVELS))
+
+static struct {
+	unsigned long now;		/* next tick to be processed */
+	unsigned count;			/* timers on the wheel */
+	Timer *slots[WHEEL_LEVELS][WHEEL_SIZE];
+} wheel;
+
+TimerStats timerstats = { 0, };
+
+static unsigned long
+timer_ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+timer_link(Timer *t)
+{
+	unsigned long delta;
+	Timer **slot;
+	int level;
+
+	if ((long) (t->expires - wheel.now) < 0)
+		t->expires = wheel.now;
+	/* beyond the wheel: park in the last slot and cascade again from there */
+	if ((delta = t->expires - wheel.now) >= WHEEL_SPAN)
+		delta = WHEEL_SPAN - 1;
+	for (level = 0; delta >= (WHEEL_SIZE << (WHEEL_BITS * level)); level++) ;
+	slot = &wheel.slots[level][((wheel.now + delta) >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	if ((t->next = *slot))
+		t->next->prev = &t->next;
+	t->prev = slot;
+	*slot = t;
+}
+
+static void
+timer_unlink(Timer *t)
+{
+	if ((*t->prev = t->next))
+		t->next->prev = t->prev;
+	t->next = NULL;
+	t->prev = NULL;
+}
+
+void
+timer_init(Timer *t, TimerFunc func, void *data)
+{
+	t->next = NULL;
+	t->prev = NULL;
+	t->expires = 0;
+	t->period = 0;
+	t->func = func;
+	t->data = data;
+}
+
+/*
+ * Arm (or re-arm) a timer to fire in msec milliseconds, and every period
+ * milliseconds after that when period is not zero.
+ */
+void
+timer_start(Timer *t, unsigned long msec, unsigned long period)
+{
+	unsigned long now = timer_ticks();
+
+	if (t->prev)
+		timer_unlink(t);
+	else if (!wheel.count++)
+		wheel.now = now;	/* the wheel is idle: catch it up */
+	t->expires = now + msec;
+	t->period = period;
+	timer_link(t);
+	timerstats.started++;
+}
+
+void
+timer_stop(Timer *t)
+{
+	if (!t->prev)
+		return;
+	timer_unlink(t);
+	wheel.count--;
+}
+
+Bool
+timer_pending(const Timer *t)
+{
+	return (t->prev ? True : False);
+}
+
+/*
+ * The first tick at or after the next one to be processed at which something
+ * happens: a level 0 slot fires or a higher level slot cascades, whichever
+ * comes first.  A cascade may bring a timer due before the first occupied
+ * level 0 slot, so the wheel must not be advanced past a non-empty cascade.
+ */
+static unsigned long
+timer_next(void)
+{
+	unsigned long best = wheel.now + WHEEL_SPAN, tick, k;
+	int level;
+
+	for (k = 0; k < WHEEL_SIZE; k++)
+		if (wheel.slots[0][(wheel.now + k) & WHEEL_MASK]) {
+			best = wheel.now + k;
+			break;
+		}
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		unsigned shift = WHEEL_BITS * level;
+
+		for (k = 0; k <= WHEEL_SIZE; k++) {
+			tick = ((wheel.now >> shift) + k) << shift;
+			if ((long) (tick - wheel.now) < 0)
+				continue;
+			if ((long) (tick - best) >= 0)
+				break;
+			if (wheel.slots[level][(tick >> shift) & WHEEL_MASK]) {
+				best = tick;
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+/*
+ * Milliseconds until the wheel next needs attention, or -1 when no timers are
+ * armed: suitable as the poll() timeout.
+ */
+int
+timer_timeout(void)
+{
+	unsigned long now, next;
+
+	if (!wheel.count)
+		return -1;
+	now = timer_ticks();
+	if ((long) ((next = timer_next()) - now) <= 0)
+		return 0;
+	if (next - now > INT_MAX)
+		return INT_MAX;
+	return (next - now);
+}
+
+static void
+timer_cascade(int level)
+{
+	unsigned shift = WHEEL_BITS * level;
+	Timer *t, **slot = &wheel.slots[level][(wheel.now >> shift) & WHEEL_MASK];
+
+	while ((t = *slot)) {
+		timer_unlink(t);
+		timer_link(t);
+		timerstats.cascaded++;
+	}
+}
+
+/*
+ * Fire every timer that has come due.  Callbacks may start and stop timers,
+ * including the one that is firing.
+ */
+void
+timer_run(void)
+{
+	unsigned long now, next;
+
+	if (!wheel.count)
+		return;
+	now = timer_ticks();
+	while ((long) (now - wheel.now) >= 0) {
+		unsigned idx = wheel.now & WHEEL_MASK;
+		Timer *t, *list;
+		int level;
+
+		for (level = 1; level < WHEEL_LEVELS && !((wheel.now >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK); level++)
+			timer_cascade(level);
+		/* callbacks may add timers that are already due to this slot */
+		while ((list = wheel.slots[0][idx])) {
+			wheel.slots[0][idx] = NULL;
+			list->prev = &list;
+			while ((t = list)) {
+				timer_unlink(t);
+				if (t->period) {
+					t->expires += t->period;
+					if ((long) (t->expires - now) <= 0)
+						t->expires = now + 1;
+					timer_link(t);
+				} else
+					wheel.count--;
+				timerstats.fired++;
+				t->func(t, t->data);
+			}
+		}
+		wheel.now++;
+		if (!wheel.count) {
+			wheel.now = now + 1;
+			break;
+		}
+		/* skip the ticks on which nothing happens: any cascade skipped is empty */
+		if ((long) ((next = timer_next()) - wheel.now) > 0)
+			wheel.now = ((long) (next - now) > 0) ? now + 1 : next;
+	}
+}
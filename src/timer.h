@@ -0,0 +1,13 @@
+/* timer.c */
+
+#ifndef __LOCAL_TIMER_H__
+#define __LOCAL_TIMER_H__
+
+void timer_init(Timer *t, TimerFunc func, void *data);
+void timer_start(Timer *t, unsigned long msec, unsigned long period);
+void timer_stop(Timer *t);
+Bool timer_pending(const Timer *t);
+int timer_timeout(void);
+void timer_run(void);
+
+#endif				/* __LOCAL_TIMER_H__ */
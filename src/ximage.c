@@ -488,6 +488,56 @@ ximage_drawdamage(Client *c, XDamageNotifyEvent *ev)
 }
 #endif
 
+/** @brief blend an ARGB button image over its background and put it
+  *
+  * The image holds ARGB whatever the visual; it is composited against the
+  * background (and, for bitmaps, colorized with the foreground) into an ARGB
+  * buffer which renderimage() converts to the pixel format of the screen.
+  */
+static void
+ximage_blendimage(AScreen *ds, Drawable d, AdwmPixmap *px, XImage *xsrc, XftColor *fg,
+		  XftColor *bg, int x, int y)
+{
+	ARGB *argb, *p;
+	unsigned long pixel;
+	unsigned A, R, G, B;
+	unsigned rf, gf, bf, rb, gb, bb;
+	unsigned i, j;
+
+	if (!px->w || !px->h)
+		return;
+	rb = bg->color.red >> 8;
+	gb = bg->color.green >> 8;
+	bb = bg->color.blue >> 8;
+	rf = fg ? fg->color.red >> 8 : 0;
+	gf = fg ? fg->color.green >> 8 : 0;
+	bf = fg ? fg->color.blue >> 8 : 0;
+
+	p = argb = ecalloc((size_t) px->w * px->h, sizeof(*argb));
+	for (j = 0; j < px->h; j++) {
+		for (i = 0; i < px->w; i++, p++) {
+			pixel = XGetPixel(xsrc, px->x + i, px->y + j);
+
+			A = (pixel >> 24) & 0xff;
+			if (fg) {
+				R = rf;
+				G = gf;
+				B = bf;
+			} else {
+				R = (pixel >> 16) & 0xff;
+				G = (pixel >>  8) & 0xff;
+				B = (pixel >>  0) & 0xff;
+			}
+			p->red   = min(255, ((A * R) + ((255 - A) * rb)) / 255);
+			p->green = min(255, ((A * G) + ((255 - A) * gb)) / 255);
+			p->blue  = min(255, ((A * B) + ((255 - A) * bb)) / 255);
+			p->alpha = 255;
+		}
+	}
+	renderimage(ds, d, ds->dc.gc, argb, x, y, px->w, px->h);
+	free(argb);
+}
+
 int
 ximage_drawbutton(AScreen *ds, Client *c, ElementType type, XftColor *col, int x)
 {
@@ -520,111 +570,28 @@ ximage_drawbutton(AScreen *ds, Client *c, ElementType type, XftColor *col, int x
 	fg = ec->pressed ? &col[ColFG] : &col[ColButton];
 	bg = bi->bg.pixel ? &bi->bg : &col[ColBG];
 
+	if (px->bitmap.ximage || px->pixmap.ximage) {
+		/* TODO: eventually this should be a texture */
+		/* always draw the element background */
+		XSetForeground(dpy, ds->dc.gc, bg->pixel);
+		XSetFillStyle(dpy, ds->dc.gc, FillSolid);
+		status = XFillRectangle(dpy, d, ds->dc.gc, ec->eg.x, ec->eg.y, ec->eg.w, ec->eg.h);
+		if (!status)
+			XPRINTF("Could not fill rectangle, error %d\n", status);
+		XSetForeground(dpy, ds->dc.gc, fg->pixel);
+		XSetBackground(dpy, ds->dc.gc, bg->pixel);
+	}
 	if (px->bitmap.ximage) {
-		XImage *ximage;
-
-		if ((ximage = XSubImage(px->bitmap.ximage, 0, 0,
-					px->bitmap.ximage->width,
-					px->bitmap.ximage->height))) {
-			unsigned long pixel;
-			unsigned A, R, G, B;
-			int i, j;
-
-			unsigned rf = (fg->pixel >> 16) & 0xff;
-			unsigned gf = (fg->pixel >>  8) & 0xff;
-			unsigned bf = (fg->pixel >>  0) & 0xff;
-
-			unsigned rb = (bg->pixel >> 16) & 0xff;
-			unsigned gb = (bg->pixel >>  8) & 0xff;
-			unsigned bb = (bg->pixel >>  0) & 0xff;
-
-			/* blend image with foreground and background */
-			for (j = 0; j < ximage->height; j++) {
-				for (i = 0; i < ximage->width; i++) {
-					pixel = XGetPixel(ximage, i, j);
-
-					A = (pixel >> 24) & 0xff;
-					R = (pixel >> 16) & 0xff;
-					G = (pixel >>  8) & 0xff;
-					B = (pixel >>  0) & 0xff;
-
-					R = min(255, lround(((A * rf) + ((255 - A) * rb)) / 255));
-					G = min(255, lround(((A * gf) + ((255 - A) * gb)) / 255));
-					B = min(255, lround(((A * bf) + ((255 - A) * bb)) / 255));
-
-					A = 255;
-					pixel = (A << 24) | (R << 16) | (G << 8) | B;
-					XPutPixel(ximage, i, j, pixel);
-				}
-			}
-			{
-				/* TODO: eventually this should be a texture */
-				/* always draw the element background */
-				XSetForeground(dpy, ds->dc.gc, bg->pixel);
-				XSetFillStyle(dpy, ds->dc.gc, FillSolid);
-				status = XFillRectangle(dpy, d, ds->dc.gc, ec->eg.x, ec->eg.y, ec->eg.w, ec->eg.h);
-				if (!status)
-					XPRINTF("Could not fill rectangle, error %d\n", status);
-				XSetForeground(dpy, ds->dc.gc, fg->pixel);
-				XSetBackground(dpy, ds->dc.gc, bg->pixel);
-			}
-			XPRINTF(__CFMTS(c) "copying bitmap ximage %dx%dx%d+%d+%d to +%d+%d\n", __CARGS(c),
-					px->w, px->h, px->d, px->x, px->y, ec->eg.x, ec->eg.y);
-			XPutImage(dpy, d, ds->dc.gc, ximage, px->x, px->y, ec->eg.x, ec->eg.y, px->w, px->h);
-			XDestroyImage(ximage);
-			return g.w;
-		}
+		XPRINTF(__CFMTS(c) "copying bitmap ximage %dx%dx%d+%d+%d to +%d+%d\n", __CARGS(c),
+				px->w, px->h, px->d, px->x, px->y, ec->eg.x, ec->eg.y);
+		ximage_blendimage(ds, d, px, px->bitmap.ximage, fg, bg, ec->eg.x, ec->eg.y);
+		return g.w;
 	}
 	if (px->pixmap.ximage) {
-		XImage *ximage;
-
-		if ((ximage = XSubImage(px->pixmap.ximage, 0, 0,
-					px->pixmap.ximage->width,
-					px->pixmap.ximage->height))) {
-			unsigned long pixel;
-			unsigned A, R, G, B;
-			int i, j;
-
-			unsigned rb = (bg->pixel >> 16) & 0xff;
-			unsigned gb = (bg->pixel >>  8) & 0xff;
-			unsigned bb = (bg->pixel >>  0) & 0xff;
-
-			/* blend image with foreground and background */
-			for (j = 0; j < ximage->height; j++) {
-				for (i = 0; i < ximage->width; i++) {
-					pixel = XGetPixel(ximage, i, j);
-
-					A = (pixel >> 24) & 0xff;
-					R = (pixel >> 16) & 0xff;
-					G = (pixel >>  8) & 0xff;
-					B = (pixel >>  0) & 0xff;
-
-					R = min(255, lround(((A * R) + ((255 - A) * rb)) / 255));
-					G = min(255, lround(((A * G) + ((255 - A) * gb)) / 255));
-					B = min(255, lround(((A * B) + ((255 - A) * bb)) / 255));
-
-					A = 255;
-					pixel = (A << 24) | (R << 16) | (G << 8) | B;
-					XPutPixel(ximage, i, j, pixel);
-				}
-			}
-			{
-				/* TODO: eventually this should be a texture */
-				/* always draw the element background */
-				XSetForeground(dpy, ds->dc.gc, bg->pixel);
-				XSetFillStyle(dpy, ds->dc.gc, FillSolid);
-				status = XFillRectangle(dpy, d, ds->dc.gc, ec->eg.x, ec->eg.y, ec->eg.w, ec->eg.h);
-				if (!status)
-					XPRINTF("Could not fill rectangle, error %d\n", status);
-				XSetForeground(dpy, ds->dc.gc, fg->pixel);
-				XSetBackground(dpy, ds->dc.gc, bg->pixel);
-			}
-			XPRINTF(__CFMTS(c) "copying pixmap ximage %dx%dx%d+%d+%d to +%d+%d\n", __CARGS(c),
-					px->w, px->h, px->d, px->x, px->y, ec->eg.x, ec->eg.y);
-			XPutImage(dpy, d, ds->dc.gc, ximage, px->x, px->y, ec->eg.x, ec->eg.y, px->w, px->h);
-			XDestroyImage(ximage);
-			return g.w;
-		}
+		XPRINTF(__CFMTS(c) "copying pixmap ximage %dx%dx%d+%d+%d to +%d+%d\n", __CARGS(c),
+				px->w, px->h, px->d, px->x, px->y, ec->eg.x, ec->eg.y);
+		ximage_blendimage(ds, d, px, px->pixmap.ximage, NULL, bg, ec->eg.x, ec->eg.y);
+		return g.w;
 	}
 	XPRINTF("button %d has no pixmap or bitmap\n", type);
 	return 0;
@@ -665,7 +632,7 @@ ximage_drawtext(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdr
 {
 	int w, h;
 	char buf[256];
-	unsigned int len, olen;
+	unsigned int len;
 	int gap, status;
 	XftFont *font = ds->style.font[hilite];
 	struct _FontInfo *info = &ds->dc.font[hilite];
@@ -674,29 +641,12 @@ ximage_drawtext(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdr
 
 	if (!text)
 		return 0;
-	olen = len = strlen(text);
-	w = 0;
-	if (len >= sizeof buf)
-		len = sizeof buf - 1;
-	memcpy(buf, text, len);
-	buf[len] = 0;
 	h = ds->style.titleheight;
 	y = ds->dc.h / 2 + info->ascent / 2 - 1 - ds->style.outline;
 	gap = info->height / 2;
 	x += gap;
 	/* shorten text if necessary */
-	while (len && (w = textnw(ds, buf, len, hilite)) > mw) {
-		buf[--len] = 0;
-	}
-	if (len < olen) {
-		if (len > 1)
-			buf[len - 1] = '.';
-		if (len > 2)
-			buf[len - 2] = '.';
-		if (len > 3)
-			buf[len - 3] = '.';
-	}
-	if (w > mw)
+	if ((w = textfit(ds, text, hilite, mw, buf, sizeof buf, &len)) < 0)
 		return 0;	/* too long */
 	while (x <= 0)
 		x = ds->dc.x++;
@@ -713,6 +663,97 @@ ximage_drawtext(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdr
 	return w + gap * 2;
 }
 
+#ifdef RENDER
+/*
+ * Client titles are rendered once into a coverage mask and composited through it
+ * in the title colours, so that redrawing a title for a change of focus or
+ * hover costs one composite (two with a shadow) instead of laying out and
+ * rasterizing the glyphs again.  The mask is only rendered again when the
+ * fitted title, its size or the font changes.
+ */
+static void
+ximage_drawtextlayer(AScreen *ds, Client *c, XftFont *font, const char *buf, unsigned len,
+		     unsigned w, unsigned h, int x, int y)
+{
+	static const XRenderColor clear = { 0, 0, 0, 0 };
+	static const XRenderColor white = { 0xffff, 0xffff, 0xffff, 0xffff };
+	XRenderPictureAttributes pa = { .component_alpha = True, };
+	Picture fill;
+
+	if (!c->layer.mask || c->layer.w != w || c->layer.h != h) {
+		freetextlayer(c);
+		/* per channel coverage keeps subpixel antialiased glyphs intact */
+		c->layer.pixmap = XCreatePixmap(dpy, ds->drawable, w, h, 32);
+		c->layer.mask = XRenderCreatePicture(dpy, c->layer.pixmap,
+						     XRenderFindStandardFormat(dpy, PictStandardARGB32),
+						     CPComponentAlpha, &pa);
+		c->layer.w = w;
+		c->layer.h = h;
+	}
+	XRenderFillRectangle(dpy, PictOpSrc, c->layer.mask, &clear, 0, 0, w, h);
+	fill = XRenderCreateSolidFill(dpy, &white);
+	XftTextRenderUtf8(dpy, PictOpOver, fill, font, c->layer.mask, 0, 0, x, y,
+			  (const FcChar8 *) buf, len);
+	XRenderFreePicture(dpy, fill);
+	free(c->layer.text);
+	c->layer.text = strdup(buf);
+	c->layer.font = font;
+	textstats.layers++;
+}
+
+int
+ximage_drawtitle(AScreen *ds, Client *c, Drawable drawable, XftDraw *xftdraw,
+		 XftColor *col, int hilite, int x, int y, int mw)
+{
+	int w, h;
+	char buf[256];
+	unsigned int len, lw;
+	int gap, status;
+	XftFont *font = ds->style.font[hilite];
+	struct _FontInfo *info = &ds->dc.font[hilite];
+	XftColor *fcol = ds->style.color.hue[hilite];
+	int drop = ds->style.drop[hilite];
+	Picture dst, src;
+
+	if (!(dst = XftDrawPicture(xftdraw)))
+		/* no RENDER on the display: draw the glyphs every time */
+		return ximage_drawtext(ds, c->name, drawable, xftdraw, col, hilite, x, y, mw);
+	if (!c->name)
+		return 0;
+	h = ds->style.titleheight;
+	y = ds->dc.h / 2 + info->ascent / 2 - 1 - ds->style.outline;
+	gap = info->height / 2;
+	x += gap;
+	/* shorten text if necessary */
+	if ((w = textfit(ds, c->name, hilite, mw, buf, sizeof buf, &len)) < 0)
+		return 0;	/* too long */
+	while (x <= 0)
+		x = ds->dc.x++;
+	lw = w + gap * 2;
+
+	if (c->layer.font != font || c->layer.w != lw || c->layer.h != (unsigned) h ||
+	    !c->layer.text || strcmp(c->layer.text, buf))
+		ximage_drawtextlayer(ds, c, font, buf, len, lw, h, gap, y);
+	else
+		textstats.composited++;
+
+	XSetForeground(dpy, ds->dc.gc, col[ColBG].pixel);
+	XSetFillStyle(dpy, ds->dc.gc, FillSolid);
+	status = XFillRectangle(dpy, drawable, ds->dc.gc, x - gap, 0, lw, h);
+	if (!status)
+		XPRINTF("Could not fill rectangle, error %d\n", status);
+	if (drop) {
+		src = XftDrawSrcPicture(xftdraw, &fcol[ColShadow]);
+		XRenderComposite(dpy, PictOpOver, src, c->layer.mask, dst, 0, 0, 0, 0,
+				 x - gap + drop, drop, lw, h);
+	}
+	src = XftDrawSrcPicture(xftdraw, &fcol[ColFG]);
+	XRenderComposite(dpy, PictOpOver, src, c->layer.mask, dst, 0, 0, 0, 0,
+			 x - gap, 0, lw, h);
+	return lw;
+}
+#endif
+
 void
 ximage_drawdockapp(AScreen *ds, Client *c)
 {
@@ -810,7 +851,11 @@ ximage_drawnormal(AScreen *ds, Client *c)
 	/* Don't know about this... */
 	if (ds->dc.w < (int) textw(ds, c->name, gethilite(c))) {
 		ds->dc.w -= elementw(ds, c, CloseBtn);
+#ifdef RENDER
+		ximage_drawtitle(ds, c, ds->dc.draw.pixmap, ds->dc.draw.xft, gethues(ds, c), gethilite(c), ds->dc.x, ds->dc.y, ds->dc.w);
+#else
 		ximage_drawtext(ds, c->name, ds->dc.draw.pixmap, ds->dc.draw.xft, gethues(ds, c), gethilite(c), ds->dc.x, ds->dc.y, ds->dc.w);
+#endif
 		ximage_drawbutton(ds, c, CloseBtn, gethues(ds, c), ds->dc.w);
 		goto end;
 	}
@@ -857,7 +902,7 @@ ximage_drawnormal(AScreen *ds, Client *c)
 	XPRINTF(__CFMTS(c) "copying title pixmap to %dx%d+%d+%d to +%d+%d\n", __CARGS(c), c->c.w, ds->dc.h, 0, 0, 0, 0);
 	XCopyArea(dpy, ds->dc.draw.pixmap, c->title, ds->dc.gc, 0, 0, c->c.w, ds->dc.h, 0, 0);
 
-	if (!c->grips)
+	if (!c->grips || c->drawn.grips)
 		return;
 
 	ds->dc.x = ds->dc.y = 0;
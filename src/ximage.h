@@ -16,6 +16,9 @@ Bool ximage_drawdamage(Client *c, XDamageNotifyEvent *ev);
 #endif
 int ximage_drawbutton(AScreen *ds, Client *c, ElementType type, XftColor *col, int x);
 int ximage_drawtext(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdraw, XftColor *col, int hilite, int x, int y, int mw);
+#ifdef RENDER
+int ximage_drawtitle(AScreen *ds, Client *c, Drawable drawable, XftDraw *xftdraw, XftColor *col, int hilite, int x, int y, int mw);
+#endif
 int ximage_drawsep(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdraw, XftColor *col, int hilite, int x, int y, int w);
 void ximage_drawdockapp(AScreen *ds, Client *c);
 void ximage_drawnormal(AScreen *ds, Client *c);
@@ -1103,7 +1103,7 @@ xlib_drawtext(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdraw
 {
 	int w, h;
 	char buf[256];
-	unsigned int len, olen;
+	unsigned int len;
 	int gap, status;
 	XftFont *font = ds->style.font[hilite];
 	struct _FontInfo *info = &ds->dc.font[hilite];
@@ -1112,29 +1112,12 @@ xlib_drawtext(AScreen *ds, const char *text, Drawable drawable, XftDraw *xftdraw
 
 	if (!text)
 		return 0;
-	olen = len = strlen(text);
-	w = 0;
-	if (len >= sizeof buf)
-		len = sizeof buf - 1;
-	memcpy(buf, text, len);
-	buf[len] = 0;
 	h = ds->style.titleheight;
 	y = ds->dc.h / 2 + info->ascent / 2 - 1 - ds->style.outline;
 	gap = info->height / 2;
 	x += gap;
 	/* shorten text if necessary */
-	while (len && (w = textnw(ds, buf, len, hilite)) > mw) {
-		buf[--len] = 0;
-	}
-	if (len < olen) {
-		if (len > 1)
-			buf[len - 1] = '.';
-		if (len > 2)
-			buf[len - 2] = '.';
-		if (len > 3)
-			buf[len - 3] = '.';
-	}
-	if (w > mw)
+	if ((w = textfit(ds, text, hilite, mw, buf, sizeof buf, &len)) < 0)
 		return 0;	/* too long */
 	while (x <= 0)
 		x = ds->dc.x++;
@@ -1266,6 +1249,8 @@ xlib_drawnormal(AScreen *ds, Client *c)
 		XCopyArea(dpy, ds->dc.draw.pixmap, c->title, ds->dc.gc, 0, 0, c->c.w,
 			  ds->dc.h, 0, 0);
 	}
+	if (!c->grips || c->drawn.grips)
+		return;
 	ds->dc.x = ds->dc.y = 0;
 	ds->dc.w = c->c.w;
 	ds->dc.h = ds->style.gripsheight;